@@ -7,6 +7,15 @@
 #include<linux/device.h>
 #include<linux/delay.h>
 #include<linux/interrupt.h>
+#include<linux/workqueue.h>
+#include<linux/completion.h>
+#include<linux/slab.h>
+#include<linux/mutex.h>
+#include<linux/rcupdate.h>
+#include<linux/hrtimer.h>
+#include "led_bitmap.h"
+#include "led_rules.h"
+#include "selftest.h"
 
 typedef struct mydevice {
     char *device_name;
@@ -14,18 +23,212 @@ typedef struct mydevice {
     dev_t dev_nr;
     struct class *dev_class;
     struct cdev cdev;
-    int led_gpio;
-    int button_gpio;
-    int irq_nr;
 } mydevice;
 
+/* Button lines, input <n> of the rules */
+#define MAX_BUTTONS 8
+static int btn_gpios[MAX_BUTTONS] = { 529 };    // GPIO17
+static int nr_btns = 1;
+module_param_array(btn_gpios, int, &nr_btns, 0444);
+MODULE_PARM_DESC(btn_gpios, "GPIO numbers of the buttons");
+static int btn_irqs[MAX_BUTTONS];
+
+/* LED lines, set together with one write */
+static int led_gpios[LED_BITMAP_MAX] = { 539 };  // GPIO27
+static int nr_leds = 1;
+module_param_array(led_gpios, int, &nr_leds, 0444);
+MODULE_PARM_DESC(led_gpios, "GPIO numbers of the LEDs");
+static struct gpio_desc *led_descs[LED_BITMAP_MAX];
+static unsigned long led_state;                 // level of every LED, for toggle
+
+static void leds_set(const unsigned long *bits){
+    WRITE_ONCE(led_state, bits[0]);
+    gpiod_set_array_value(nr_leds, led_descs, NULL, (unsigned long *)bits);
+}
+
+static void leds_set_all(int value){
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+
+    if (value)
+        bitmap_fill(bits, nr_leds);
+    else
+        bitmap_zero(bits, nr_leds);
+    leds_set(bits);
+}
+
 static mydevice mydev = {
     .device_name = "led_control",
     .class_name = "led_class",
-    .led_gpio = 539,     // GPIO27
-    .button_gpio = 529 // GPIO17
 };
 
+/*
+ * Rules, see led_rules.h. The interrupt reads the table under RCU only, an
+ * upload builds a new table and swaps it in, the old one is freed after a
+ * grace period.
+ */
+struct rule_table {
+    struct rcu_head rcu;
+    unsigned int nr;
+    led_rule rules[];
+};
+
+static struct rule_table __rcu *rules;
+static DEFINE_MUTEX(rules_lock);                // serialises uploads
+static struct hrtimer pulse_timers[LED_BITMAP_MAX];
+
+/* LED self-test runs after the module is loaded, I/O waits until it is done */
+static void selftest_done_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(selftest_work, selftest_done_fn);
+static DECLARE_COMPLETION(init_done);
+
+static void selftest_done_fn(struct work_struct *work){
+    leds_set_all(0);
+    complete_all(&init_done);
+    printk("INFO: LED self-test done\n");
+}
+
+/**
+ * @brief Set one LED, any context
+ */
+static void led_out(unsigned int led, int value){
+    if (value)
+        set_bit(led, &led_state);
+    else
+        clear_bit(led, &led_state);
+    gpiod_set_value(led_descs[led], value);
+}
+
+/**
+ * @brief End of a pulse
+ */
+static enum hrtimer_restart pulse_fn(struct hrtimer *timer){
+    led_out(timer - pulse_timers, 0);
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * @brief Run one rule from the interrupt
+ */
+static void rule_run(const led_rule *rule, int level){
+    unsigned int led = rule->output;
+
+    switch (rule->action) {
+    case LED_RULE_SET:
+        led_out(led, 1);
+        break;
+    case LED_RULE_CLEAR:
+        led_out(led, 0);
+        break;
+    case LED_RULE_TOGGLE:
+        gpiod_set_value(led_descs[led], !test_and_change_bit(led, &led_state));
+        break;
+    case LED_RULE_PULSE:
+        led_out(led, 1);
+        hrtimer_start(&pulse_timers[led], ns_to_ktime((u64)rule->pulse_us * NSEC_PER_USEC), HRTIMER_MODE_REL);
+        break;
+    case LED_RULE_FOLLOW:
+        led_out(led, level);
+        break;
+    }
+}
+
+/**
+ * @brief Check a table uploaded by the user
+ */
+static int rules_check(const led_rule *rule, unsigned int nr){
+    unsigned int i;
+
+    for (i = 0; i < nr; i++, rule++) {
+        if (rule->input >= nr_btns || rule->output >= nr_leds)
+            return -EINVAL;
+        if (!rule->edge || (rule->edge & ~LED_RULE_BOTH) || rule->action >= LED_RULE_ACTIONS)
+            return -EINVAL;
+        if (rule->action == LED_RULE_PULSE && (!rule->pulse_us || rule->pulse_us > LED_RULE_PULSE_MAX_US))
+            return -EINVAL;
+    }
+    return 0;
+}
+
+/**
+ * @brief Replace the rules, NULL removes them all
+ */
+static void rules_replace(struct rule_table *new){
+    struct rule_table *old;
+
+    mutex_lock(&rules_lock);
+    old = rcu_replace_pointer(rules, new, lockdep_is_held(&rules_lock));
+    mutex_unlock(&rules_lock);
+
+    if (old)
+        kfree_rcu(old, rcu);
+}
+
+static int rules_set(const led_rule_table *req){
+    struct rule_table *new = NULL;
+    int ret;
+
+    if (req->nr_rules > LED_RULES_MAX)
+        return -EINVAL;
+
+    if (req->nr_rules) {
+        new = kmalloc(struct_size(new, rules, req->nr_rules), GFP_KERNEL);
+        if (!new)
+            return -ENOMEM;
+        new->nr = req->nr_rules;
+        if (copy_from_user(new->rules, u64_to_user_ptr(req->rules), req->nr_rules * sizeof(led_rule))) {
+            kfree(new);
+            return -EFAULT;
+        }
+        ret = rules_check(new->rules, new->nr);
+        if (ret) {
+            kfree(new);
+            return ret;
+        }
+    }
+
+    rules_replace(new);
+    return 0;
+}
+
+static int rules_get(led_rule_table *req){
+    led_rule tmp[LED_RULES_MAX];
+    struct rule_table *tbl;
+    unsigned int nr = 0;
+
+    mutex_lock(&rules_lock);
+    tbl = rcu_dereference_protected(rules, lockdep_is_held(&rules_lock));
+    if (tbl) {
+        nr = tbl->nr;
+        memcpy(tmp, tbl->rules, nr * sizeof(led_rule));
+    }
+    mutex_unlock(&rules_lock);
+
+    if (copy_to_user(u64_to_user_ptr(req->rules), tmp, min(nr, req->nr_rules) * sizeof(led_rule)))
+        return -EFAULT;
+    req->nr_rules = nr;
+    return 0;
+}
+
+/**
+ * @brief The default rules: every LED follows button 0, like before the rules
+ */
+static int rules_init(void){
+    struct rule_table *tbl;
+    unsigned int i;
+
+    tbl = kzalloc(struct_size(tbl, rules, nr_leds), GFP_KERNEL);
+    if (!tbl)
+        return -ENOMEM;
+    tbl->nr = nr_leds;
+    for (i = 0; i < nr_leds; i++) {
+        tbl->rules[i].edge = LED_RULE_BOTH;
+        tbl->rules[i].action = LED_RULE_FOLLOW;
+        tbl->rules[i].output = i;
+    }
+    rcu_assign_pointer(rules, tbl);
+    return 0;
+}
+
 static int dev_open(struct inode *inode, struct file *file){
     printk("INFO: Device opened\n");
     return 0;
@@ -36,60 +239,155 @@ static int dev_release(struct inode *inode, struct file *file){
     return 0;
 }
 
+/* A bit string or a bitmap, LED 0 first, see led_bitmap.h */
 static ssize_t dev_write(struct file *file, const char __user *buf, size_t count, loff_t *offset){
-    char value;
-    if (copy_from_user(&value, buf, 1)){
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+    char tmp[LED_BITMAP_MAX + 1];
+    int ret = selftest_wait_done(&init_done, file);
+    if (ret)
+        return ret;
+
+    if (count > sizeof(tmp)){
+        printk("ERROR: Invalid value\n");
+        return -EINVAL;
+    }
+
+    if (copy_from_user(tmp, buf, count)){
         printk("ERROR: Fail to copy data from user\n");
         return -1;
     }
 
-    switch(value){
-        case '0':
-            gpio_set_value(mydev.led_gpio, 0);
-            printk("LED OFF\n");
-            break;
-
-        case '1':
-            gpio_set_value(mydev.led_gpio, 1);
-            printk("LED ON");
-            break;
-
-        default:
-            printk("ERROR: Invalid value: %c\n", value);
-            break;
+    if (led_bitmap_parse(tmp, count, bits, nr_leds)){
+        printk("ERROR: Invalid value: %.*s\n", (int)count, tmp);
+        return -EINVAL;
     }
 
+    // Every LED changes at once
+    leds_set(bits);
+    printk("LED %*pb\n", nr_leds, bits);
+
     return count;
 }
 
 static ssize_t dev_read(struct file *file, char __user *buf, size_t count, loff_t *offset){
-    char tmp[2];
-    int value = gpio_get_value(mydev.led_gpio);
-    tmp[0] = value ? '1' : '0';
-    tmp[1] = '\n';
-    if (copy_to_user(buf, tmp, 2)){
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+    char tmp[LED_BITMAP_MAX + 1];
+    size_t len;
+    int ret = selftest_wait_done(&init_done, file);
+    if (ret)
+        return ret;
+
+    gpiod_get_array_value(nr_leds, led_descs, NULL, bits);
+    len = led_bitmap_format(tmp, bits, nr_leds);
+    if (count < len)
+        return -EINVAL;
+    if (copy_to_user(buf, tmp, len)){
         printk("ERROR: Faile to copy data to user\n");
         return -1;
     }
 
-    return 2;
+    return len;
 }
 
+static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
+    led_rule_table req;
+    int ret;
+
+    // Unknown commands never touch arg
+    if (cmd != LED_IOCTL_SET_RULES && cmd != LED_IOCTL_GET_RULES)
+        return -ENOTTY;
+    if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+        return -EFAULT;
+
+    switch (cmd) {
+    case LED_IOCTL_SET_RULES:
+        return rules_set(&req);
+    case LED_IOCTL_GET_RULES:
+        ret = rules_get(&req);
+        if (ret)
+            return ret;
+        if (copy_to_user((void __user *)arg, &req, sizeof(req)))
+            return -EFAULT;
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+/*
+ * No printk here: the rules are the fast path, a console message would cost
+ * more than the whole reaction.
+ */
 static irqreturn_t irq_callback(int irq, void *dev_id) {
-    printk("*********************\n");
-    printk("\t\t%s\t\t\n", __func__);
-    printk("*********************\n");
+    unsigned int input = (unsigned long)dev_id;
+    int level = gpio_get_value(btn_gpios[input]);
+    u8 edge = level ? LED_RULE_RISING : LED_RULE_FALLING;
+    const struct rule_table *tbl;
+    unsigned int i;
+
+    /* The LED belongs to the self-test until it is done */
+    if (!completion_done(&init_done))
+        return IRQ_HANDLED;
+
+    rcu_read_lock();
+    tbl = rcu_dereference(rules);
+    for (i = 0; tbl && i < tbl->nr; i++) {
+        if (tbl->rules[i].input == input && (tbl->rules[i].edge & edge))
+            rule_run(&tbl->rules[i], level);
+    }
+    rcu_read_unlock();
 
+    return IRQ_HANDLED;
+}
 
-    if(gpio_get_value(mydev.button_gpio) == 0){
-        gpio_set_value(mydev.led_gpio, 0);
-        printk("Button pressed! LED OFF\n");
-    }else{
-        gpio_set_value(mydev.led_gpio, 1);
-        printk("Button pressed! LED ON\n");
+/**
+ * @brief Release the first n buttons
+ */
+static void buttons_free(unsigned int n){
+    while (n--) {
+        free_irq(btn_irqs[n], (void *)(unsigned long)n);
+        gpio_free(btn_gpios[n]);
     }
+}
 
-    return IRQ_HANDLED;
+/**
+ * @brief Request every button, the index is the dev_id of its interrupt
+ */
+static int buttons_request(void){
+    unsigned int i;
+
+    for (i = 0; i < nr_btns; i++) {
+        if (gpio_request(btn_gpios[i], "btn_gpio")){
+            printk("ERROR: Fail to request gpio %d\n", btn_gpios[i]);
+            goto err;
+        }
+
+        if (gpio_direction_input(btn_gpios[i])){
+            printk("ERROR: Fail to set gpio %d as input\n", btn_gpios[i]);
+            goto gpio_err;
+        }
+
+        // Get irq number form btn
+        btn_irqs[i] = gpio_to_irq(btn_gpios[i]);
+        if (btn_irqs[i] < 0){
+            printk("ERROR: Fai to get IRQ for GPIO %d\n", btn_gpios[i]);
+            goto gpio_err;
+        }
+
+        // Register irq handler
+        if (request_irq(btn_irqs[i], irq_callback, IRQF_TRIGGER_FALLING | IRQF_TRIGGER_RISING, "btn_irq",
+                        (void *)(unsigned long)i)){
+            printk("ERROR: Fail to register irq handler\n");
+            goto gpio_err;
+        }
+    }
+    return 0;
+
+gpio_err:
+    gpio_free(btn_gpios[i]);
+err:
+    buttons_free(i);
+    return -1;
 }
 
 static struct file_operations fops = {
@@ -98,15 +396,25 @@ static struct file_operations fops = {
     .release = dev_release,
     .write = dev_write,
     .read = dev_read,
+    .unlocked_ioctl = dev_ioctl,
 };
 
 static int __init my_device_init(void){
+    unsigned int i;
+
     printk("INFO: Module is loaded\n");
 
+    for (i = 0; i < LED_BITMAP_MAX; i++) {
+        hrtimer_init(&pulse_timers[i], CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+        pulse_timers[i].function = pulse_fn;
+    }
+    if (rules_init())
+        return -ENOMEM;
+
     // Allocate device number
     if (alloc_chrdev_region(&mydev.dev_nr, 0, 1, mydev.device_name) < 0){
         printk("ERROR: Fail to allocate device number\n");
-        return -1;
+        goto region_err;
     }
 
     // Create device class
@@ -131,53 +439,24 @@ static int __init my_device_init(void){
 
     // Set up GPIO
     /* BUTTON */
-    if (gpio_request(mydev.button_gpio, "btn_gpio")){
-        printk("ERROR: Fail to request gpio %d\n", mydev.button_gpio);
+    if (buttons_request()){
         goto gpio_err;
     }
 
-    if (gpio_direction_input(mydev.button_gpio)){
-        printk("ERROR: Fail to set gpio %d as input\n", mydev.button_gpio);
-        goto btn_dir_err;
-    } else{
-        // Get irq number form btn
-        mydev.irq_nr = gpio_to_irq(mydev.button_gpio);
-        if (mydev.irq_nr < 0){
-            printk("ERROR: Fai to get IRQ for GPIO %d\n", mydev.button_gpio);
-            return -1;
-        }
-
-        // Register irq handler
-        if (request_irq(mydev.irq_nr, irq_callback, IRQF_TRIGGER_FALLING | IRQF_TRIGGER_RISING, "btn_irq", NULL)){
-            printk("ERROR: Fail to register irq handler\n");
-            goto irq_err;
-        }
-    }
-
     /* LED */
-    if (gpio_request(mydev.led_gpio, "led_gpio")){
-        printk("ERROR: Fail to request gpio %d\n", mydev.led_gpio);
-        goto gpio_err;
+    if (led_gpios_request(led_gpios, nr_leds, led_descs, "led_gpio")){
+        goto btn_err;
     }
 
-    if (gpio_direction_output(mydev.led_gpio, 0)){
-        printk("ERROR: Fail to set gpio %d as output\n", mydev.led_gpio);
-        goto led_dir_err;
-    } else{
-        gpio_set_value(mydev.led_gpio, 1);
-        mdelay(1000);
-        gpio_set_value(mydev.led_gpio, 0);
-    }
+    // Self-test: the LEDs are on for one second without blocking insmod
+    leds_set_all(1);
+    schedule_delayed_work(&selftest_work, HZ);
 
 
     return 0;
 
-led_dir_err:
-    gpio_free(mydev.led_gpio);
-irq_err:
-    free_irq(mydev.irq_nr, NULL);
-btn_dir_err:
-    gpio_free(mydev.button_gpio);
+btn_err:
+    buttons_free(nr_btns);
 gpio_err:
     cdev_del(&mydev.cdev);
 cdev_err:
@@ -186,13 +465,21 @@ dev_err:
     class_destroy(mydev.dev_class);
 class_err:
     unregister_chrdev_region(mydev.dev_nr, 1);
+region_err:
+    rules_replace(NULL);
     return -1;
 }
 
 static void __exit my_device_exit(void){
-    gpio_free(mydev.led_gpio);
-    gpio_free(mydev.button_gpio);
-    free_irq(mydev.irq_nr, NULL);
+    unsigned int i;
+
+    cancel_delayed_work_sync(&selftest_work);
+    buttons_free(nr_btns);
+    for (i = 0; i < LED_BITMAP_MAX; i++)
+        hrtimer_cancel(&pulse_timers[i]);
+    leds_set_all(0);                    // nothing can turn them on again now
+    led_gpios_free(led_gpios, nr_leds);
+    rules_replace(NULL);
     cdev_del(&mydev.cdev);
     device_destroy(mydev.dev_class, mydev.dev_nr);
     class_destroy(mydev.dev_class);
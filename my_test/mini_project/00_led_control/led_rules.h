@@ -0,0 +1,55 @@
+#ifndef __LED_RULES_H__
+#define __LED_RULES_H__
+
+#include <linux/types.h>
+
+/*
+ * Button to LED rules of /dev/led_control. On every edge of a button the
+ * driver runs the rules of that button and edge, in table order, straight
+ * from the interrupt. A new table replaces the old one as a whole.
+ *
+ * Example: pressing button 0 toggles LED 1, releasing it flashes LED 2:
+ *
+ *   { .input = 0, .edge = LED_RULE_RISING,  .action = LED_RULE_TOGGLE, .output = 1 }
+ *   { .input = 0, .edge = LED_RULE_FALLING, .action = LED_RULE_PULSE,  .output = 2, .pulse_us = 50000 }
+ */
+
+#define LED_RULES_MAGIC_NUM 0xF4
+#define LED_RULES_MAX 64
+#define LED_RULE_PULSE_MAX_US 10000000     // 10 s
+
+/* Edges */
+#define LED_RULE_RISING     0x1
+#define LED_RULE_FALLING    0x2
+#define LED_RULE_BOTH       (LED_RULE_RISING | LED_RULE_FALLING)
+
+/* Actions */
+enum led_rule_action {
+    LED_RULE_SET,           // output on
+    LED_RULE_CLEAR,         // output off
+    LED_RULE_TOGGLE,
+    LED_RULE_PULSE,         // on for pulse_us, again restarts the pulse
+    LED_RULE_FOLLOW,        // output = button level
+    LED_RULE_ACTIONS,
+};
+
+typedef struct led_rule {
+    __u8 input;             // button index, see btn_gpios
+    __u8 edge;              // LED_RULE_RISING / FALLING / BOTH
+    __u8 action;            // enum led_rule_action
+    __u8 output;            // LED index, see led_gpios
+    __u32 pulse_us;         // LED_RULE_PULSE only
+} led_rule;
+
+typedef struct led_rule_table {
+    __u32 nr_rules;         // GET: size of the array in, number of rules out
+    __u32 pad;
+    __u64 rules;            // pointer to led_rule[nr_rules]
+} led_rule_table;
+
+/* Replace the rules, nr_rules = 0 removes them all */
+#define LED_IOCTL_SET_RULES     _IOW(LED_RULES_MAGIC_NUM, 0, led_rule_table)
+/* Read the rules */
+#define LED_IOCTL_GET_RULES     _IOWR(LED_RULES_MAGIC_NUM, 1, led_rule_table)
+
+#endif
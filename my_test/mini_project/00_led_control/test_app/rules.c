@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "../led_rules.h"
+
+/*
+ * Upload button to LED rules, then print the table back
+ *
+ *   ./rules            button 0 press toggles LED 0, release flashes LED 1
+ *   ./rules follow     every LED follows button 0 (the default)
+ *   ./rules clear      no rule, the button does nothing
+ */
+
+static const char *actions[] = { "set", "clear", "toggle", "pulse", "follow" };
+
+/* Number of LEDs the module was loaded with, from its led_gpios parameter */
+static unsigned int count_leds(void) {
+    FILE *f = fopen("/sys/module/00_led_control/parameters/led_gpios", "r");
+    unsigned int n = 1;
+    int c;
+
+    if (!f) {
+        perror("Failed to read led_gpios, assuming one LED");
+        return 1;
+    }
+    while ((c = fgetc(f)) != EOF)
+        n += c == ',';
+    fclose(f);
+    return n < LED_RULES_MAX ? n : LED_RULES_MAX;
+}
+
+int main(int argc, char *argv[]) {
+    led_rule toggle[] = {
+        { .input = 0, .edge = LED_RULE_RISING,  .action = LED_RULE_TOGGLE, .output = 0 },
+        { .input = 0, .edge = LED_RULE_FALLING, .action = LED_RULE_PULSE,  .output = 1, .pulse_us = 200000 },
+    };
+    led_rule follow[LED_RULES_MAX];
+    led_rule out[LED_RULES_MAX];
+    led_rule_table tbl = { .nr_rules = 2, .rules = (uintptr_t)toggle };
+    unsigned int i;
+
+    int fd = open("/dev/led_control", O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open /dev/led_control");
+        return 1;
+    }
+
+    if (argc > 1 && argv[1][0] == 'f') {
+        /* Same table as the module builds at load: LED i follows button 0 */
+        tbl.nr_rules = count_leds();
+        for (i = 0; i < tbl.nr_rules; i++)
+            follow[i] = (led_rule){ .input = 0, .edge = LED_RULE_BOTH, .action = LED_RULE_FOLLOW, .output = i };
+        tbl.rules = (uintptr_t)follow;
+    } else if (argc > 1 && argv[1][0] == 'c') {
+        tbl.nr_rules = 0;
+    }
+    if (ioctl(fd, LED_IOCTL_SET_RULES, &tbl) < 0) {
+        perror("LED_IOCTL_SET_RULES");
+        return 1;
+    }
+
+    tbl.nr_rules = LED_RULES_MAX;
+    tbl.rules = (uintptr_t)out;
+    if (ioctl(fd, LED_IOCTL_GET_RULES, &tbl) < 0) {
+        perror("LED_IOCTL_GET_RULES");
+        return 1;
+    }
+    printf("%u rule(s)\n", tbl.nr_rules);
+    for (i = 0; i < tbl.nr_rules; i++) {
+        printf("  button %u %s%s -> %s LED %u", out[i].input,
+               out[i].edge & LED_RULE_RISING ? "rise" : "", out[i].edge & LED_RULE_FALLING ? "fall" : "",
+               actions[out[i].action], out[i].output);
+        if (out[i].action == LED_RULE_PULSE)
+            printf(" for %u us", out[i].pulse_us);
+        printf("\n");
+    }
+
+    close(fd);
+    return 0;
+}
@@ -1,8 +1,12 @@
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/fs.h>
-#include <linux/cdev.h>
 #include <linux/uaccess.h>
+#include <linux/leds.h>
+#include <linux/version.h>
+#include <linux/slab.h>
+#include "drv_shared.h"
+#include "chrdev_core.h"
 
 
 /* Meta info */
@@ -10,19 +14,52 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Phan Hao");
 MODULE_DESCRIPTION("A character driver function to read write");
 
-/*Buffer for data*/
-static char buffer[255];
-static size_t buff_p = 0;
+/*Buffer for data, replaced as a whole by every write*/
+#define BUFFER_SIZE 255
+
+struct driver_buffer {
+	struct rcu_head rcu;
+	size_t len;
+	char data[BUFFER_SIZE];
+};
+
+/*One per device, reads, writes and bytes are counted by chrdev_core*/
+struct driver_device {
+	struct driver_buffer __rcu *buffer;
+	struct mutex buffer_lock;	// serialises writers, readers use RCU
+	struct chrdev_inst *inst;
+};
 
 /*Variable for driver and driver class*/
-static dev_t device_nr;		// device number (major and minor)
-static struct class *my_class;
-static struct cdev my_device;
+static struct chrdev_class *my_class;
+static struct driver_device *devices;
 
 #define DRIVER_NAME "characterDriver"
 #define DRIVER_CLASS "myClass"
 #define DEBUG 1
 
+/*Number of devices: characterDriver, characterDriver1, characterDriver2, ...*/
+static unsigned int nr_devices = 1;
+module_param(nr_devices, uint, 0444);
+MODULE_PARM_DESC(nr_devices, "Number of devices to create");
+
+/*LED trigger, blinks on every read and write like a disk activity LED*/
+DEFINE_LED_TRIGGER(activity_trigger);
+#define ACTIVITY_BLINK_MS 30
+
+/**
+ * @brief Blink the LEDs bound to the activity trigger, once
+ */
+static void driver_activity(void){
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+	led_trigger_blink_oneshot(activity_trigger, ACTIVITY_BLINK_MS, ACTIVITY_BLINK_MS, 0);
+#else
+	unsigned long delay = ACTIVITY_BLINK_MS;
+
+	led_trigger_blink_oneshot(activity_trigger, &delay, &delay, 0);
+#endif
+}
+
 /**
  * @brief This function is called when the device is opened
  */
@@ -44,25 +81,31 @@ static int driver_close(struct inode *device_file, struct file *instance){
  * Read data to buffer
  */
 static ssize_t driver_read(struct file *File, char *usr_buffer, size_t count, loff_t *offset){
+	struct driver_device *dev = chrdev_file_priv(File);
+	struct driver_buffer *buf;
+	char tmp[BUFFER_SIZE];
 	int amount, cp, del;
 
-	/*Get amount of data to copy*/
-	amount = min((size_t)count, buff_p);
+	/*Snapshot of the last write, copy_to_user() can not run under RCU*/
+	rcu_read_lock();
+	buf = rcu_dereference(dev->buffer);
+	amount = buf ? min(count, buf->len) : 0;
+	if (amount)
+		memcpy(tmp, buf->data, amount);
+	rcu_read_unlock();
 	if (DEBUG){
 		printk ("Amount of data to read: %d\n", amount);
 	}
 
 	/*Copy data to user*/
-	cp = copy_to_user(usr_buffer, buffer, amount);
-	if (DEBUG){
-		printk ("usr_buffer: %s\n", usr_buffer);
-	}
+	cp = copy_to_user(usr_buffer, tmp, amount);
 
 	/*Caculate data*/
 	del = amount - cp;
 	if (DEBUG){
 		printk ("delta of read: %d\n", del);
 	}
+	driver_activity();
 
 	return del;
 }
@@ -72,16 +115,25 @@ static ssize_t driver_read(struct file *File, char *usr_buffer, size_t count, lo
  * Write data to buffer
  */
 static ssize_t driver_write(struct file *File, const char *usr_buffer, size_t count, loff_t *offet){
+	struct driver_device *dev = chrdev_file_priv(File);
+	struct driver_buffer *buf;
 	int amount, cp, del;
 	/*Get amount data to copy*/
-	amount = min((int)count, (int)sizeof(buffer));
+	amount = min((int)count, BUFFER_SIZE);
+
+	/*Fill a new buffer, readers keep seeing the old one until it is published*/
+	buf = kmalloc(sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
 
 	/*Copy data from user*/
-	cp = copy_from_user(buffer, usr_buffer, amount);
-	buff_p = amount;
+	cp = copy_from_user(buf->data, usr_buffer, amount);
 
 	/*Caculate data*/
 	del = amount - cp;
+	buf->len = del;
+	drv_config_publish(dev->buffer, buf, &dev->buffer_lock);
+	driver_activity();
 
 	return del;
 }
@@ -98,56 +150,65 @@ static struct file_operations fops = {
  * @brief This function is called when the driver is loaded into kernel
  */
 static int __init ModuleInit(void){
+	unsigned int i;
+	int ret;
+
 	printk(KERN_INFO "Hello, this is character driver\n");
 
-	/*Allocate a device number*/
-	if(alloc_chrdev_region(&device_nr, 0, 1, DRIVER_NAME) < 0){
-		printk("Could not be allocated the device number\n");
-		return -1;
-	}
-	printk("Device %s was registered with Major: %d, Minor: %d\n", DRIVER_NAME, device_nr >> 20, device_nr & 0xfffff);
+	if (!nr_devices)
+		return -EINVAL;
+	devices = kcalloc(nr_devices, sizeof(*devices), GFP_KERNEL);
+	if (!devices)
+		return -ENOMEM;
 
-	/*Create device class*/
-    if ((my_class = class_create(DRIVER_CLASS)) == NULL){
+	/*Device numbers, class and cdev*/
+	my_class = chrdev_class_create(DRIVER_CLASS, DRIVER_NAME, nr_devices, &fops);
+	if (IS_ERR(my_class)){
 		printk("Device class can not be create!\n");
+		ret = PTR_ERR(my_class);
 		goto classError;
 	}
 
-	/*create device file*/
-	if(device_create(my_class, NULL, device_nr, NULL, DRIVER_NAME) == NULL){
-		printk("Device file can not be create!\n");
-		goto fileError;
+	/*create device files*/
+	for (i = 0; i < nr_devices; i++){
+		mutex_init(&devices[i].buffer_lock);
+		devices[i].inst = i ? chrdev_inst_create(my_class, &devices[i], DRIVER_NAME "%u", i) :
+				      chrdev_inst_create(my_class, &devices[i], DRIVER_NAME);
+		if (IS_ERR(devices[i].inst)){
+			printk("Device file can not be create!\n");
+			ret = PTR_ERR(devices[i].inst);
+			goto fileError;
+		}
 	}
+	printk("Device %s was registered with Major: %d, %u device(s)\n", DRIVER_NAME,
+	       MAJOR(devices[0].inst->devt), nr_devices);
 
-	/*Initialize device file*/
-	cdev_init(&my_device, &fops);
-
-	/*Register device to kernel*/
-	if(cdev_add(&my_device, device_nr, 1) == -1){
-		printk("Register device to kernel fail!\n");
-		goto addError;
-	}
+	/*echo characterDriver > /sys/class/leds/<led>/trigger*/
+	led_trigger_register_simple(DRIVER_NAME, &activity_trigger);
 
 	return 0;
 
-classError:
-	unregister_chrdev_region(device_nr, 1);
 fileError:
-	class_destroy(my_class);
-addError:
-	device_destroy(my_class, device_nr);
-	return -1;
+	/*Also destroys the devices created so far*/
+	chrdev_class_destroy(my_class);
+classError:
+	kfree(devices);
+	return ret;
 }
 
 /**
  * @brief This function is called when the driver is removed from kernel
  */
 static void __exit ModuleExit(void){
+	unsigned int i;
+
 	printk(KERN_INFO "Good bye kernel!\n");
-	cdev_del(&my_device);
-	device_destroy(my_class, device_nr);
-	class_destroy(my_class);
-	unregister_chrdev_region(device_nr, 1);
+	led_trigger_unregister_simple(activity_trigger);
+	/*One grace period for every device, then free the buffers*/
+	chrdev_class_destroy(my_class);
+	for (i = 0; i < nr_devices; i++)
+		kfree(rcu_dereference_protected(devices[i].buffer, true));
+	kfree(devices);
 }
 
 module_init(ModuleInit);
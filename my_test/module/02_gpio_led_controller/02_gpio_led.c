@@ -3,29 +3,676 @@
 #include <linux/fs.h>
 #include <linux/cdev.h>
 #include <linux/uaccess.h>
-#include <linux/gpio.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/kref.h>
+#include <linux/idr.h>
+#include <linux/platform_device.h>
+#include <linux/mod_devicetable.h>
+#include <linux/gpio/consumer.h>
+#include <linux/gpio/driver.h>
+#include <linux/gpio/machine.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+#include <linux/smp.h>
+#include <linux/math64.h>
+#include <linux/llist.h>
+#include <linux/workqueue.h>
+#include <linux/leds.h>
+#include <linux/property.h>
+#include "led_bitmap.h"
+#include "gpio_led_ioctl.h"
 
 /* Meta info */
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Phan Hao");
-MODULE_DESCRIPTION("A character driver function to read write");
+MODULE_DESCRIPTION("A platform driver for groups of GPIO LEDs");
 
+/*
+ * Every bound device is a group of up to LED_BITMAP_MAX LEDs described by
+ * "led-gpios" in the device tree (see gpio-leds-overlay.dts) or by a GPIO
+ * lookup table. A group gets one node per LED and one for all of them:
+ *
+ *   /dev/gpio_led<group>_<n>   "0" or "1"
+ *   /dev/gpio_led<group>_all   bit string or bitmap, see led_bitmap.h
+ *
+ * Minor number = group * GPIO_LED_MINORS + LED, the "all" node is the last.
+ *
+ * LEDs can also be dimmed with software PWM (GPIO_LED_IOCTL_SET_PWM). One
+ * hrtimer per group runs the PWM of all its LEDs: every tick applies the
+ * edges that are due within pwm_slack_ns with a single array write, then
+ * sleeps until the next edge of any LED.
+ *
+ * A waveform (GPIO_LED_IOCTL_WAVE_QUEUE on the all node) is a list of
+ * (bitmap, duration) steps played by a second hrtimer. Step times are
+ * absolute, so a long waveform does not drift. One waveform plays while the
+ * next one waits; it takes over right after the last step of the current
+ * one. A waveform owns its LEDs while it plays, over PWM and static levels.
+ *
+ * Every LED is also registered with the LED class as gpio_led<group>::<n>,
+ * so kernel triggers (button-edge, my_misc, characterDriver, timer, ...) can
+ * drive it without a trip through userspace:
+ *
+ *   echo button-edge > /sys/class/leds/gpio_led0::0/trigger
+ *
+ * The LED class sets the static level, exactly like a write to the LED node.
+ */
+
+/* A waveform, freed from a work item once it is done */
+struct gpio_led_wave_buf {
+	struct llist_node node;
+	u32 nr_steps;
+	u32 loops;			// 0 = forever
+	u32 mask;			// LEDs driven by the waveform
+	gpio_led_step steps[];
+};
+
+/* PWM channel, one per LED */
+struct gpio_led_pwm_chan {
+	u32 duty;			// per mille, 0 = not in PWM mode
+	u32 freq_hz;
+	u64 on_ns;
+	u64 off_ns;
+	ktime_t next_edge;		// ideal time of the next edge
+	ktime_t start;
+	u64 periods;
+	u64 edges;
+	u64 edge_err_sum;		// |actual - ideal| of every edge
+	u32 edge_err_max;
+};
+
+struct gpio_led_ctrl;
+
+/* One LED as seen by the LED class */
+struct gpio_led_classdev {
+	struct led_classdev cdev;
+	struct gpio_led_ctrl *ctrl;
+	unsigned int index;
+	char name[24];
+};
+
+/* State of one group */
+struct gpio_led_ctrl {
+	struct gpio_descs *descs;	// NULL once the group is removed
+	struct mutex lock;		// serialises the LEDs of this group
+	struct kref ref;		// held by probe and every open file
+	DECLARE_BITMAP(state, LED_BITMAP_MAX);	// static level of every LED
+	unsigned int nr_leds;
+	struct cdev *cdev;
+	int id;
+	dev_t devt;			// first device number of the group
+
+	/* PWM engine, only for lines that can be set from the timer */
+	bool can_pwm;
+	spinlock_t pwm_lock;		// PWM state below, taken by the timer
+	struct hrtimer pwm_timer;
+	DECLARE_BITMAP(pwm_mask, LED_BITMAP_MAX);	// LEDs in PWM mode
+	DECLARE_BITMAP(pwm_level, LED_BITMAP_MAX);	// their current level
+	struct gpio_led_pwm_chan pwm[LED_BITMAP_MAX];
+	u64 ticks;
+	u64 late_sum;
+	u32 late_max;
+
+	/* Waveform player, protected by pwm_lock too */
+	struct hrtimer wave_timer;
+	struct gpio_led_wave_buf *wave_cur;	// playing
+	struct gpio_led_wave_buf *wave_next;	// queued
+	u32 wave_step;			// next step of wave_cur
+	u32 wave_loop;
+	DECLARE_BITMAP(wave_mask, LED_BITMAP_MAX);
+	DECLARE_BITMAP(wave_level, LED_BITMAP_MAX);
+	u64 wave_switches;
+	u64 wave_overruns;
+	struct llist_head wave_done;
+	struct work_struct wave_free_work;
+
+	struct gpio_led_classdev *leds;	// LED class devices, one per LED
+};
 
 /*Variable for driver and driver class*/
-static dev_t device_nr;		// device number (major and minor)
+static dev_t device_nr;		// first device number (major and minor)
 static struct class *my_class;
-static struct cdev my_device;
 
-#define DRIVER_NAME "gpio_Led"
+/* Group id -> group, protected by led_table_lock */
+static DEFINE_IDR(led_table);
+static DEFINE_MUTEX(led_table_lock);
+
+#define DRIVER_NAME "gpio_led"
 #define DRIVER_CLASS "myClass"
-#define DEBUG 0
-#define GPIO4 516
+#define GPIO_LED_MAX_DEVICES 8
+#define GPIO_LED_MINORS (LED_BITMAP_MAX + 1)
+#define GPIO_LED_ALL LED_BITMAP_MAX
+
+/* Legacy: a group made of GPIO numbers, for boards without the overlay */
+static bool legacy = true;
+module_param(legacy, bool, 0444);
+MODULE_PARM_DESC(legacy, "Create a group from the gpios parameter");
+
+static int gpios[LED_BITMAP_MAX] = { 516 };	// GPIO4
+static int nr_gpios = 1;
+module_param_array(gpios, int, &nr_gpios, 0444);
+MODULE_PARM_DESC(gpios, "GPIO numbers of the legacy group");
+
+static struct platform_device *legacy_pdev;
+static struct gpiod_lookup_table *legacy_lookup;
+
+static int pwm_cpu = -1;
+module_param(pwm_cpu, int, 0644);
+MODULE_PARM_DESC(pwm_cpu, "CPU that runs the PWM timers, -1 for any");
+
+static unsigned int pwm_slack_ns = 2000;
+module_param(pwm_slack_ns, uint, 0644);
+MODULE_PARM_DESC(pwm_slack_ns, "Edges this close together are applied in one write");
+
+static char *default_trigger;
+module_param(default_trigger, charp, 0444);
+MODULE_PARM_DESC(default_trigger, "LED trigger of groups without linux,default-trigger");
+
+/**
+ * @brief Levels to drive: the waveform, then PWM, then the static state
+ */
+static void gpio_led_levels(struct gpio_led_ctrl *ctrl, unsigned long *out)
+{
+	DECLARE_BITMAP(tmp, LED_BITMAP_MAX);
+
+	bitmap_andnot(out, ctrl->state, ctrl->pwm_mask, ctrl->nr_leds);
+	bitmap_and(tmp, ctrl->pwm_level, ctrl->pwm_mask, ctrl->nr_leds);
+	bitmap_or(out, out, tmp, ctrl->nr_leds);
+
+	bitmap_andnot(out, out, ctrl->wave_mask, ctrl->nr_leds);
+	bitmap_and(tmp, ctrl->wave_level, ctrl->wave_mask, ctrl->nr_leds);
+	bitmap_or(out, out, tmp, ctrl->nr_leds);
+}
+
+/**
+ * @brief Set the static level of the LEDs in mask, then drive every LED
+ *
+ * Groups with sleeping lines need ctrl->lock held. The others can be updated
+ * from any context, LED triggers fire from interrupts: their state changes
+ * under pwm_lock, in the same section as the write.
+ */
+static void gpio_led_update(struct gpio_led_ctrl *ctrl, const unsigned long *mask, const unsigned long *bits)
+{
+	DECLARE_BITMAP(out, LED_BITMAP_MAX);
+	unsigned long flags;
+
+	if (!ctrl->can_pwm) {
+		bitmap_replace(ctrl->state, ctrl->state, bits, mask, ctrl->nr_leds);
+		gpiod_set_array_value_cansleep(ctrl->nr_leds, ctrl->descs->desc, ctrl->descs->info, ctrl->state);
+		return;
+	}
+
+	/* The PWM timer writes the same lines */
+	spin_lock_irqsave(&ctrl->pwm_lock, flags);
+	bitmap_replace(ctrl->state, ctrl->state, bits, mask, ctrl->nr_leds);
+	if (ctrl->descs) {
+		gpio_led_levels(ctrl, out);
+		gpiod_set_array_value(ctrl->nr_leds, ctrl->descs->desc, ctrl->descs->info, out);
+	}
+	spin_unlock_irqrestore(&ctrl->pwm_lock, flags);
+}
+
+/**
+ * @brief Drive every LED of a group, called with ctrl->lock held
+ */
+static void gpio_led_apply(struct gpio_led_ctrl *ctrl)
+{
+	DECLARE_BITMAP(none, LED_BITMAP_MAX);
+
+	bitmap_zero(none, LED_BITMAP_MAX);
+	gpio_led_update(ctrl, none, none);
+}
+
+/**
+ * @brief Set the static level of one LED
+ */
+static void gpio_led_set_one(struct gpio_led_ctrl *ctrl, unsigned int led, bool on)
+{
+	DECLARE_BITMAP(mask, LED_BITMAP_MAX);
+	DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+
+	bitmap_zero(mask, LED_BITMAP_MAX);
+	bitmap_zero(bits, LED_BITMAP_MAX);
+	set_bit(led, mask);
+	assign_bit(led, bits, on);
+	gpio_led_update(ctrl, mask, bits);
+}
+
+/**
+ * @brief PWM tick - Apply the edges that are due, sleep until the next one
+ */
+static enum hrtimer_restart gpio_led_pwm_tick(struct hrtimer *timer)
+{
+	struct gpio_led_ctrl *ctrl = container_of(timer, struct gpio_led_ctrl, pwm_timer);
+	DECLARE_BITMAP(out, LED_BITMAP_MAX);
+	struct gpio_led_pwm_chan *ch;
+	ktime_t now = hrtimer_cb_get_time(timer);
+	ktime_t due = ktime_add_ns(now, pwm_slack_ns);
+	ktime_t next = KTIME_MAX;
+	bool changed = false;
+	u64 late, err;
+	unsigned int i;
+
+	spin_lock(&ctrl->pwm_lock);
+
+	late = max_t(s64, 0, ktime_sub(now, hrtimer_get_expires(timer)));
+	ctrl->ticks++;
+	ctrl->late_sum += late;
+	ctrl->late_max = max_t(u32, ctrl->late_max, late);
+
+	for_each_set_bit(i, ctrl->pwm_mask, ctrl->nr_leds) {
+		ch = &ctrl->pwm[i];
+
+		/* Far behind, e.g. after a long irq-off section: restart the period */
+		if (ktime_before(ktime_add_ns(ch->next_edge, ch->on_ns + ch->off_ns), now))
+			ch->next_edge = now;
+
+		while (!ktime_after(ch->next_edge, due)) {
+			err = abs(ktime_to_ns(ktime_sub(now, ch->next_edge)));
+			ch->edges++;
+			ch->edge_err_sum += err;
+			ch->edge_err_max = max_t(u32, ch->edge_err_max, err);
+
+			if (test_and_change_bit(i, ctrl->pwm_level)) {
+				ch->next_edge = ktime_add_ns(ch->next_edge, ch->off_ns);
+			} else {
+				ch->next_edge = ktime_add_ns(ch->next_edge, ch->on_ns);
+				ch->periods++;
+			}
+			changed = true;
+		}
+		if (ktime_before(ch->next_edge, next))
+			next = ch->next_edge;
+	}
+
+	/* Every edge of this tick in one write */
+	if (changed && ctrl->descs) {
+		gpio_led_levels(ctrl, out);
+		gpiod_set_array_value(ctrl->nr_leds, ctrl->descs->desc, ctrl->descs->info, out);
+	}
+	spin_unlock(&ctrl->pwm_lock);
+
+	if (next == KTIME_MAX)
+		return HRTIMER_NORESTART;
+	hrtimer_set_expires(timer, next);
+	return HRTIMER_RESTART;
+}
+
+static void gpio_led_timer_start_here(void *data)
+{
+	hrtimer_start(data, ktime_get(), HRTIMER_MODE_ABS_PINNED);
+}
+
+/**
+ * @brief Run a group timer now, on pwm_cpu when it is set
+ *
+ * Called with ctrl->lock held. The timer is cancelled first: starting it
+ * while its callback moves the expiry would corrupt the timer queue.
+ */
+static void gpio_led_timer_kick(struct hrtimer *timer)
+{
+	int cpu = READ_ONCE(pwm_cpu);
+
+	hrtimer_cancel(timer);
+	if (cpu >= 0 && cpu < nr_cpu_ids && cpu_online(cpu))
+		smp_call_function_single(cpu, gpio_led_timer_start_here, timer, 1);
+	else
+		hrtimer_start(timer, ktime_get(), HRTIMER_MODE_ABS);
+}
+
+static void gpio_led_wave_free_work(struct work_struct *work)
+{
+	struct gpio_led_ctrl *ctrl = container_of(work, struct gpio_led_ctrl, wave_free_work);
+	struct gpio_led_wave_buf *buf, *tmp;
+
+	llist_for_each_entry_safe(buf, tmp, llist_del_all(&ctrl->wave_done), node)
+		kvfree(buf);
+}
+
+/**
+ * @brief Hand a finished waveform to the free work, any context
+ */
+static void gpio_led_wave_retire(struct gpio_led_ctrl *ctrl, struct gpio_led_wave_buf *buf)
+{
+	if (!buf)
+		return;
+	llist_add(&buf->node, &ctrl->wave_done);
+	schedule_work(&ctrl->wave_free_work);
+}
+
+/**
+ * @brief Waveform tick - Output one step, the next waveform takes over at the end
+ */
+static enum hrtimer_restart gpio_led_wave_tick(struct hrtimer *timer)
+{
+	struct gpio_led_ctrl *ctrl = container_of(timer, struct gpio_led_ctrl, wave_timer);
+	DECLARE_BITMAP(out, LED_BITMAP_MAX);
+	struct gpio_led_wave_buf *buf;
+	const gpio_led_step *step;
+	enum hrtimer_restart ret = HRTIMER_RESTART;
+	ktime_t expires;
+
+	spin_lock(&ctrl->pwm_lock);
+
+	buf = ctrl->wave_cur;
+	if (buf && ctrl->wave_step == buf->nr_steps) {
+		ctrl->wave_step = 0;
+		ctrl->wave_loop++;
+		/* Endless waveforms give way to a queued one after a full loop */
+		if (buf->loops ? ctrl->wave_loop >= buf->loops : ctrl->wave_next != NULL) {
+			/* Seamless switch to the queued waveform */
+			gpio_led_wave_retire(ctrl, buf);
+			buf = ctrl->wave_cur = ctrl->wave_next;
+			ctrl->wave_next = NULL;
+			ctrl->wave_loop = 0;
+			if (buf)
+				ctrl->wave_switches++;
+		}
+	}
+
+	if (buf) {
+		step = &buf->steps[ctrl->wave_step++];
+		bitmap_from_arr32(ctrl->wave_mask, &buf->mask, ctrl->nr_leds);
+		bitmap_from_arr32(ctrl->wave_level, &step->bitmap, ctrl->nr_leds);
+
+		/* Absolute step times, a late tick does not delay the next steps */
+		expires = ktime_add_ns(hrtimer_get_expires(timer), step->duration_ns);
+		if (ktime_before(expires, hrtimer_cb_get_time(timer)))
+			ctrl->wave_overruns++;
+		hrtimer_set_expires(timer, expires);
+	} else {
+		bitmap_zero(ctrl->wave_mask, ctrl->nr_leds);
+		ret = HRTIMER_NORESTART;
+	}
+
+	if (ctrl->descs) {
+		gpio_led_levels(ctrl, out);
+		gpiod_set_array_value(ctrl->nr_leds, ctrl->descs->desc, ctrl->descs->info, out);
+	}
+	spin_unlock(&ctrl->pwm_lock);
+
+	return ret;
+}
+
+/**
+ * @brief Queue a waveform uploaded by the user, called with ctrl->lock held
+ */
+static int gpio_led_wave_queue(struct gpio_led_ctrl *ctrl, const gpio_led_wave *wave)
+{
+	struct gpio_led_wave_buf *buf, *old_cur = NULL, *old_next;
+	bool start;
+	u32 i;
+
+	if (!ctrl->can_pwm)
+		return -EOPNOTSUPP;
+	if (wave->nr_steps == 0 || wave->nr_steps > GPIO_LED_WAVE_MAX_STEPS)
+		return -EINVAL;
+	if (wave->flags & ~GPIO_LED_WAVE_NOW)
+		return -EINVAL;
+	if (!wave->mask || (ctrl->nr_leds < 32 && wave->mask >> ctrl->nr_leds))
+		return -EINVAL;
+
+	buf = kvmalloc(struct_size(buf, steps, wave->nr_steps), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	if (copy_from_user(buf->steps, u64_to_user_ptr(wave->steps), wave->nr_steps * sizeof(gpio_led_step))) {
+		kvfree(buf);
+		return -EFAULT;
+	}
+	for (i = 0; i < wave->nr_steps; i++) {
+		if (buf->steps[i].duration_ns < GPIO_LED_WAVE_MIN_NS) {
+			kvfree(buf);
+			return -EINVAL;
+		}
+	}
+	buf->nr_steps = wave->nr_steps;
+	buf->loops = wave->loops;
+	buf->mask = wave->mask;
+
+	spin_lock_irq(&ctrl->pwm_lock);
+	start = !ctrl->wave_cur || (wave->flags & GPIO_LED_WAVE_NOW);
+	old_next = ctrl->wave_next;
+	if (start) {
+		old_cur = ctrl->wave_cur;
+		ctrl->wave_cur = buf;
+		ctrl->wave_next = NULL;
+		ctrl->wave_step = 0;
+		ctrl->wave_loop = 0;
+	} else {
+		/* A newer upload replaces the one still waiting */
+		ctrl->wave_next = buf;
+	}
+	spin_unlock_irq(&ctrl->pwm_lock);
+
+	gpio_led_wave_retire(ctrl, old_cur);
+	gpio_led_wave_retire(ctrl, old_next);
+	if (start)
+		gpio_led_timer_kick(&ctrl->wave_timer);
+	return 0;
+}
+
+/**
+ * @brief Stop the waveforms, the LEDs go back to PWM or static levels
+ */
+static void gpio_led_wave_stop(struct gpio_led_ctrl *ctrl)
+{
+	struct gpio_led_wave_buf *cur, *next;
+
+	hrtimer_cancel(&ctrl->wave_timer);
+
+	spin_lock_irq(&ctrl->pwm_lock);
+	cur = ctrl->wave_cur;
+	next = ctrl->wave_next;
+	ctrl->wave_cur = ctrl->wave_next = NULL;
+	bitmap_zero(ctrl->wave_mask, ctrl->nr_leds);
+	spin_unlock_irq(&ctrl->pwm_lock);
+
+	gpio_led_wave_retire(ctrl, cur);
+	gpio_led_wave_retire(ctrl, next);
+	if (ctrl->descs)
+		gpio_led_apply(ctrl);
+}
+
+static void gpio_led_wave_status(struct gpio_led_ctrl *ctrl, gpio_led_wave_status *st)
+{
+	memset(st, 0, sizeof(*st));
+	spin_lock_irq(&ctrl->pwm_lock);
+	st->playing = !!ctrl->wave_cur;
+	st->queued = !!ctrl->wave_next;
+	st->step = ctrl->wave_step;
+	st->loop = ctrl->wave_loop;
+	st->switches = ctrl->wave_switches;
+	st->overruns = ctrl->wave_overruns;
+	spin_unlock_irq(&ctrl->pwm_lock);
+}
+
+/**
+ * @brief Set the PWM of one LED, called with ctrl->lock held
+ */
+static int gpio_led_set_pwm(struct gpio_led_ctrl *ctrl, unsigned int led, const gpio_led_pwm *cfg)
+{
+	struct gpio_led_pwm_chan *ch = &ctrl->pwm[led];
+	unsigned long flags;
+	u64 period;
+
+	if (cfg->duty > GPIO_LED_DUTY_MAX)
+		return -EINVAL;
+
+	/* 0% and 100% are static levels */
+	if (cfg->duty == 0 || cfg->duty == GPIO_LED_DUTY_MAX) {
+		spin_lock_irqsave(&ctrl->pwm_lock, flags);
+		clear_bit(led, ctrl->pwm_mask);
+		memset(ch, 0, sizeof(*ch));
+		spin_unlock_irqrestore(&ctrl->pwm_lock, flags);
+		gpio_led_set_one(ctrl, led, cfg->duty);
+		return 0;
+	}
+
+	if (!ctrl->can_pwm)
+		return -EOPNOTSUPP;
+	if (cfg->freq_hz == 0 || cfg->freq_hz > GPIO_LED_PWM_MAX_HZ)
+		return -EINVAL;
+
+	period = div_u64(NSEC_PER_SEC, cfg->freq_hz);
+
+	spin_lock_irqsave(&ctrl->pwm_lock, flags);
+	memset(ch, 0, sizeof(*ch));
+	ch->duty = cfg->duty;
+	ch->freq_hz = cfg->freq_hz;
+	ch->on_ns = div_u64(period * cfg->duty, GPIO_LED_DUTY_MAX);
+	ch->off_ns = period - ch->on_ns;
+	ch->start = ch->next_edge = ktime_get();
+	clear_bit(led, ctrl->pwm_level);
+	set_bit(led, ctrl->pwm_mask);
+	spin_unlock_irqrestore(&ctrl->pwm_lock, flags);
+
+	gpio_led_timer_kick(&ctrl->pwm_timer);
+	return 0;
+}
+
+/**
+ * @brief Leave PWM mode, any context
+ */
+static void gpio_led_stop_pwm(struct gpio_led_ctrl *ctrl, unsigned int led)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ctrl->pwm_lock, flags);
+	clear_bit(led, ctrl->pwm_mask);
+	memset(&ctrl->pwm[led], 0, sizeof(ctrl->pwm[led]));
+	spin_unlock_irqrestore(&ctrl->pwm_lock, flags);
+}
+
+static void gpio_led_pwm_stats(struct gpio_led_ctrl *ctrl, unsigned int led, gpio_led_pwm_stats *st)
+{
+	struct gpio_led_pwm_chan *ch = &ctrl->pwm[led];
+	unsigned long flags;
+	u64 elapsed;
+
+	memset(st, 0, sizeof(*st));
+	spin_lock_irqsave(&ctrl->pwm_lock, flags);
+	st->periods = ch->periods;
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), ch->start));
+	if (ch->duty && elapsed)
+		st->freq_mhz = div64_u64(ch->periods * NSEC_PER_SEC * 1000, elapsed);
+	if (ch->edges)
+		st->edge_avg_ns = div64_u64(ch->edge_err_sum, ch->edges);
+	st->edge_max_ns = ch->edge_err_max;
+	if (ctrl->ticks)
+		st->late_avg_ns = div64_u64(ctrl->late_sum, ctrl->ticks);
+	st->late_max_ns = ctrl->late_max;
+	st->ticks = ctrl->ticks;
+	spin_unlock_irqrestore(&ctrl->pwm_lock, flags);
+}
+
+/**
+ * @brief LED class - Set the level from a trigger or sysfs, any context
+ */
+static void gpio_led_brightness_set(struct led_classdev *cdev, enum led_brightness value)
+{
+	struct gpio_led_classdev *led = container_of(cdev, struct gpio_led_classdev, cdev);
+
+	/* A static level ends PWM, like a write to the LED node */
+	gpio_led_stop_pwm(led->ctrl, led->index);
+	gpio_led_set_one(led->ctrl, led->index, value != LED_OFF);
+}
+
+/**
+ * @brief LED class - Same for groups with sleeping lines, from a work item
+ */
+static int gpio_led_brightness_set_blocking(struct led_classdev *cdev, enum led_brightness value)
+{
+	struct gpio_led_classdev *led = container_of(cdev, struct gpio_led_classdev, cdev);
+
+	mutex_lock(&led->ctrl->lock);
+	gpio_led_set_one(led->ctrl, led->index, value != LED_OFF);
+	mutex_unlock(&led->ctrl->lock);
+	return 0;
+}
+
+static enum led_brightness gpio_led_brightness_get(struct led_classdev *cdev)
+{
+	struct gpio_led_classdev *led = container_of(cdev, struct gpio_led_classdev, cdev);
+
+	return test_bit(led->index, led->ctrl->state) ? LED_ON : LED_OFF;
+}
+
+static void gpio_led_unregister_leds(struct gpio_led_ctrl *ctrl, unsigned int nr)
+{
+	while (nr--)
+		led_classdev_unregister(&ctrl->leds[nr].cdev);
+	kfree(ctrl->leds);
+	ctrl->leds = NULL;
+}
+
+/**
+ * @brief Register every LED of a group with the LED class
+ */
+static int gpio_led_register_leds(struct gpio_led_ctrl *ctrl, struct device *parent)
+{
+	const char *trigger = default_trigger;
+	struct gpio_led_classdev *led;
+	unsigned int i;
+	int ret;
+
+	ctrl->leds = kcalloc(ctrl->nr_leds, sizeof(*ctrl->leds), GFP_KERNEL);
+	if (!ctrl->leds)
+		return -ENOMEM;
+
+	// Same trigger for the whole group, e.g. linux,default-trigger = "button-edge"
+	device_property_read_string(parent, "linux,default-trigger", &trigger);
+
+	for (i = 0; i < ctrl->nr_leds; i++) {
+		led = &ctrl->leds[i];
+		led->ctrl = ctrl;
+		led->index = i;
+		snprintf(led->name, sizeof(led->name), DRIVER_NAME "%d::%u", ctrl->id, i);
+		led->cdev.name = led->name;
+		led->cdev.max_brightness = LED_ON;
+		led->cdev.default_trigger = trigger;
+		led->cdev.brightness_get = gpio_led_brightness_get;
+		if (ctrl->can_pwm)
+			led->cdev.brightness_set = gpio_led_brightness_set;
+		else
+			led->cdev.brightness_set_blocking = gpio_led_brightness_set_blocking;
+
+		ret = led_classdev_register(parent, &led->cdev);
+		if (ret) {
+			gpio_led_unregister_leds(ctrl, i);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static void gpio_led_release(struct kref *ref)
+{
+	struct gpio_led_ctrl *ctrl = container_of(ref, struct gpio_led_ctrl, ref);
+
+	kfree(ctrl);
+}
 
 /**
  * @brief This function is called when the device is opened
  */
 static int driver_open(struct inode *device_file, struct file *instance){
-	printk("The character driver is opened\n");
+	unsigned int minor = iminor(device_file);
+	unsigned int led = minor % GPIO_LED_MINORS;
+	struct gpio_led_ctrl *ctrl;
+
+	mutex_lock(&led_table_lock);
+	ctrl = idr_find(&led_table, minor / GPIO_LED_MINORS);
+	// The cdev spans every minor of the group, not only the LEDs it has
+	if (ctrl && led != GPIO_LED_ALL && led >= ctrl->nr_leds)
+		ctrl = NULL;
+	if (ctrl)
+		kref_get(&ctrl->ref);
+	mutex_unlock(&led_table_lock);
+
+	if (!ctrl)
+		return -ENODEV;
+
+	instance->private_data = ctrl;
 	return 0;
 }
 
@@ -33,68 +680,141 @@ static int driver_open(struct inode *device_file, struct file *instance){
  * @brief This function is called when the device is closed
  */
 static int driver_close(struct inode *device_file, struct file *instance){
-	printk("The character driver is closed\n");
+	struct gpio_led_ctrl *ctrl = instance->private_data;
+
+	kref_put(&ctrl->ref, gpio_led_release);
 	return 0;
 }
 
 /**
  * @brief This function is called when user want to read data
- * Read data to buffer
+ * One LED reads as "0\n" or "1\n", the all node as a bit string
  */
 static ssize_t driver_read(struct file *File, char *usr_buffer, size_t count, loff_t *offset){
-	int amount, cp, del;
-	char tmp[3];
+	struct gpio_led_ctrl *ctrl = File->private_data;
+	unsigned int led = iminor(file_inode(File)) % GPIO_LED_MINORS;
+	char tmp[LED_BITMAP_MAX + 1];
+	size_t len;
 
-	/* Get amount of data to copy */
-	amount = min(count, sizeof(tmp));
+	mutex_lock(&ctrl->lock);
+	if (led == GPIO_LED_ALL) {
+		len = led_bitmap_format(tmp, ctrl->state, ctrl->nr_leds);
+	} else {
+		tmp[0] = test_bit(led, ctrl->state) ? '1' : '0';
+		tmp[1] = '\n';
+		len = 2;
+	}
+	mutex_unlock(&ctrl->lock);
+
+	return simple_read_from_buffer(usr_buffer, count, offset, tmp, len);
+}
+
+/**
+ * @brief This function is called when user want to write data
+ * Set one LED, or all of them at once through the all node
+ */
+static ssize_t driver_write(struct file *File, const char *usr_buffer, size_t count, loff_t *offet){
+	struct gpio_led_ctrl *ctrl = File->private_data;
+	unsigned int led = iminor(file_inode(File)) % GPIO_LED_MINORS;
+	DECLARE_BITMAP(mask, LED_BITMAP_MAX);
+	DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+	char tmp[LED_BITMAP_MAX + 1];
+	ssize_t ret = count;
 
-	/* Read value of led */
-	if(DEBUG)
-		printk("This is read func Value of led: %d\n", gpio_get_value(GPIO4));
+	if (count > sizeof(tmp))
+		return -EINVAL;
 
-	tmp[0] = gpio_get_value(GPIO4) + '0';
+	/*Copy data from user*/
+	if (copy_from_user(tmp, usr_buffer, count))
+		return -EFAULT;
 
-	/* Copy data to user */
-	cp = copy_to_user(usr_buffer, &tmp, amount);
+	if (led_bitmap_parse(tmp, count, bits, led == GPIO_LED_ALL ? ctrl->nr_leds : 1))
+		return -EINVAL;
 
-	/* Calculate data */
-	del = amount - cp;
+	mutex_lock(&ctrl->lock);
+	if (!ctrl->descs) {
+		ret = -ENODEV;
+	} else if (led == GPIO_LED_ALL) {
+		/* Lines on the same bank change together, LEDs in PWM mode keep it */
+		bitmap_fill(mask, ctrl->nr_leds);
+		gpio_led_update(ctrl, mask, bits);
+	} else if (led < ctrl->nr_leds) {
+		/* A static level ends PWM */
+		gpio_led_stop_pwm(ctrl, led);
+		gpio_led_set_one(ctrl, led, test_bit(0, bits));
+	} else {
+		ret = -ENODEV;
+	}
+	mutex_unlock(&ctrl->lock);
 
-	return del;
+	return ret;
 }
 
 /**
- * @brief This function is called when user want to write data
- * Write data to buffer
+ * @brief This function is called for ioctl on a LED node - software PWM
  */
-static ssize_t driver_write(struct file *File, const char *usr_buffer, size_t count, loff_t *offet){
-	int amount, cp, del;
-	char value;
-	/*Get amount data to copy*/
-	amount = min((int)count, (int)sizeof(value));
+static long driver_ioctl(struct file *File, unsigned int cmd, unsigned long arg){
+	struct gpio_led_ctrl *ctrl = File->private_data;
+	unsigned int led = iminor(file_inode(File)) % GPIO_LED_MINORS;
+	gpio_led_wave_status wst;
+	gpio_led_pwm_stats st;
+	gpio_led_wave wave;
+	gpio_led_pwm cfg;
+	long ret = 0;
 
-	/*Copy data from user*/
-	cp = copy_from_user(&value, usr_buffer, amount);
-	
-	/* Setting the LED */
-	switch(value) {
-		case '0':
-			gpio_set_value(GPIO4, 0);
-			break;
-		case '1':
-			gpio_set_value(GPIO4, 1);
-			break;
+	/* The all node plays waveforms */
+	if (led == GPIO_LED_ALL) {
+		switch (cmd) {
+		case GPIO_LED_IOCTL_WAVE_QUEUE:
+			if (copy_from_user(&wave, (void __user *)arg, sizeof(wave)))
+				return -EFAULT;
+			mutex_lock(&ctrl->lock);
+			ret = ctrl->descs ? gpio_led_wave_queue(ctrl, &wave) : -ENODEV;
+			mutex_unlock(&ctrl->lock);
+			return ret;
+		case GPIO_LED_IOCTL_WAVE_STOP:
+			mutex_lock(&ctrl->lock);
+			gpio_led_wave_stop(ctrl);
+			mutex_unlock(&ctrl->lock);
+			return 0;
+		case GPIO_LED_IOCTL_WAVE_STATUS:
+			gpio_led_wave_status(ctrl, &wst);
+			if (copy_to_user((void __user *)arg, &wst, sizeof(wst)))
+				return -EFAULT;
+			return 0;
 		default:
-			printk("Invalid Input!\n");
-			break;
+			return -ENOTTY;
+		}
 	}
-	if(DEBUG)
-		printk("This is write func Value of led: %d\n", gpio_get_value(GPIO4));
 
-	/*Caculate data*/
-	del = amount - cp;
+	if (led >= ctrl->nr_leds)
+		return -ENOTTY;
 
-	return del;
+	switch (cmd) {
+	case GPIO_LED_IOCTL_SET_PWM:
+		if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+			return -EFAULT;
+		mutex_lock(&ctrl->lock);
+		ret = ctrl->descs ? gpio_led_set_pwm(ctrl, led, &cfg) : -ENODEV;
+		mutex_unlock(&ctrl->lock);
+		break;
+	case GPIO_LED_IOCTL_GET_PWM:
+		mutex_lock(&ctrl->lock);
+		cfg.duty = ctrl->pwm[led].duty ? ctrl->pwm[led].duty : (test_bit(led, ctrl->state) ? GPIO_LED_DUTY_MAX : 0);
+		cfg.freq_hz = ctrl->pwm[led].freq_hz;
+		mutex_unlock(&ctrl->lock);
+		if (copy_to_user((void __user *)arg, &cfg, sizeof(cfg)))
+			return -EFAULT;
+		break;
+	case GPIO_LED_IOCTL_PWM_STATS:
+		gpio_led_pwm_stats(ctrl, led, &st);
+		if (copy_to_user((void __user *)arg, &st, sizeof(st)))
+			return -EFAULT;
+		break;
+	default:
+		return -ENOTTY;
+	}
+	return ret;
 }
 
 static struct file_operations fops = {
@@ -102,70 +822,280 @@ static struct file_operations fops = {
 	.open = driver_open,
 	.release = driver_close,
 	.read = driver_read,
-	.write = driver_write
+	.write = driver_write,
+	.unlocked_ioctl = driver_ioctl,
+};
+
+/**
+ * @brief Remove the device files of a group
+ */
+static void gpio_led_destroy_files(struct gpio_led_ctrl *ctrl){
+	unsigned int i;
+
+	device_destroy(my_class, ctrl->devt + GPIO_LED_ALL);
+	for (i = 0; i < ctrl->nr_leds; i++)
+		device_destroy(my_class, ctrl->devt + i);
+}
+
+/**
+ * @brief Create one device file per LED and one for the whole group
+ */
+static int gpio_led_create_files(struct gpio_led_ctrl *ctrl, struct device *parent){
+	struct device *dev;
+	unsigned int i;
+
+	for (i = 0; i < ctrl->nr_leds; i++) {
+		dev = device_create(my_class, parent, ctrl->devt + i, ctrl, DRIVER_NAME "%d_%u", ctrl->id, i);
+		if (IS_ERR(dev))
+			goto err;
+	}
+
+	dev = device_create(my_class, parent, ctrl->devt + GPIO_LED_ALL, ctrl, DRIVER_NAME "%d_all", ctrl->id);
+	if (IS_ERR(dev))
+		goto err;
+	return 0;
+
+err:
+	while (i--)
+		device_destroy(my_class, ctrl->devt + i);
+	return PTR_ERR(dev);
+}
+
+/**
+ * @brief This function is called when a group of LEDs is bound to the driver
+ */
+static int gpio_led_probe(struct platform_device *pdev) {
+	struct device *dev = &pdev->dev;
+	struct gpio_led_ctrl *ctrl;
+	unsigned int i;
+	int ret;
+
+	ctrl = kzalloc(sizeof(*ctrl), GFP_KERNEL);
+	if (!ctrl)
+		return -ENOMEM;
+
+	mutex_init(&ctrl->lock);
+	kref_init(&ctrl->ref);
+	spin_lock_init(&ctrl->pwm_lock);
+	hrtimer_init(&ctrl->pwm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	ctrl->pwm_timer.function = gpio_led_pwm_tick;
+	hrtimer_init(&ctrl->wave_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	ctrl->wave_timer.function = gpio_led_wave_tick;
+	init_llist_head(&ctrl->wave_done);
+	INIT_WORK(&ctrl->wave_free_work, gpio_led_wave_free_work);
+
+	// All LEDs start off
+	ctrl->descs = gpiod_get_array(dev, "led", GPIOD_OUT_LOW);
+	if (IS_ERR(ctrl->descs)) {
+		ret = dev_err_probe(dev, PTR_ERR(ctrl->descs), "Can not get the led gpios\n");
+		goto freeError;
+	}
+	ctrl->nr_leds = ctrl->descs->ndescs;
+	if (ctrl->nr_leds > LED_BITMAP_MAX) {
+		dev_err(dev, "Too many LEDs, at most %d\n", LED_BITMAP_MAX);
+		ret = -EINVAL;
+		goto gpioError;
+	}
+
+	// PWM runs in the timer interrupt, so every line must be settable there
+	ctrl->can_pwm = true;
+	for (i = 0; i < ctrl->nr_leds; i++)
+		ctrl->can_pwm &= !gpiod_cansleep(ctrl->descs->desc[i]);
+
+	// Reserve a group id, the group is not visible to open() yet
+	mutex_lock(&led_table_lock);
+	ctrl->id = idr_alloc(&led_table, NULL, 0, GPIO_LED_MAX_DEVICES, GFP_KERNEL);
+	mutex_unlock(&led_table_lock);
+	if (ctrl->id < 0) {
+		dev_err(dev, "No free minor number\n");
+		ret = ctrl->id;
+		goto gpioError;
+	}
+	ctrl->devt = MKDEV(MAJOR(device_nr), ctrl->id * GPIO_LED_MINORS);
+
+	// One cdev covers every node of the group
+	ctrl->cdev = cdev_alloc();
+	if (!ctrl->cdev) {
+		ret = -ENOMEM;
+		goto idError;
+	}
+	ctrl->cdev->ops = &fops;
+	ctrl->cdev->owner = THIS_MODULE;
+	ret = cdev_add(ctrl->cdev, ctrl->devt, GPIO_LED_MINORS);
+	if (ret) {
+		dev_err(dev, "Register device to kernel failed!\n");
+		kobject_put(&ctrl->cdev->kobj);
+		goto idError;
+	}
+
+	ret = gpio_led_create_files(ctrl, dev);
+	if (ret) {
+		dev_err(dev, "Device file can not be created!\n");
+		goto cdevError;
+	}
+
+	ret = gpio_led_register_leds(ctrl, dev);
+	if (ret) {
+		dev_err(dev, "Can not register the LEDs with the LED class\n");
+		goto filesError;
+	}
+
+	mutex_lock(&led_table_lock);
+	idr_replace(&led_table, ctrl, ctrl->id);
+	mutex_unlock(&led_table_lock);
+
+	platform_set_drvdata(pdev, ctrl);
+	dev_info(dev, "%u LED(s) as /dev/%s%d_*\n", ctrl->nr_leds, DRIVER_NAME, ctrl->id);
+	return 0;
+
+filesError:
+	gpio_led_destroy_files(ctrl);
+cdevError:
+	cdev_del(ctrl->cdev);
+idError:
+	mutex_lock(&led_table_lock);
+	idr_remove(&led_table, ctrl->id);
+	mutex_unlock(&led_table_lock);
+gpioError:
+	gpiod_put_array(ctrl->descs);
+freeError:
+	kfree(ctrl);
+	return ret;
+}
+
+/**
+ * @brief This function is called when a group of LEDs is unbound from the driver
+ */
+static void gpio_led_remove(struct platform_device *pdev) {
+	struct gpio_led_ctrl *ctrl = platform_get_drvdata(pdev);
+
+	mutex_lock(&led_table_lock);
+	idr_remove(&led_table, ctrl->id);
+	mutex_unlock(&led_table_lock);
+
+	// No trigger can reach the group once its LEDs are unregistered
+	gpio_led_unregister_leds(ctrl, ctrl->nr_leds);
+	gpio_led_destroy_files(ctrl);
+	cdev_del(ctrl->cdev);
+
+	// Files that are still open see -ENODEV from now on
+	mutex_lock(&ctrl->lock);
+	gpio_led_wave_stop(ctrl);
+	flush_work(&ctrl->wave_free_work);
+	spin_lock_irq(&ctrl->pwm_lock);
+	bitmap_zero(ctrl->pwm_mask, ctrl->nr_leds);
+	spin_unlock_irq(&ctrl->pwm_lock);
+	hrtimer_cancel(&ctrl->pwm_timer);
+	bitmap_zero(ctrl->state, ctrl->nr_leds);
+	gpio_led_apply(ctrl);
+	gpiod_put_array(ctrl->descs);
+	ctrl->descs = NULL;
+	mutex_unlock(&ctrl->lock);
+
+	kref_put(&ctrl->ref, gpio_led_release);
+}
+
+static const struct of_device_id gpio_led_of_match[] = {
+	{ .compatible = "phanhao,gpio-leds" },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, gpio_led_of_match);
+
+static struct platform_driver gpio_led_driver = {
+	.driver = {
+		.name = "gpio-led-ctrl",
+		.of_match_table = gpio_led_of_match,
+	},
+	.probe = gpio_led_probe,
+	.remove_new = gpio_led_remove,
 };
 
+/**
+ * @brief Describe the gpios parameter as a lookup table and create a group for it
+ */
+static int legacy_create(void){
+	struct gpio_desc *desc;
+	struct gpio_chip *chip;
+	int i, ret;
+
+	legacy_lookup = kzalloc(struct_size(legacy_lookup, table, nr_gpios + 1), GFP_KERNEL);
+	if (!legacy_lookup)
+		return -ENOMEM;
+
+	legacy_lookup->dev_id = "gpio-led-ctrl";
+	for (i = 0; i < nr_gpios; i++) {
+		desc = gpio_to_desc(gpios[i]);
+		chip = desc ? gpiod_to_chip(desc) : NULL;
+		if (!chip) {
+			printk("Gpio led - GPIO %d does not exist\n", gpios[i]);
+			kfree(legacy_lookup);
+			legacy_lookup = NULL;
+			return -ENODEV;
+		}
+		legacy_lookup->table[i] = (struct gpiod_lookup)
+			GPIO_LOOKUP_IDX(chip->label, gpios[i] - chip->base, "led", i, GPIO_ACTIVE_HIGH);
+	}
+	gpiod_add_lookup_table(legacy_lookup);
+
+	legacy_pdev = platform_device_register_simple("gpio-led-ctrl", PLATFORM_DEVID_NONE, NULL, 0);
+	if (IS_ERR(legacy_pdev)) {
+		ret = PTR_ERR(legacy_pdev);
+		legacy_pdev = NULL;
+		gpiod_remove_lookup_table(legacy_lookup);
+		kfree(legacy_lookup);
+		legacy_lookup = NULL;
+		return ret;
+	}
+	return 0;
+}
+
 /**
  * @brief This function is called when the driver is loaded into kernel
  */
 static int __init ModuleInit(void){
-	printk(KERN_INFO "Hello, this is character driver\n");
+	int ret;
 
-	/*Allocate a device number*/
-	if(alloc_chrdev_region(&device_nr, 0, 1, DRIVER_NAME) < 0){
+	printk(KERN_INFO "Hello, this is gpio led driver\n");
+
+	/*Allocate device numbers for all groups*/
+	ret = alloc_chrdev_region(&device_nr, 0, GPIO_LED_MAX_DEVICES * GPIO_LED_MINORS, DRIVER_NAME);
+	if (ret < 0) {
 		printk("Could not be allocated the device number\n");
-		return -1;
+		return ret;
 	}
-	printk("Device %s was registered with Major: %d, Minor: %d\n", DRIVER_NAME, device_nr >> 20, device_nr & 0xfffff);
+	printk("Device %s was registered with Major: %d\n", DRIVER_NAME, MAJOR(device_nr));
 
 	/*Create device class*/
-    if ((my_class = class_create(DRIVER_CLASS)) == NULL){
+	my_class = class_create(DRIVER_CLASS);
+	if (IS_ERR(my_class)) {
 		printk("Device class can not be create!\n");
+		ret = PTR_ERR(my_class);
 		goto classError;
 	}
 
-	/*create device file*/
-	if(device_create(my_class, NULL, device_nr, NULL, DRIVER_NAME) == NULL){
-		printk("Device file can not be create!\n");
-		goto fileError;
+	ret = platform_driver_register(&gpio_led_driver);
+	if (ret) {
+		printk("Register platform driver failed!\n");
+		goto driverError;
 	}
 
-	/*Initialize device file*/
-	cdev_init(&my_device, &fops);
-
-	/*Register device to kernel*/
-	if(cdev_add(&my_device, device_nr, 1) == -1){
-		printk("Register device to kernel fail!\n");
-		goto addError;
+	if (legacy) {
+		ret = legacy_create();
+		if (ret) {
+			printk("Gpio led - Can not create the legacy group\n");
+			goto legacyError;
+		}
 	}
 
-    /* GPIO 4 init */
-	if(gpio_request(GPIO4, "rpi-gpio-4")) {
-		printk("Gpio led - Can not allocate GPIO 4\n");
-		goto addError;
-	}
-	printk("Gpio led - Allocate GPIO 4 success\n");
-
-	/*Set DPIO 4 direction*/
-	if(gpio_direction_output(GPIO4, 0)){
-		printk("Gpio led - Can not set gpio4 to output\n");
-		goto gpio4Error;
-	}
-	printk("Gpio led - Set gpio4 to output success\n");
-	if(DEBUG)
-		printk("Gpio led - Value of led: %d\n", gpio_get_value(GPIO4));
-
 	return 0;
 
-classError:
-	unregister_chrdev_region(device_nr, 1);
-fileError:
+legacyError:
+	platform_driver_unregister(&gpio_led_driver);
+driverError:
 	class_destroy(my_class);
-addError:
-	device_destroy(my_class, device_nr);
-gpio4Error:
-	gpio_free(516);
-	return -1;
+classError:
+	unregister_chrdev_region(device_nr, GPIO_LED_MAX_DEVICES * GPIO_LED_MINORS);
+	return ret;
 }
 
 /**
@@ -173,11 +1103,15 @@ gpio4Error:
  */
 static void __exit ModuleExit(void){
 	printk(KERN_INFO "Good bye kernel!\n");
-	cdev_del(&my_device);
-	device_destroy(my_class, device_nr);
+	if (legacy_pdev) {
+		platform_device_unregister(legacy_pdev);
+		gpiod_remove_lookup_table(legacy_lookup);
+		kfree(legacy_lookup);
+	}
+	platform_driver_unregister(&gpio_led_driver);
 	class_destroy(my_class);
-	unregister_chrdev_region(device_nr, 1);
-	gpio_free(4);
+	unregister_chrdev_region(device_nr, GPIO_LED_MAX_DEVICES * GPIO_LED_MINORS);
+	idr_destroy(&led_table);
 }
 
 module_init(ModuleInit);
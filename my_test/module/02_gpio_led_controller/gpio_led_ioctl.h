@@ -0,0 +1,69 @@
+#ifndef __GPIO_LED_IOCTL_H__
+#define __GPIO_LED_IOCTL_H__
+
+#define GPIO_LED_MAGIC_NUM 0xF3
+
+#define GPIO_LED_DUTY_MAX       1000    // duty cycle is in per mille
+#define GPIO_LED_PWM_MAX_HZ     5000
+
+/* Software PWM of one LED, duty 0 or GPIO_LED_DUTY_MAX leaves the LED static */
+typedef struct gpio_led_pwm {
+    unsigned int duty;          // 0..GPIO_LED_DUTY_MAX
+    unsigned int freq_hz;       // 1..GPIO_LED_PWM_MAX_HZ
+} gpio_led_pwm;
+
+/* What the PWM engine achieved for one LED since PWM was set */
+typedef struct gpio_led_pwm_stats {
+    unsigned long long periods;     // periods completed
+    unsigned int freq_mhz;          // achieved frequency in mHz
+    unsigned int edge_avg_ns;       // average distance of an edge to its ideal time
+    unsigned int edge_max_ns;
+    unsigned int late_avg_ns;       // average timer latency of the group
+    unsigned int late_max_ns;
+    unsigned long long ticks;       // timer callbacks of the group
+} gpio_led_pwm_stats;
+
+/* One step of a waveform */
+typedef struct gpio_led_step {
+    unsigned int bitmap;            // bit n = level of LED n
+    unsigned int pad;
+    unsigned long long duration_ns; // at least GPIO_LED_WAVE_MIN_NS
+} gpio_led_step;
+
+#define GPIO_LED_WAVE_MAX_STEPS 65536
+#define GPIO_LED_WAVE_MIN_NS    10000
+
+/* Waveform flags */
+#define GPIO_LED_WAVE_NOW       0x1     // replace the playing waveform at once
+
+typedef struct gpio_led_wave {
+    unsigned long long steps;       // pointer to nr_steps gpio_led_step
+    unsigned int nr_steps;
+    unsigned int loops;             // times to play it, 0 = until replaced
+    unsigned int mask;              // LEDs driven by the waveform
+    unsigned int flags;
+} gpio_led_wave;
+
+typedef struct gpio_led_wave_status {
+    unsigned int playing;
+    unsigned int queued;            // a waveform waits for the current one
+    unsigned int step;              // next step of the playing waveform
+    unsigned int loop;
+    unsigned long long switches;    // queued waveforms that took over
+    unsigned long long overruns;    // steps that started late
+} gpio_led_wave_status;
+
+/* On /dev/gpio_led<group>_<n> only */
+#define GPIO_LED_IOCTL_SET_PWM      _IOW(GPIO_LED_MAGIC_NUM, 0, gpio_led_pwm)
+#define GPIO_LED_IOCTL_GET_PWM      _IOR(GPIO_LED_MAGIC_NUM, 1, gpio_led_pwm)
+#define GPIO_LED_IOCTL_PWM_STATS    _IOR(GPIO_LED_MAGIC_NUM, 2, gpio_led_pwm_stats)
+
+/*
+ * On /dev/gpio_led<group>_all only. A waveform plays while the next one is
+ * queued, a new upload replaces the queued one.
+ */
+#define GPIO_LED_IOCTL_WAVE_QUEUE   _IOW(GPIO_LED_MAGIC_NUM, 3, gpio_led_wave)
+#define GPIO_LED_IOCTL_WAVE_STOP    _IO(GPIO_LED_MAGIC_NUM, 4)
+#define GPIO_LED_IOCTL_WAVE_STATUS  _IOR(GPIO_LED_MAGIC_NUM, 5, gpio_led_wave_status)
+
+#endif
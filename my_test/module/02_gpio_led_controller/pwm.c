@@ -0,0 +1,70 @@
+/**
+ * Dim the LEDs of group 0 with software PWM and print what the engine achieved
+ *
+ *   ./pwm [freq_hz]
+ *
+ * Every LED breathes with its own phase, the engine merges the edges that
+ * fall together.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "gpio_led_ioctl.h"
+
+#define MAX_LEDS 32
+
+int main(int argc, char *argv[]){
+    unsigned int freq = argc > 1 ? atoi(argv[1]) : 200;
+    int fd[MAX_LEDS], n, i, step;
+    gpio_led_pwm pwm;
+    gpio_led_pwm_stats st;
+    char path[64];
+
+    for (n = 0; n < MAX_LEDS; n++) {
+        snprintf(path, sizeof(path), "/dev/gpio_led0_%d", n);
+        fd[n] = open(path, O_RDWR);
+        if (fd[n] == -1)
+            break;
+    }
+    if (n == 0) {
+        printf("Open device failed!\n");
+        return -1;
+    }
+    printf("%d LED(s), %u Hz\n", n, freq);
+
+    for (step = 0; step < 200; step++) {
+        for (i = 0; i < n; i++) {
+            int phase = (step * 10 + i * 1000 / n) % 2000;
+            pwm.duty = phase < 1000 ? phase : 2000 - phase;
+            pwm.freq_hz = freq;
+            if (ioctl(fd[i], GPIO_LED_IOCTL_SET_PWM, &pwm) == -1) {
+                perror("GPIO_LED_IOCTL_SET_PWM");
+                return -1;
+            }
+        }
+        usleep(20000);
+    }
+
+    /* Hold a steady duty cycle and measure it */
+    for (i = 0; i < n; i++) {
+        pwm.duty = 100 + i * 800 / n;
+        pwm.freq_hz = freq;
+        ioctl(fd[i], GPIO_LED_IOCTL_SET_PWM, &pwm);
+    }
+    sleep(2);
+
+    for (i = 0; i < n; i++) {
+        ioctl(fd[i], GPIO_LED_IOCTL_PWM_STATS, &st);
+        printf("LED %2d: %llu periods, %u.%03u Hz, edge error avg %u ns max %u ns\n",
+               i, st.periods, st.freq_mhz / 1000, st.freq_mhz % 1000, st.edge_avg_ns, st.edge_max_ns);
+    }
+    printf("timer: %llu ticks, latency avg %u ns max %u ns\n", st.ticks, st.late_avg_ns, st.late_max_ns);
+
+    for (i = 0; i < n; i++) {
+        write(fd[i], "0", 1);
+        close(fd[i]);
+    }
+    return 0;
+}
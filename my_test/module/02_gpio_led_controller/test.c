@@ -5,34 +5,43 @@
 #include <string.h> 
 
 int main(){
-    char buff[5];
+    char buff[40];
+    int n;
 
-    /* Open the device */
-    int dev = open("/dev/gpio_Led", O_RDWR);
-    if(dev == -1){
+    /* Open the first LED and the whole group */
+    int led = open("/dev/gpio_led0_0", O_RDWR);
+    int all = open("/dev/gpio_led0_all", O_RDWR);
+    if(led == -1 || all == -1){
         printf("Open device failed!\n");
         return -1;
     }
     printf("Open the device success\n");
 
     while(1){
-        /* Write data to device */
-        write(dev, "1", 1); 
-        read(dev, buff, sizeof(buff));
-        printf("Read data '%s' from device\n", buff); 
+        /* One LED */
+        write(led, "1", 1); 
+        n = pread(led, buff, sizeof(buff) - 1, 0);
+        buff[n > 0 ? n : 0] = '\0';
+        printf("Read LED 0: %s", buff); 
         sleep(2);
-        write(dev, "0", 1); 
-        read(dev, buff, sizeof(buff));
-        printf("Read data '%s' from device\n", buff); 
+
+        /* Every LED at once, LED 0 first */
+        n = pread(all, buff, sizeof(buff) - 1, 0);
+        buff[n > 0 ? n : 0] = '\0';
+        if(n < 1 || n > (int)sizeof(buff) - 1){
+            printf("Read group failed!\n");
+            break;
+        }
+        printf("Read group: %s", buff); 
+        memset(buff, '0', n - 1);
+        write(all, buff, n);
+        printf("Group off\n"); 
         sleep(2);
     }
 
-
-    /* Read data from device */
-
-
     /* Close the device */
-    close(dev);
+    close(led);
+    close(all);
 
     return 0;
 }
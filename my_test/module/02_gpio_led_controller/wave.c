@@ -0,0 +1,84 @@
+/**
+ * Play waveforms on LED group 0
+ *
+ *   ./wave
+ *
+ * Uploads a running light, queues a blink pattern behind it while it plays
+ * and prints when the player switched over.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "gpio_led_ioctl.h"
+
+static int queue(int fd, gpio_led_step *steps, unsigned int n, unsigned int loops, unsigned int mask){
+    gpio_led_wave wave = {
+        .steps = (uintptr_t)steps,
+        .nr_steps = n,
+        .loops = loops,
+        .mask = mask,
+    };
+
+    if (ioctl(fd, GPIO_LED_IOCTL_WAVE_QUEUE, &wave) == -1) {
+        perror("GPIO_LED_IOCTL_WAVE_QUEUE");
+        return -1;
+    }
+    return 0;
+}
+
+static void status(int fd){
+    gpio_led_wave_status st;
+
+    ioctl(fd, GPIO_LED_IOCTL_WAVE_STATUS, &st);
+    printf("playing %u queued %u step %u loop %u switches %llu overruns %llu\n",
+           st.playing, st.queued, st.step, st.loop, st.switches, st.overruns);
+}
+
+int main(){
+    gpio_led_step run[4], blink[2];
+    char buf[40];
+    int fd, n, i;
+
+    fd = open("/dev/gpio_led0_all", O_RDWR);
+    if (fd == -1) {
+        printf("Open device failed!\n");
+        return -1;
+    }
+    n = read(fd, buf, sizeof(buf)) - 1;
+    if (n < 1)
+        return -1;
+    if (n > 4)
+        n = 4;
+
+    /* Running light, 100 ms per LED, 10 times */
+    memset(run, 0, sizeof(run));
+    for (i = 0; i < n; i++) {
+        run[i].bitmap = 1u << i;
+        run[i].duration_ns = 100000000ull;
+    }
+    if (queue(fd, run, n, 10, (1u << n) - 1))
+        return -1;
+    status(fd);
+
+    /* All on / all off, 1 kHz, takes over right after the running light */
+    memset(blink, 0, sizeof(blink));
+    blink[0].bitmap = (1u << n) - 1;
+    blink[0].duration_ns = 500000;
+    blink[1].duration_ns = 500000;
+    if (queue(fd, blink, 2, 2000, (1u << n) - 1))
+        return -1;
+    status(fd);
+
+    for (i = 0; i < 8; i++) {
+        sleep(1);
+        status(fd);
+    }
+
+    ioctl(fd, GPIO_LED_IOCTL_WAVE_STOP);
+    close(fd);
+    return 0;
+}
@@ -1,6 +1,25 @@
 /**
  * This is a Driver to comunicate with LCD 16x2
  * When user write a string to device, It will display on LCD
+ *
+ * Every panel is an i2c client bound to this driver, so several panels can be
+ * driven by one copy of the module. Each panel gets its own state, lock and
+ * device file /dev/lcd_deviceN. Panels can be created from device tree
+ * (compatible = "phanhao,lcd1602") or at runtime:
+ *   echo lcd1602 0x27 > /sys/bus/i2c/devices/i2c-1/new_device
+ * For the old behaviour, load the module with bus=1 and the panel at 0x27 is
+ * created automatically. Probing is asynchronous and the panel init runs in a
+ * work item, so loading the module never waits for the LCD; writes wait until
+ * the panel is ready (or fail with -EAGAIN when opened O_NONBLOCK).
+ *
+ * Text longer than the panel is kept in the kernel and scrolled by an hrtimer.
+ * A '\n' in the message starts the second line. See lcd_ioctl.h for the
+ * scroll modes.
+ *
+ * Messages are UTF-8. Characters in the HD44780 ROM are mapped to their ROM
+ * code, other characters use a 5x8 glyph uploaded with LCD_IOCTL_SET_GLYPH.
+ * The 8 CGRAM slots hold the most recently used glyphs, a slot is only
+ * rewritten when its glyph is evicted.
  */
 
 #include <linux/module.h>
@@ -11,79 +30,430 @@
 #include <linux/i2c.h>
 #include <linux/delay.h>
 #include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/kref.h>
+#include <linux/idr.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/xarray.h>
+#include <linux/bsearch.h>
+#include <linux/nls.h>
+#include "lcd_ioctl.h"
+#include "lcd_encode.h"
 
 /* Define for LCD */
 #define I2C_ADDR 0x27
-#define ENABLE 0x04
-#define BACKLIGHT 0x08
 
-static struct i2c_client *lcd_client; 
-static struct i2c_adapter *lcd_adapter;
+#define LCD_COLS 16
+#define LCD_ROWS 2
+#define LCD_DDRAM_LINE 40       // DDRAM cells per line, the display shift wraps here
+
+/* Commands */
+#define LCD_CMD_CLEAR 0x01
+#define LCD_CMD_HOME 0x02
+#define LCD_CMD_CGRAM 0x40
+#define LCD_CMD_SHIFT_LEFT 0x18
+#define LCD_CMD_SHIFT_RIGHT 0x1C
+#define LCD_CMD_DDRAM 0x80
+
+#define LCD_MSG_MAX PAGE_SIZE   // longest message accepted by write()
+#define LCD_SCROLL_GAP 4        // blanks between the end and the start of a scrolling line
+#define LCD_STEP_MS_MIN 20
+#define LCD_STEP_MS_MAX 10000
+#define LCD_STEP_MS_DEFAULT 300
+
+#define LCD_CGRAM_SLOTS 8
+#define LCD_MAX_GLYPHS 256      // glyphs kept per panel
+#define LCD_CHAR_UNKNOWN '?'
+
+static const u8 lcd_row_addr[LCD_ROWS] = { 0x00, 0x40 };
+
+/* One line of the current message */
+struct lcd_line {
+    const u32 *text;            // codepoints, points into lcd_device.text
+    size_t len;
+    size_t offset;              // first visible character when scrolling by redraw
+};
+
+/* One CGRAM slot of the glyph cache */
+struct lcd_cgram_slot {
+    u32 codepoint;              // 0: empty
+    u64 last_used;              // LRU stamp
+    u8 rows;                    // rows that show this slot, such a slot is never evicted
+};
+/* State of one panel */
+struct lcd_device {
+    struct i2c_client *client;      // NULL once the panel is removed
+    struct mutex lock;              // serialises bus access and message
+    struct kref ref;                // held by probe and every open file
+    char *msg;                      // last message written, as written
+    size_t msg_len;
+    u32 *text;                      // msg decoded from UTF-8
+    size_t text_len;
+    struct lcd_line line[LCD_ROWS];
+    struct cdev *cdev;
+    dev_t devt;
+    struct work_struct init_work;   // panel init runs after probe returns
+    struct completion init_done;
+
+    /* Scroll engine */
+    int scroll_mode;
+    int step_ms;
+    int direction;
+    bool hw_shift;                  // current frame scrolls with the display shift
+    bool scrolling;                 // timer keeps running while set
+    struct hrtimer scroll_timer;
+    struct work_struct scroll_work; // bus access can sleep, the timer can not
+
+    /* Glyph cache */
+    struct xarray glyphs;           // codepoint -> 8 byte bitmap
+    unsigned int nr_glyphs;
+    struct lcd_cgram_slot cgram[LCD_CGRAM_SLOTS];
+    u64 lru_clock;
+};
+
+/* Unicode characters found in the ROM (A00) of the HD44780, sorted by codepoint */
+static const struct lcd_rom_char {
+    u32 codepoint;
+    u8 code;
+} lcd_rom_table[] = {
+    { 0x00A2, 0xEC },   // ¢
+    { 0x00A5, 0x5C },   // ¥
+    { 0x00B0, 0xDF },   // °
+    { 0x00B5, 0xE4 },   // µ
+    { 0x00B7, 0xA5 },   // ·
+    { 0x00DF, 0xE2 },   // ß
+    { 0x00E4, 0xE1 },   // ä
+    { 0x00F1, 0xEE },   // ñ
+    { 0x00F6, 0xEF },   // ö
+    { 0x00F7, 0xFD },   // ÷
+    { 0x00FC, 0xF5 },   // ü
+    { 0x03A3, 0xF6 },   // Σ
+    { 0x03A9, 0xF4 },   // Ω
+    { 0x03B1, 0xE0 },   // α
+    { 0x03B2, 0xE2 },   // β
+    { 0x03B5, 0xE3 },   // ε
+    { 0x03B8, 0xF2 },   // θ
+    { 0x03C0, 0xF7 },   // π
+    { 0x03C1, 0xE6 },   // ρ
+    { 0x03C3, 0xE5 },   // σ
+    { 0x2190, 0x7F },   // ←
+    { 0x2192, 0x7E },   // →
+    { 0x221A, 0xE8 },   // √
+    { 0x221E, 0xF3 },   // ∞
+    { 0x2588, 0xFF },   // █
+};
 
 //##################### LCD FUNCTION #####################
-/* Send enable signal to LCD */
-static void lcd_toggle_enable(u8 data) {
-    i2c_smbus_write_byte(lcd_client, data | ENABLE);
-    udelay(500);
-    i2c_smbus_write_byte(lcd_client, data & ~ENABLE);
-    udelay(500);
+/* Send one byte, the LCD latches each nibble on the falling edge of EN */
+static void lcd_send(struct lcd_device *lcd, u8 byte, bool data) {
+    u8 xfer[LCD_XFER_LEN];
+    int i;
+
+    lcd_encode(byte, data, xfer);
+    for (i = 0; i < LCD_XFER_LEN; i++) {
+        i2c_smbus_write_byte(lcd->client, xfer[i]);
+        /* EN pulse width and hold time */
+        if (i % 3)
+            udelay(500);
+    }
 }
 
 /* Send command to LCD */
-static void lcd_send_command(u8 cmd) {
-    u8 high = cmd & 0xF0;
-    u8 low = (cmd << 4) & 0xF0;
-
-    i2c_smbus_write_byte(lcd_client, high | BACKLIGHT);
-    lcd_toggle_enable(high | BACKLIGHT);
+static void lcd_send_command(struct lcd_device *lcd, u8 cmd) {
+    lcd_send(lcd, cmd, false);
 
-    i2c_smbus_write_byte(lcd_client, low | BACKLIGHT);
-    lcd_toggle_enable(low | BACKLIGHT);
+    /* Clear and return home take 1.52 ms, the LCD ignores anything sent meanwhile */
+    if (cmd == LCD_CMD_CLEAR || (cmd & 0xFE) == LCD_CMD_HOME)
+        usleep_range(1600, 2000);
 }
 
 /* Send data to LCD */
-static void lcd_send_data(u8 data) {
-    u8 high = data & 0xF0;
-    u8 low = (data << 4) & 0xF0;
-
-    i2c_smbus_write_byte(lcd_client, high | BACKLIGHT | 0x01);
-    lcd_toggle_enable(high | BACKLIGHT | 0x01);			// Make sure this is a data not a command
-
-    i2c_smbus_write_byte(lcd_client, low | BACKLIGHT | 0x01);
-    lcd_toggle_enable(low | BACKLIGHT | 0x01);
-}
-
-/* Print data on LCD */
-static void lcd_print(const char *str) {
-    int char_count = 0;  // Counter to track the number of printed characters
-    lcd_send_command(0x01);  // Clear the screen
-
-    while (*str != '\0') {
-        if (char_count < 16) {  // Print characters on line 1
-            lcd_send_data(*str++);
-            char_count++;
-        } else if (char_count < 32) {  // Print characters on line 2
-            if (char_count == 16) {
-                lcd_send_command(0xC0);  // Move the cursor to the beginning of line 2
-            }
-            lcd_send_data(*str++);
-            char_count++;
-        } else {
-            break;  // Stop printing once 32 characters (16 on each line) are printed
+static void lcd_send_data(struct lcd_device *lcd, u8 data) {
+    lcd_send(lcd, data, true);
+}
+
+static int lcd_rom_cmp(const void *key, const void *elt) {
+    u32 codepoint = *(const u32 *)key;
+    const struct lcd_rom_char *rom = elt;
+
+    if (codepoint < rom->codepoint)
+        return -1;
+    return codepoint > rom->codepoint;
+}
+
+/* Write a glyph into a CGRAM slot, the caller sets the DDRAM address again */
+static void lcd_upload_glyph(struct lcd_device *lcd, int slot, const u8 *bitmap) {
+    int i;
+
+    lcd_send_command(lcd, LCD_CMD_CGRAM | (slot << 3));
+    for (i = 0; i < 8; i++)
+        lcd_send_data(lcd, bitmap[i] & 0x1F);
+}
+
+/* Find the CGRAM slot of a glyph, upload it into the least recently used free slot on a miss */
+static int lcd_cgram_get(struct lcd_device *lcd, u32 codepoint, const u8 *bitmap, int row) {
+    struct lcd_cgram_slot *slot;
+    int i, victim = -1;
+
+    for (i = 0; i < LCD_CGRAM_SLOTS; i++) {
+        slot = &lcd->cgram[i];
+        if (slot->codepoint == codepoint)
+            goto hit;
+        /* Slots on screen can not be reused, their characters would change */
+        if (slot->rows)
+            continue;
+        if (victim < 0 || slot->last_used < lcd->cgram[victim].last_used)
+            victim = i;
+    }
+
+    if (victim < 0)
+        return -ENOSPC;
+
+    i = victim;
+    slot = &lcd->cgram[i];
+    lcd_upload_glyph(lcd, i, bitmap);
+    slot->codepoint = codepoint;
+hit:
+    slot->last_used = ++lcd->lru_clock;
+    slot->rows |= BIT(row);
+    return i;
+}
+
+/* Translate a codepoint to the code sent to the LCD */
+static u8 lcd_map_char(struct lcd_device *lcd, u32 codepoint, int row) {
+    const struct lcd_rom_char *rom;
+    const u8 *bitmap;
+    int slot;
+
+    /* ASCII is in the ROM, except '\\' and '~' */
+    if (codepoint >= 0x20 && codepoint < 0x7E && codepoint != '\\')
+        return codepoint;
+    if (codepoint < 0x20)
+        return ' ';
+
+    rom = bsearch(&codepoint, lcd_rom_table, ARRAY_SIZE(lcd_rom_table),
+                  sizeof(lcd_rom_table[0]), lcd_rom_cmp);
+    if (rom)
+        return rom->code;
+
+    bitmap = xa_load(&lcd->glyphs, codepoint);
+    if (!bitmap)
+        return LCD_CHAR_UNKNOWN;
+
+    slot = lcd_cgram_get(lcd, codepoint, bitmap, row);
+    return slot < 0 ? LCD_CHAR_UNKNOWN : slot;
+}
+
+/* Write a window of a line, the text repeats after a gap of blanks */
+static void lcd_print_line(struct lcd_device *lcd, int row, size_t offset, size_t width) {
+    struct lcd_line *line = &lcd->line[row];
+    size_t period = line->len + LCD_SCROLL_GAP;
+    u8 codes[LCD_DDRAM_LINE];
+    size_t i, pos;
+
+    /* Glyphs that left this row can be evicted now */
+    for (i = 0; i < LCD_CGRAM_SLOTS; i++)
+        lcd->cgram[i].rows &= ~BIT(row);
+
+    /* Map first, a CGRAM upload moves the address counter */
+    for (i = 0; i < width; i++) {
+        pos = (offset + i) % period;
+        codes[i] = pos < line->len ? lcd_map_char(lcd, line->text[pos], row) : ' ';
+    }
+
+    lcd_send_command(lcd, LCD_CMD_DDRAM | lcd_row_addr[row]);
+    for (i = 0; i < width; i++)
+        lcd_send_data(lcd, codes[i]);
+}
+
+/* Decode the UTF-8 message, invalid bytes become U+FFFD */
+static u32 *lcd_decode(const char *msg, size_t len, size_t *text_len) {
+    unicode_t codepoint;
+    size_t n = 0;
+    u32 *text;
+    int used;
+
+    text = kmalloc_array(len + 1, sizeof(*text), GFP_KERNEL);
+    if (!text)
+        return NULL;
+
+    while (len) {
+        used = utf8_to_utf32(msg, len, &codepoint);
+        if (used <= 0) {
+            codepoint = 0xFFFD;
+            used = 1;
+        }
+        text[n++] = codepoint;
+        msg += used;
+        len -= used;
+    }
+
+    *text_len = n;
+    return text;
+}
+
+/* Split the message in lines, a message without '\n' wraps after 16 characters */
+static size_t lcd_find_newline(const u32 *text, size_t len) {
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        if (text[i] == '\n')
+            break;
+    return i;
+}
+
+static void lcd_split_lines(struct lcd_device *lcd) {
+    const u32 *text = lcd->text;
+    size_t len = lcd->text_len;
+    size_t nl;
+
+    memset(lcd->line, 0, sizeof(lcd->line));
+    if (len && text[len - 1] == '\n')
+        len--;
+
+    nl = lcd_find_newline(text, len);
+    if (nl < len) {
+        lcd->line[0].text = text;
+        lcd->line[0].len = nl;
+        len -= nl + 1;
+        text += nl + 1;
+        lcd->line[1].text = text;
+        lcd->line[1].len = lcd_find_newline(text, len);
+    } else if (len <= LCD_COLS * LCD_ROWS) {
+        lcd->line[0].text = text;
+        lcd->line[0].len = min_t(size_t, len, LCD_COLS);
+        if (len > LCD_COLS) {
+            lcd->line[1].text = text + LCD_COLS;
+            lcd->line[1].len = len - LCD_COLS;
         }
+    } else {
+        lcd->line[0].text = text;
+        lcd->line[0].len = len;
     }
 }
 
+/* Pick how the current message scrolls */
+static bool lcd_use_hw_shift(struct lcd_device *lcd) {
+    int row;
+
+    switch (lcd->scroll_mode) {
+    case LCD_SCROLL_SHIFT:
+        /* DDRAM holds LCD_DDRAM_LINE cells a line, longer ones are redrawn */
+        for (row = 0; row < LCD_ROWS; row++) {
+            if (lcd->line[row].len > LCD_DDRAM_LINE)
+                return false;
+        }
+        return true;
+    case LCD_SCROLL_AUTO:
+        /* The shift moves both lines, so only use it when every line scrolls */
+        for (row = 0; row < LCD_ROWS; row++) {
+            if (lcd->line[row].len > LCD_DDRAM_LINE)
+                return false;
+            if (lcd->line[row].len && lcd->line[row].len <= LCD_COLS)
+                return false;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Draw the whole message, called with lcd->lock held */
+static void lcd_print(struct lcd_device *lcd) {
+    bool needs_scroll = false;
+    size_t width;
+    int row, i;
+
+    for (row = 0; row < LCD_ROWS; row++)
+        if (lcd->line[row].len > LCD_COLS)
+            needs_scroll = true;
+    if (lcd->scroll_mode == LCD_SCROLL_OFF)
+        needs_scroll = false;
+
+    lcd->hw_shift = needs_scroll && lcd_use_hw_shift(lcd);
+    lcd_send_command(lcd, LCD_CMD_CLEAR);  // Clear the screen and the display shift
+    for (i = 0; i < LCD_CGRAM_SLOTS; i++)
+        lcd->cgram[i].rows = 0;
+
+    for (row = 0; row < LCD_ROWS; row++) {
+        lcd->line[row].offset = 0;
+        if (!lcd->line[row].len)
+            continue;
+        /* With the display shift the line is written once into DDRAM */
+        width = lcd->hw_shift ? LCD_DDRAM_LINE : LCD_COLS;
+        lcd_print_line(lcd, row, 0, min(lcd->line[row].len, width));
+    }
+
+    WRITE_ONCE(lcd->scrolling, needs_scroll);
+    if (needs_scroll)
+        hrtimer_start(&lcd->scroll_timer, ms_to_ktime(lcd->step_ms), HRTIMER_MODE_REL);
+}
+
+/* Move the text by one character, called with lcd->lock held */
+static void lcd_scroll_step(struct lcd_device *lcd) {
+    struct lcd_line *line;
+    size_t period;
+    int row;
+
+    if (lcd->hw_shift) {
+        lcd_send_command(lcd, lcd->direction == LCD_SCROLL_RIGHT ?
+                         LCD_CMD_SHIFT_RIGHT : LCD_CMD_SHIFT_LEFT);
+        return;
+    }
+
+    for (row = 0; row < LCD_ROWS; row++) {
+        line = &lcd->line[row];
+        if (line->len <= LCD_COLS)
+            continue;
+        period = line->len + LCD_SCROLL_GAP;
+        if (lcd->direction == LCD_SCROLL_RIGHT)
+            line->offset = (line->offset + period - 1) % period;
+        else
+            line->offset = (line->offset + 1) % period;
+        lcd_print_line(lcd, row, line->offset, LCD_COLS);
+    }
+}
+
+static void lcd_scroll_work(struct work_struct *work) {
+    struct lcd_device *lcd = container_of(work, struct lcd_device, scroll_work);
+
+    mutex_lock(&lcd->lock);
+    if (lcd->client && lcd->scrolling)
+        lcd_scroll_step(lcd);
+    mutex_unlock(&lcd->lock);
+}
+
+static enum hrtimer_restart lcd_scroll_timer(struct hrtimer *timer) {
+    struct lcd_device *lcd = container_of(timer, struct lcd_device, scroll_timer);
+
+    if (!READ_ONCE(lcd->scrolling))
+        return HRTIMER_NORESTART;
+
+    schedule_work(&lcd->scroll_work);
+    hrtimer_forward_now(timer, ms_to_ktime(READ_ONCE(lcd->step_ms)));
+    return HRTIMER_RESTART;
+}
+
+/* Stop scrolling, must be called without lcd->lock */
+static void lcd_scroll_stop(struct lcd_device *lcd) {
+    WRITE_ONCE(lcd->scrolling, false);
+    hrtimer_cancel(&lcd->scroll_timer);
+    cancel_work_sync(&lcd->scroll_work);
+}
+
 
 
 /* Init LCD */
-static void lcd_init(void) {
-    lcd_send_command(0x33); // 4-bits mode
-    lcd_send_command(0x32); // 4-bits mode
-    lcd_send_command(0x28); // 2 line, 5x8 pixel
-    lcd_send_command(0x0C); // Do not show the pointer
-    lcd_send_command(0x01); // Clean screen
-    // lcd_send_command(0xC0); // Put the pointer at header of line 2
+static void lcd_init(struct lcd_device *lcd) {
+    lcd_send_command(lcd, 0x33); // 4-bits mode
+    lcd_send_command(lcd, 0x32); // 4-bits mode
+    lcd_send_command(lcd, 0x28); // 2 line, 5x8 pixel
+    lcd_send_command(lcd, 0x0C); // Do not show the pointer
+    lcd_send_command(lcd, LCD_CMD_CLEAR); // Clean screen
+    // lcd_send_command(lcd, 0xC0); // Put the pointer at header of line 2
     msleep(2);
 }
 
@@ -95,23 +465,81 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Phan Hao");
 MODULE_DESCRIPTION("A driver to communicate with LCD 16x2 thougth I2C protocol");
 
-/*Buffer for data*/
-static char buffer[30];
-static size_t buff_p = 0;
+/* Legacy mode: create a panel on this bus at load time (-1: disabled) */
+static int bus = -1;
+module_param(bus, int, 0444);
+MODULE_PARM_DESC(bus, "I2C bus to create a panel on at load time (-1: none)");
+
+static unsigned short addr = I2C_ADDR;
+module_param(addr, ushort, 0444);
+MODULE_PARM_DESC(addr, "I2C address of the panel created with bus=");
 
 /*Variable for driver and driver class*/
-static dev_t device_nr;		// device number (major and minor)
+static dev_t device_nr;		// first device number (major and minor)
 static struct class *my_class;
-static struct cdev my_device;
+static struct i2c_client *legacy_client;
+
+/* Minor number -> panel, protected by lcd_table_lock */
+static DEFINE_IDR(lcd_table);
+static DEFINE_MUTEX(lcd_table_lock);
 
 #define DRIVER_NAME "lcd_device"
-#define DRIVER_CLASS "myClass"
+#define DRIVER_CLASS "lcd_class"
+#define LCD_MAX_DEVICES 16
 #define DEBUG 1
 
+static void lcd_release(struct kref *ref)
+{
+    struct lcd_device *lcd = container_of(ref, struct lcd_device, ref);
+    void *bitmap;
+    unsigned long index;
+
+    xa_for_each(&lcd->glyphs, index, bitmap)
+        kfree(bitmap);
+    xa_destroy(&lcd->glyphs);
+    kfree(lcd->text);
+    kfree(lcd->msg);
+    kfree(lcd);
+}
+
+static void lcd_init_work(struct work_struct *work)
+{
+    struct lcd_device *lcd = container_of(work, struct lcd_device, init_work);
+
+    mutex_lock(&lcd->lock);
+    if (lcd->client)
+        lcd_init(lcd);
+    mutex_unlock(&lcd->lock);
+
+    complete_all(&lcd->init_done);
+}
+
+/* Wait until the panel is initialised */
+static int lcd_wait_ready(struct lcd_device *lcd, struct file *file)
+{
+    if (completion_done(&lcd->init_done))
+        return 0;
+    if (file->f_flags & O_NONBLOCK)
+        return -EAGAIN;
+    return wait_for_completion_interruptible(&lcd->init_done);
+}
+
 /**
  * @brief This function is called when the device is opened
  */
 static int driver_open(struct inode *device_file, struct file *instance){
+	struct lcd_device *lcd;
+
+	mutex_lock(&lcd_table_lock);
+	lcd = idr_find(&lcd_table, iminor(device_file));
+	if (lcd)
+		kref_get(&lcd->ref);
+	mutex_unlock(&lcd_table_lock);
+
+	if (!lcd)
+		return -ENODEV;
+
+	instance->private_data = lcd;
 	printk(KERN_INFO "lcd - The lcd device is opened\n");
 	return 0;
 }
@@ -120,6 +548,9 @@ static int driver_open(struct inode *device_file, struct file *instance){
  * @brief This function is called when the device is closed
  */
 static int driver_close(struct inode *device_file, struct file *instance){
+	struct lcd_device *lcd = instance->private_data;
+
+	kref_put(&lcd->ref, lcd_release);
 	printk(KERN_INFO "lcd - The lcd device is closed\n");
 	return 0;
 }
@@ -129,24 +560,15 @@ static int driver_close(struct inode *device_file, struct file *instance){
  * Read data to buffer
  */
 static ssize_t driver_read(struct file *File, char *usr_buffer, size_t count, loff_t *offset){
-	int amount, cp, del;
-
-	/*Get amount of data to copy*/
-	amount = min(count, buff_p);
-	if (DEBUG){
-		printk ("Amount of data to read: %d\n", amount);
-	}
-
-	/*Copy data to user*/
-	cp = copy_to_user(usr_buffer, buffer, amount);
-	if (DEBUG){
-		printk ("usr_buffer: %s\n", usr_buffer);
-	}
+	struct lcd_device *lcd = File->private_data;
+	ssize_t del;
 
-	/*Caculate data*/
-	del = amount - cp;
+	/*Copy the current message to user*/
+	mutex_lock(&lcd->lock);
+	del = simple_read_from_buffer(usr_buffer, count, offset, lcd->msg, lcd->msg_len);
+	mutex_unlock(&lcd->lock);
 	if (DEBUG){
-		printk ("delta of read: %d\n", del);
+		printk ("delta of read: %zd\n", del);
 	}
 
 	return del;
@@ -154,33 +576,192 @@ static ssize_t driver_read(struct file *File, char *usr_buffer, size_t count, lo
 
 /**
  * @brief This function is called when user want to write data
- * Write data to buffer
+ * The whole message is kept, lines that do not fit are scrolled
  */
 static ssize_t driver_write(struct file *File, const char *usr_buffer, size_t count, loff_t *offset) {
-    int amount, cp, del;
+    struct lcd_device *lcd = File->private_data;
+    char *msg, *old;
+    u32 *text, *old_text;
+    size_t amount, text_len;
+    int ret;
+
+    ret = lcd_wait_ready(lcd, File);
+    if (ret)
+        return ret;
 
     /* Get the amount of data to copy */
-    amount = min(count, sizeof(buffer));
+    amount = min_t(size_t, count, LCD_MSG_MAX);
 
-    /* Copy data from user space */
-    cp = copy_from_user(buffer, usr_buffer, amount);
-    if (cp) {
+    /* Copy data from user space before taking the panel lock */
+    msg = memdup_user_nul(usr_buffer, amount);
+    if (IS_ERR(msg)) {
         printk(KERN_ERR "Failed to copy data from user space\n");
-        return -EFAULT;
+        return PTR_ERR(msg);
     }
-    buff_p = amount - cp;
 
-    if (strlen(buffer) < 31) {  // Check if the string length is less than 31 characters
-        /* Print string on LCD */
-        lcd_print(buffer);
-        printk(KERN_INFO "lcd - LCD Display: %s\n", buffer);
-    } else {
-        printk(KERN_INFO "lcd - The size of string is out of range: %s: %d\n", buffer, strlen(buffer));
+    text = lcd_decode(msg, amount, &text_len);
+    if (!text) {
+        kfree(msg);
+        return -ENOMEM;
+    }
+
+    lcd_scroll_stop(lcd);
+
+    mutex_lock(&lcd->lock);
+    if (!lcd->client) {
+        mutex_unlock(&lcd->lock);
+        kfree(text);
+        kfree(msg);
+        return -ENODEV;
+    }
+    old = lcd->msg;
+    old_text = lcd->text;
+    lcd->msg = msg;
+    lcd->msg_len = amount;
+    lcd->text = text;
+    lcd->text_len = text_len;
+    lcd_split_lines(lcd);
+
+    /* Print string on LCD */
+    lcd_print(lcd);
+    mutex_unlock(&lcd->lock);
+    kfree(old_text);
+    kfree(old);
+
+    if (count > amount)
+        printk(KERN_INFO "lcd - The size of string is out of range: %zu, truncated to %zu\n", count, amount);
+    if (DEBUG)
+        printk(KERN_INFO "lcd - LCD Display: %zu bytes\n", amount);
+
+    return amount;
+}
+
+/**
+ * @brief Store a glyph, a glyph already in CGRAM is rewritten in place
+ *
+ * -EEXIST for characters of the ROM, the ROM one is always used.
+ */
+static int lcd_set_glyph(struct lcd_device *lcd, const lcd_glyph *glyph) {
+    u8 *bitmap, *old;
+    int i;
+
+    if (glyph->codepoint < 0x80 || glyph->codepoint > 0x10FFFF)
+        return -EINVAL;
+    /* lcd_map_char() would always pick the ROM character */
+    if (bsearch(&glyph->codepoint, lcd_rom_table, ARRAY_SIZE(lcd_rom_table),
+                sizeof(lcd_rom_table[0]), lcd_rom_cmp))
+        return -EEXIST;
+
+    bitmap = kmemdup(glyph->bitmap, sizeof(glyph->bitmap), GFP_KERNEL);
+    if (!bitmap)
+        return -ENOMEM;
+
+    mutex_lock(&lcd->lock);
+    if (!lcd->client) {
+        mutex_unlock(&lcd->lock);
+        kfree(bitmap);
+        return -ENODEV;
+    }
+    if (!xa_load(&lcd->glyphs, glyph->codepoint) && lcd->nr_glyphs >= LCD_MAX_GLYPHS) {
+        mutex_unlock(&lcd->lock);
+        kfree(bitmap);
+        return -ENOSPC;
+    }
+
+    old = xa_store(&lcd->glyphs, glyph->codepoint, bitmap, GFP_KERNEL);
+    if (xa_is_err(old)) {
+        mutex_unlock(&lcd->lock);
+        kfree(bitmap);
+        return xa_err(old);
+    }
+    if (!old)
+        lcd->nr_glyphs++;
+
+    for (i = 0; i < LCD_CGRAM_SLOTS; i++) {
+        if (lcd->cgram[i].codepoint == glyph->codepoint) {
+            lcd_upload_glyph(lcd, i, bitmap);
+            lcd_send_command(lcd, LCD_CMD_DDRAM);
+        }
+    }
+    mutex_unlock(&lcd->lock);
+
+    kfree(old);
+    return 0;
+}
+
+/**
+ * @brief Drop every glyph, characters already on screen keep their shape
+ */
+static void lcd_clear_glyphs(struct lcd_device *lcd) {
+    unsigned long index;
+    void *bitmap;
+
+    mutex_lock(&lcd->lock);
+    xa_for_each(&lcd->glyphs, index, bitmap) {
+        xa_erase(&lcd->glyphs, index);
+        kfree(bitmap);
     }
+    lcd->nr_glyphs = 0;
+    mutex_unlock(&lcd->lock);
+}
+
+/**
+ * @brief This function is called when user want to configure scrolling or glyphs
+ */
+static long driver_ioctl(struct file *File, unsigned int cmd, unsigned long arg) {
+    struct lcd_device *lcd = File->private_data;
+    lcd_scroll scroll;
+    lcd_glyph glyph;
+    int ret;
+
+    ret = lcd_wait_ready(lcd, File);
+    if (ret)
+        return ret;
+
+    switch (cmd) {
+    case LCD_IOCTL_SET_SCROLL:
+        if (copy_from_user(&scroll, (lcd_scroll __user *)arg, sizeof(scroll)))
+            return -EFAULT;
+        if (scroll.mode < LCD_SCROLL_OFF || scroll.mode > LCD_SCROLL_SOFT ||
+            scroll.step_ms < LCD_STEP_MS_MIN || scroll.step_ms > LCD_STEP_MS_MAX ||
+            (scroll.direction != LCD_SCROLL_LEFT && scroll.direction != LCD_SCROLL_RIGHT)) {
+            printk(KERN_ERR "lcd - Invalid scroll config\n");
+            return -EINVAL;
+        }
 
+        lcd_scroll_stop(lcd);
+        mutex_lock(&lcd->lock);
+        if (!lcd->client) {
+            mutex_unlock(&lcd->lock);
+            return -ENODEV;
+        }
+        lcd->scroll_mode = scroll.mode;
+        lcd->step_ms = scroll.step_ms;
+        lcd->direction = scroll.direction;
+        lcd_print(lcd);     // the mode decides how the message is laid out
+        mutex_unlock(&lcd->lock);
+        break;
+    case LCD_IOCTL_GET_SCROLL:
+        mutex_lock(&lcd->lock);
+        scroll.mode = lcd->scroll_mode;
+        scroll.step_ms = lcd->step_ms;
+        scroll.direction = lcd->direction;
+        mutex_unlock(&lcd->lock);
+        if (copy_to_user((lcd_scroll __user *)arg, &scroll, sizeof(scroll)))
+            return -EFAULT;
+        break;
+    case LCD_IOCTL_SET_GLYPH:
+        if (copy_from_user(&glyph, (lcd_glyph __user *)arg, sizeof(glyph)))
+            return -EFAULT;
+        return lcd_set_glyph(lcd, &glyph);
+    case LCD_IOCTL_CLEAR_GLYPHS:
+        lcd_clear_glyphs(lcd);
+        break;
+    default:
+        return -ENOTTY;
+    }
 
-	del = amount - cp;
-    return del;
+    return 0;
 }
 
 
@@ -189,71 +770,210 @@ static struct file_operations fops = {
 	.open = driver_open,
 	.release = driver_close,
 	.read = driver_read,
-	.write = driver_write
+	.write = driver_write,
+	.unlocked_ioctl = driver_ioctl,
+};
+
+/**
+ * @brief This function is called when a panel is bound to the driver
+ */
+static int lcd_probe(struct i2c_client *client) {
+    struct lcd_device *lcd;
+    struct device *dev;
+    int minor, ret;
+
+    if (!i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_BYTE)) {
+        dev_err(&client->dev, "Adapter does not support byte writes\n");
+        return -ENODEV;
+    }
+
+    lcd = kzalloc(sizeof(*lcd), GFP_KERNEL);
+    if (!lcd)
+        return -ENOMEM;
+
+    lcd->client = client;
+    mutex_init(&lcd->lock);
+    kref_init(&lcd->ref);
+    lcd->scroll_mode = LCD_SCROLL_AUTO;
+    lcd->step_ms = LCD_STEP_MS_DEFAULT;
+    lcd->direction = LCD_SCROLL_LEFT;
+    hrtimer_init(&lcd->scroll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    lcd->scroll_timer.function = lcd_scroll_timer;
+    INIT_WORK(&lcd->scroll_work, lcd_scroll_work);
+    xa_init(&lcd->glyphs);
+    INIT_WORK(&lcd->init_work, lcd_init_work);
+    init_completion(&lcd->init_done);
+    i2c_set_clientdata(client, lcd);
+
+    // Reserve a minor number, the panel is not visible to open() yet
+    mutex_lock(&lcd_table_lock);
+    minor = idr_alloc(&lcd_table, NULL, 0, LCD_MAX_DEVICES, GFP_KERNEL);
+    mutex_unlock(&lcd_table_lock);
+    if (minor < 0) {
+        dev_err(&client->dev, "No free minor number\n");
+        ret = minor;
+        goto freeError;
+    }
+    lcd->devt = MKDEV(MAJOR(device_nr), minor);
+
+    // Register device to kernel
+    lcd->cdev = cdev_alloc();
+    if (!lcd->cdev) {
+        ret = -ENOMEM;
+        goto minorError;
+    }
+    lcd->cdev->ops = &fops;
+    lcd->cdev->owner = THIS_MODULE;
+    ret = cdev_add(lcd->cdev, lcd->devt, 1);
+    if (ret) {
+        dev_err(&client->dev, "Register device to kernel failed!\n");
+        kobject_put(&lcd->cdev->kobj);
+        goto minorError;
+    }
+
+    // Create device file
+    dev = device_create(my_class, &client->dev, lcd->devt, lcd, DRIVER_NAME "%d", minor);
+    if (IS_ERR(dev)) {
+        dev_err(&client->dev, "Device file cannot be created!\n");
+        ret = PTR_ERR(dev);
+        goto cdevError;
+    }
+
+    mutex_lock(&lcd_table_lock);
+    idr_replace(&lcd_table, lcd, minor);
+    mutex_unlock(&lcd_table_lock);
+
+    // init LCD
+    schedule_work(&lcd->init_work);
+
+    dev_info(&client->dev, "LCD attached as /dev/%s%d\n", DRIVER_NAME, minor);
+    return 0;
+
+cdevError:
+    cdev_del(lcd->cdev);
+minorError:
+    mutex_lock(&lcd_table_lock);
+    idr_remove(&lcd_table, minor);
+    mutex_unlock(&lcd_table_lock);
+freeError:
+    kfree(lcd);
+    return ret;
+}
+
+/**
+ * @brief This function is called when a panel is unbound from the driver
+ */
+static void lcd_remove(struct i2c_client *client) {
+    struct lcd_device *lcd = i2c_get_clientdata(client);
+
+    mutex_lock(&lcd_table_lock);
+    idr_remove(&lcd_table, MINOR(lcd->devt));
+    mutex_unlock(&lcd_table_lock);
+
+    device_destroy(my_class, lcd->devt);
+    cdev_del(lcd->cdev);
+
+    // Nobody waits for an init that will not run
+    cancel_work_sync(&lcd->init_work);
+    complete_all(&lcd->init_done);
+
+    // Files that are still open see -ENODEV from now on
+    mutex_lock(&lcd->lock);
+    lcd_send_command(lcd, LCD_CMD_CLEAR);
+    lcd->client = NULL;
+    mutex_unlock(&lcd->lock);
+    lcd_scroll_stop(lcd);
+
+    kref_put(&lcd->ref, lcd_release);
+}
+
+static const struct i2c_device_id lcd_id[] = {
+    { "lcd1602", 0 },
+    { }
+};
+MODULE_DEVICE_TABLE(i2c, lcd_id);
+
+static const struct of_device_id lcd_of_match[] = {
+    { .compatible = "phanhao,lcd1602" },
+    { }
+};
+MODULE_DEVICE_TABLE(of, lcd_of_match);
+
+static struct i2c_driver lcd_driver = {
+    .driver = {
+        .name = DRIVER_NAME,
+        .of_match_table = lcd_of_match,
+        .probe_type = PROBE_PREFER_ASYNCHRONOUS,
+    },
+    .probe = lcd_probe,
+    .remove = lcd_remove,
+    .id_table = lcd_id,
 };
 
 /**
  * @brief This function is called when the driver is loaded into kernel
  */
 static int __init ModuleInit(void) {
+    struct i2c_adapter *adapter;
+    struct i2c_board_info info = {
+        I2C_BOARD_INFO("lcd1602", 0),
+    };
+    int ret;
+
     printk(KERN_INFO "Hello, this is lcd driver\n");
 
-    // Allocate a device number
-    if (alloc_chrdev_region(&device_nr, 0, 1, DRIVER_NAME) < 0) {
+    // Allocate device numbers for all panels
+    ret = alloc_chrdev_region(&device_nr, 0, LCD_MAX_DEVICES, DRIVER_NAME);
+    if (ret < 0) {
         printk(KERN_ERR "Could not allocate device number\n");
-        return -1;
+        return ret;
     }
-    printk(KERN_INFO "Device %s was registered with Major: %d, Minor: %d\n", DRIVER_NAME, MAJOR(device_nr), MINOR(device_nr));
+    printk(KERN_INFO "Device %s was registered with Major: %d\n", DRIVER_NAME, MAJOR(device_nr));
 
     // Create device class
-    if ((my_class = class_create(DRIVER_CLASS)) == NULL) {
+    my_class = class_create(DRIVER_CLASS);
+    if (IS_ERR(my_class)) {
         printk(KERN_ERR "Device class cannot be created!\n");
+        ret = PTR_ERR(my_class);
         goto classError;
     }
 
-    // Create device file
-    if (device_create(my_class, NULL, device_nr, NULL, DRIVER_NAME) == NULL) {
-        printk(KERN_ERR "Device file cannot be created!\n");
-        goto fileError;
+    ret = i2c_add_driver(&lcd_driver);
+    if (ret) {
+        printk(KERN_ERR "Register i2c driver failed!\n");
+        goto driverError;
     }
 
-    // Initialize device file
-    cdev_init(&my_device, &fops);
-
-    // Register device to kernel
-    if (cdev_add(&my_device, device_nr, 1) == -1) {
-        printk(KERN_ERR "Register device to kernel failed!\n");
-        goto addError;
-    }
-
-    // Init i2c
-    lcd_adapter = i2c_get_adapter(1); // use bus i2c number 1
-    if (IS_ERR(lcd_adapter)) {
-        printk(KERN_ERR "Failed to get I2C adapter\n");
-        goto addError;
-    }
+    // Legacy: create one panel on the requested bus
+    if (bus >= 0) {
+        adapter = i2c_get_adapter(bus);
+        if (!adapter) {
+            printk(KERN_ERR "Failed to get I2C adapter %d\n", bus);
+            ret = -ENODEV;
+            goto adapterError;
+        }
 
-    lcd_client = i2c_new_dummy_device(lcd_adapter, I2C_ADDR);
-    if (IS_ERR(lcd_client)) {
-        printk(KERN_ERR "Failed to create I2C client\n");
-        goto adapterError;
+        info.addr = addr;
+        legacy_client = i2c_new_client_device(adapter, &info);
+        i2c_put_adapter(adapter);
+        if (IS_ERR(legacy_client)) {
+            printk(KERN_ERR "Failed to create I2C client\n");
+            ret = PTR_ERR(legacy_client);
+            legacy_client = NULL;
+            goto adapterError;
+        }
     }
 
-    // init LCD
-    lcd_init();
-
     printk(KERN_INFO "Character driver with LCD support loaded successfully\n");
     return 0;
 
 adapterError:
-    i2c_put_adapter(lcd_adapter);
-addError:
-    device_destroy(my_class, device_nr);
-fileError:
+    i2c_del_driver(&lcd_driver);
+driverError:
     class_destroy(my_class);
 classError:
-    unregister_chrdev_region(device_nr, 1);
-    return -1;
+    unregister_chrdev_region(device_nr, LCD_MAX_DEVICES);
+    return ret;
 }
 
 
@@ -264,13 +984,13 @@ static void __exit ModuleExit(void) {
     printk(KERN_INFO "Goodbye kernel!\n");
 
     // Giải phóng tài nguyên I2C
-    i2c_unregister_device(lcd_client);
-    i2c_put_adapter(lcd_adapter);
+    if (legacy_client)
+        i2c_unregister_device(legacy_client);
+    i2c_del_driver(&lcd_driver);
 
-    cdev_del(&my_device);
-    device_destroy(my_class, device_nr);
     class_destroy(my_class);
-    unregister_chrdev_region(device_nr, 1);
+    unregister_chrdev_region(device_nr, LCD_MAX_DEVICES);
+    idr_destroy(&lcd_table);
 }
 
 
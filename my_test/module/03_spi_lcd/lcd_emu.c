@@ -0,0 +1,446 @@
+/**
+ * Emulator of a HD44780 LCD behind a PCF8574 I2C expander
+ *
+ * The module registers a virtual I2C bus with a PCF8574 at address 0x27.
+ * Bytes written to the expander are decoded like the real panel does: the
+ * 4-bit nibbles are latched on the falling edge of E, instructions and data
+ * update a virtual DDRAM/CGRAM, and an instruction sent while the controller
+ * is still busy is counted as a timing violation. Every transaction is
+ * counted together with the time it would take on a real bus, so tests can
+ * check both what is on screen and what it cost to put it there.
+ *
+ * With lcd=1 (default) a "lcd1602" client is created on the bus, so loading
+ * 03_spi_lcd binds a panel to it. The state is in /sys/kernel/debug/lcd_emu/:
+ *   display  the 2x16 visible characters
+ *   ddram    both DDRAM lines (40 cells each)
+ *   cgram    the 8 glyphs as hex
+ *   stats    counters, writing anything resets them
+ * Characters outside printable ASCII are shown as \xHH.
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/i2c.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Phan Hao");
+MODULE_DESCRIPTION("HD44780 + PCF8574 emulator on a virtual I2C bus");
+
+/* PCF8574 pins */
+#define PIN_RS 0x01
+#define PIN_RW 0x02
+#define PIN_E 0x04
+
+#define EMU_ROWS 2
+#define EMU_COLS 16
+#define EMU_DDRAM_LINE 40
+
+/* Execution times from the datasheet (fosc = 270 kHz) */
+#define EXEC_NS_LONG 1520000    // clear display, return home
+#define EXEC_NS 37000           // other instructions
+#define EXEC_NS_DATA 41000      // data write, 37 us + tADD
+
+static unsigned short addr = 0x27;
+module_param(addr, ushort, 0444);
+MODULE_PARM_DESC(addr, "Address of the emulated PCF8574");
+
+static unsigned int bus_khz = 100;
+module_param(bus_khz, uint, 0444);
+MODULE_PARM_DESC(bus_khz, "Emulated bus clock in kHz, used for the bus time");
+
+static bool lcd = true;
+module_param(lcd, bool, 0444);
+MODULE_PARM_DESC(lcd, "Create a lcd1602 client on the emulated bus");
+
+struct lcd_emu_stats {
+    u64 transactions;       // START ... STOP on the bus
+    u64 bytes;              // bytes written to the expander, address excluded
+    u64 bus_ns;             // time the transactions take at bus_khz
+    u64 instructions;
+    u64 data;
+    u64 violations;         // nibble latched while the controller was busy
+};
+
+struct lcd_emu {
+    struct i2c_adapter adap;
+    struct i2c_client *client;
+    struct dentry *debugfs;
+    struct mutex lock;      // protects everything below against debugfs
+
+    /* PCF8574 */
+    u8 port;
+
+    /* HD44780 */
+    bool four_bit;
+    bool low_nibble;        // next nibble is the low half of a byte
+    u8 high;
+    u8 ddram[EMU_ROWS][EMU_DDRAM_LINE];
+    u8 cgram[64];
+    u8 ac;                  // address counter
+    bool ac_cgram;          // ac points into CGRAM
+    bool increment;
+    bool entry_shift;
+    int shift;              // display shift, in cells to the left
+    bool display_on;
+
+    /* Timing, on the emulated clock */
+    u64 now_ns;
+    u64 busy_until_ns;
+    u8 last_violation;      // instruction or data byte that came too early
+
+    struct lcd_emu_stats stats;
+};
+
+static struct lcd_emu emu;
+
+static void emu_reset_controller(struct lcd_emu *e) {
+    memset(e->ddram, ' ', sizeof(e->ddram));
+    memset(e->cgram, 0, sizeof(e->cgram));
+    e->four_bit = false;
+    e->low_nibble = false;
+    e->ac = 0;
+    e->ac_cgram = false;
+    e->increment = true;
+    e->entry_shift = false;
+    e->shift = 0;
+    e->display_on = false;
+    e->busy_until_ns = 0;
+}
+
+/* Move the address counter after a data access */
+static void emu_advance(struct lcd_emu *e) {
+    int line, col;
+
+    if (e->ac_cgram) {
+        e->ac = (e->ac + (e->increment ? 1 : -1)) & 0x3F;
+        return;
+    }
+
+    line = (e->ac & 0x40) ? 1 : 0;
+    col = (e->ac & 0x3F) + (e->increment ? 1 : -1);
+    /* In 2-line mode the counter runs 0x00..0x27 then 0x40..0x67 */
+    if (col >= EMU_DDRAM_LINE) {
+        col = 0;
+        line ^= 1;
+    } else if (col < 0) {
+        col = EMU_DDRAM_LINE - 1;
+        line ^= 1;
+    }
+    e->ac = (line << 6) | col;
+
+    if (e->entry_shift)
+        e->shift = (e->shift + (e->increment ? 1 : EMU_DDRAM_LINE - 1)) % EMU_DDRAM_LINE;
+}
+
+static u64 emu_instruction(struct lcd_emu *e, u8 cmd) {
+    e->stats.instructions++;
+
+    if (cmd & 0x80) {               // set DDRAM address
+        e->ac = cmd & 0x7F;
+        e->ac_cgram = false;
+    } else if (cmd & 0x40) {        // set CGRAM address
+        e->ac = cmd & 0x3F;
+        e->ac_cgram = true;
+    } else if (cmd & 0x20) {        // function set
+        e->four_bit = !(cmd & 0x10);
+    } else if (cmd & 0x10) {        // cursor or display shift
+        if (cmd & 0x08)
+            e->shift = (e->shift + ((cmd & 0x04) ? EMU_DDRAM_LINE - 1 : 1)) % EMU_DDRAM_LINE;
+    } else if (cmd & 0x08) {        // display on/off
+        e->display_on = cmd & 0x04;
+    } else if (cmd & 0x04) {        // entry mode
+        e->increment = cmd & 0x02;
+        e->entry_shift = cmd & 0x01;
+    } else if (cmd & 0x02) {        // return home
+        e->ac = 0;
+        e->ac_cgram = false;
+        e->shift = 0;
+        return EXEC_NS_LONG;
+    } else if (cmd & 0x01) {        // clear display
+        memset(e->ddram, ' ', sizeof(e->ddram));
+        e->ac = 0;
+        e->ac_cgram = false;
+        e->increment = true;
+        e->shift = 0;
+        return EXEC_NS_LONG;
+    }
+
+    return EXEC_NS;
+}
+
+static u64 emu_data(struct lcd_emu *e, u8 data) {
+    int col = e->ac & 0x3F;
+
+    e->stats.data++;
+    if (e->ac_cgram)
+        e->cgram[e->ac & 0x3F] = data;
+    else if (col < EMU_DDRAM_LINE)
+        e->ddram[(e->ac & 0x40) ? 1 : 0][col] = data;
+    emu_advance(e);
+
+    return EXEC_NS_DATA;
+}
+
+/* Falling edge of E: the controller reads RS and D4..D7 */
+static void emu_latch(struct lcd_emu *e, u8 port) {
+    u8 nibble = port & 0xF0;
+    u8 value;
+
+    if (port & PIN_RW)
+        return;                     // reads do not change the state
+
+    if (e->now_ns < e->busy_until_ns) {
+        e->stats.violations++;
+        e->last_violation = nibble;
+        dev_warn_ratelimited(&e->adap.dev, "nibble 0x%x sent %llu ns too early\n",
+                             nibble >> 4, e->busy_until_ns - e->now_ns);
+    }
+
+    if (e->four_bit && !e->low_nibble) {
+        e->high = nibble;
+        e->low_nibble = true;
+        return;
+    }
+
+    /* In 8-bit mode D0..D3 are not wired and read as 0 */
+    value = e->four_bit ? e->high | (nibble >> 4) : nibble;
+    e->low_nibble = false;
+
+    if (port & PIN_RS)
+        e->busy_until_ns = e->now_ns + emu_data(e, value);
+    else
+        e->busy_until_ns = e->now_ns + emu_instruction(e, value);
+}
+
+/* A byte written to the PCF8574 appears on its pins */
+static void emu_port_write(struct lcd_emu *e, u8 port) {
+    if ((e->port & PIN_E) && !(port & PIN_E))
+        emu_latch(e, e->port);
+    e->port = port;
+    e->stats.bytes++;
+}
+
+/* Account a transaction of len data bytes: START, address, data, STOP */
+static void emu_transaction(struct lcd_emu *e, int len) {
+    u64 bit_ns = 1000000ULL / bus_khz;
+    u64 cost = (2 + 9 * (len + 1)) * bit_ns;
+
+    /* The emulated clock never runs behind real time */
+    e->now_ns = max_t(u64, e->now_ns, ktime_get_ns()) + cost;
+    e->stats.transactions++;
+    e->stats.bus_ns += cost;
+}
+
+static int emu_master_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num) {
+    struct lcd_emu *e = i2c_get_adapdata(adap);
+    int i, j;
+
+    mutex_lock(&e->lock);
+    for (i = 0; i < num; i++) {
+        if (msgs[i].addr != addr) {
+            mutex_unlock(&e->lock);
+            return -ENXIO;
+        }
+        emu_transaction(e, msgs[i].len);
+        for (j = 0; j < msgs[i].len; j++) {
+            if (msgs[i].flags & I2C_M_RD)
+                msgs[i].buf[j] = e->port;
+            else
+                emu_port_write(e, msgs[i].buf[j]);
+        }
+    }
+    mutex_unlock(&e->lock);
+
+    return num;
+}
+
+static int emu_smbus_xfer(struct i2c_adapter *adap, u16 client_addr, unsigned short flags,
+                          char read_write, u8 command, int size, union i2c_smbus_data *data) {
+    struct lcd_emu *e = i2c_get_adapdata(adap);
+
+    if (client_addr != addr)
+        return -ENXIO;
+
+    mutex_lock(&e->lock);
+    switch (size) {
+    case I2C_SMBUS_QUICK:
+        emu_transaction(e, 0);
+        break;
+    case I2C_SMBUS_BYTE:
+        emu_transaction(e, 1);
+        if (read_write == I2C_SMBUS_WRITE)
+            emu_port_write(e, command);
+        else
+            data->byte = e->port;
+        break;
+    default:
+        mutex_unlock(&e->lock);
+        return -EOPNOTSUPP;
+    }
+    mutex_unlock(&e->lock);
+
+    return 0;
+}
+
+static u32 emu_functionality(struct i2c_adapter *adap) {
+    return I2C_FUNC_I2C | I2C_FUNC_SMBUS_QUICK | I2C_FUNC_SMBUS_BYTE;
+}
+
+static const struct i2c_algorithm emu_algo = {
+    .master_xfer = emu_master_xfer,
+    .smbus_xfer = emu_smbus_xfer,
+    .functionality = emu_functionality,
+};
+
+//##################### DEBUGFS #####################
+static void emu_show_cells(struct seq_file *s, const u8 *cells, int n) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (cells[i] >= 0x20 && cells[i] < 0x7F && cells[i] != '\\')
+            seq_putc(s, cells[i]);
+        else
+            seq_printf(s, "\\x%02x", cells[i]);
+    }
+    seq_putc(s, '\n');
+}
+
+static int display_show(struct seq_file *s, void *unused) {
+    u8 line[EMU_COLS];
+    int row, col;
+
+    mutex_lock(&emu.lock);
+    for (row = 0; row < EMU_ROWS; row++) {
+        for (col = 0; col < EMU_COLS; col++)
+            line[col] = emu.display_on ?
+                        emu.ddram[row][(col + emu.shift) % EMU_DDRAM_LINE] : ' ';
+        emu_show_cells(s, line, EMU_COLS);
+    }
+    mutex_unlock(&emu.lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(display);
+
+static int ddram_show(struct seq_file *s, void *unused) {
+    int row;
+
+    mutex_lock(&emu.lock);
+    for (row = 0; row < EMU_ROWS; row++)
+        emu_show_cells(s, emu.ddram[row], EMU_DDRAM_LINE);
+    mutex_unlock(&emu.lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ddram);
+
+static int cgram_show(struct seq_file *s, void *unused) {
+    int slot;
+
+    mutex_lock(&emu.lock);
+    for (slot = 0; slot < 8; slot++)
+        seq_printf(s, "%d: %8ph\n", slot, &emu.cgram[slot * 8]);
+    mutex_unlock(&emu.lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(cgram);
+
+static int stats_show(struct seq_file *s, void *unused) {
+    struct lcd_emu_stats stats;
+
+    mutex_lock(&emu.lock);
+    stats = emu.stats;
+    mutex_unlock(&emu.lock);
+
+    seq_printf(s, "transactions %llu\n", stats.transactions);
+    seq_printf(s, "bytes %llu\n", stats.bytes);
+    seq_printf(s, "bus_time_ns %llu\n", stats.bus_ns);
+    seq_printf(s, "instructions %llu\n", stats.instructions);
+    seq_printf(s, "data %llu\n", stats.data);
+    seq_printf(s, "violations %llu\n", stats.violations);
+    return 0;
+}
+
+static int stats_open(struct inode *inode, struct file *file) {
+    return single_open(file, stats_show, NULL);
+}
+
+static ssize_t stats_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
+    mutex_lock(&emu.lock);
+    memset(&emu.stats, 0, sizeof(emu.stats));
+    mutex_unlock(&emu.lock);
+    return count;
+}
+
+static const struct file_operations stats_fops = {
+    .owner = THIS_MODULE,
+    .open = stats_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .write = stats_write,
+    .release = single_release,
+};
+
+//##########################################################
+
+static int __init lcd_emu_init(void) {
+    struct i2c_board_info info = {
+        I2C_BOARD_INFO("lcd1602", 0),
+    };
+    int ret;
+
+    if (!bus_khz)
+        return -EINVAL;
+
+    mutex_init(&emu.lock);
+    emu_reset_controller(&emu);
+
+    emu.adap.owner = THIS_MODULE;
+    emu.adap.algo = &emu_algo;
+    strscpy(emu.adap.name, "lcd_emu", sizeof(emu.adap.name));
+    i2c_set_adapdata(&emu.adap, &emu);
+
+    ret = i2c_add_adapter(&emu.adap);
+    if (ret) {
+        pr_err("lcd_emu: Failed to add adapter\n");
+        return ret;
+    }
+
+    emu.debugfs = debugfs_create_dir("lcd_emu", NULL);
+    debugfs_create_file("display", 0444, emu.debugfs, NULL, &display_fops);
+    debugfs_create_file("ddram", 0444, emu.debugfs, NULL, &ddram_fops);
+    debugfs_create_file("cgram", 0444, emu.debugfs, NULL, &cgram_fops);
+    debugfs_create_file("stats", 0644, emu.debugfs, NULL, &stats_fops);
+
+    if (lcd) {
+        info.addr = addr;
+        emu.client = i2c_new_client_device(&emu.adap, &info);
+        if (IS_ERR(emu.client)) {
+            pr_err("lcd_emu: Failed to create lcd client\n");
+            ret = PTR_ERR(emu.client);
+            emu.client = NULL;
+            goto clientError;
+        }
+    }
+
+    pr_info("lcd_emu: Emulated panel at 0x%02x on %s\n", addr, dev_name(&emu.adap.dev));
+    return 0;
+
+clientError:
+    debugfs_remove(emu.debugfs);
+    i2c_del_adapter(&emu.adap);
+    return ret;
+}
+
+static void __exit lcd_emu_exit(void) {
+    if (emu.client)
+        i2c_unregister_device(emu.client);
+    debugfs_remove(emu.debugfs);
+    i2c_del_adapter(&emu.adap);
+    pr_info("lcd_emu: Removed\n");
+}
+
+module_init(lcd_emu_init);
+module_exit(lcd_emu_exit);
@@ -0,0 +1,35 @@
+#ifndef __LCD_ENCODE_H__
+#define __LCD_ENCODE_H__
+
+#include <linux/types.h>
+
+/*
+ * HD44780 behind a PCF8574 expander, 4 bit mode. Every port write sets
+ *   P0 RS, P1 RW, P2 EN, P3 backlight, P4..P7 D4..D7
+ * A byte goes as two nibbles, high first. Each nibble is put on the port,
+ * then latched with an EN pulse: nibble, nibble | EN, nibble.
+ */
+
+#define LCD_RS 0x01
+#define ENABLE 0x04
+#define BACKLIGHT 0x08
+
+#define LCD_XFER_LEN 6          // port writes per byte
+
+/**
+ * @brief Port writes that send one instruction (data = false) or data byte
+ */
+static inline void lcd_encode(u8 byte, bool data, u8 out[LCD_XFER_LEN])
+{
+    u8 ctrl = BACKLIGHT | (data ? LCD_RS : 0);
+    u8 nibble[2] = { byte & 0xF0, (byte << 4) & 0xF0 };
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        out[3 * i] = nibble[i] | ctrl;
+        out[3 * i + 1] = nibble[i] | ctrl | ENABLE;
+        out[3 * i + 2] = nibble[i] | ctrl;
+    }
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __LCD_IOCTL_H__
+#define __LCD_IOCTL_H__
+
+#define LCD_MAGIC_NUM 0xF1
+
+/* Scroll modes */
+#define LCD_SCROLL_OFF      0   // static text, long lines are clipped
+#define LCD_SCROLL_AUTO     1   // display shift when possible, redraw otherwise
+#define LCD_SCROLL_SHIFT    2   // always use display shift (both lines move),
+                                // as SOFT if a line is longer than 40 characters
+#define LCD_SCROLL_SOFT     3   // redraw every long line on each step
+
+/* Scroll directions */
+#define LCD_SCROLL_LEFT     0
+#define LCD_SCROLL_RIGHT    1
+
+typedef struct lcd_scroll {
+    int mode;
+    int step_ms;        // time between two scroll steps
+    int direction;
+} lcd_scroll;
+
+/*
+ * A 5x8 glyph, one byte per pixel row, bit 4 is the leftmost pixel.
+ * Characters the HD44780 ROM already has are refused with EEXIST.
+ */
+typedef struct lcd_glyph {
+    unsigned int codepoint;     // Unicode codepoint, private use area for bar graphs
+    unsigned char bitmap[8];
+} lcd_glyph;
+
+#define LCD_IOCTL_SET_SCROLL    _IOW(LCD_MAGIC_NUM, 0, lcd_scroll)
+#define LCD_IOCTL_GET_SCROLL    _IOR(LCD_MAGIC_NUM, 1, lcd_scroll)
+#define LCD_IOCTL_SET_GLYPH     _IOW(LCD_MAGIC_NUM, 2, lcd_glyph)
+#define LCD_IOCTL_CLEAR_GLYPHS  _IO(LCD_MAGIC_NUM, 3)
+
+#endif
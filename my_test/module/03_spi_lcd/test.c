@@ -2,34 +2,49 @@
 #include <stdint.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <string.h> 
+#include <string.h>
+#include <sys/ioctl.h>
+#include "lcd_ioctl.h"
 
 int main(){
-    char buff[5];
+    char *msg = "Hello Phan Hao\nThis line is longer than the panel and scrolls";
+    char *bars = "25\xc2\xb0""C \xee\x80\x80\xee\x80\x81\xee\x80\x82\xee\x80\x83\xee\x80\x84";
+    lcd_scroll scroll;
+    lcd_glyph glyph;
 
     /* Open the device */
-    int dev = open("/dev/gpio_Led", O_RDWR);
+    int dev = open("/dev/lcd_device0", O_RDWR);
     if(dev == -1){
         printf("Open device failed!\n");
         return -1;
     }
     printf("Open the device success\n");
 
-    while(1){
-        /* Write data to device */
-        write(dev, "1", 1); 
-        read(dev, buff, sizeof(buff));
-        printf("Read data '%s' from device\n", buff); 
-        sleep(2);
-        write(dev, "0", 1); 
-        read(dev, buff, sizeof(buff));
-        printf("Read data '%s' from device\n", buff); 
-        sleep(2);
+    /* Scroll by redrawing only the long line */
+    scroll.mode = LCD_SCROLL_AUTO;
+    scroll.step_ms = 250;
+    scroll.direction = LCD_SCROLL_LEFT;
+    if(ioctl(dev, LCD_IOCTL_SET_SCROLL, &scroll) == -1){
+        printf("Set scroll failed!\n");
     }
 
+    write(dev, msg, strlen(msg));
+    printf("Write data '%s' to device\n", msg);
+    sleep(10);
 
-    /* Read data from device */
+    /* Both lines move with the display shift, one command per step */
+    scroll.mode = LCD_SCROLL_SHIFT;
+    ioctl(dev, LCD_IOCTL_SET_SCROLL, &scroll);
+    sleep(10);
 
+    /* Bar graph: U+E000..U+E004 are bars of 1 to 5 columns, the degree sign is in ROM */
+    for(int i = 0; i < 5; i++){
+        glyph.codepoint = 0xE000 + i;
+        memset(glyph.bitmap, (0x1F << (4 - i)) & 0x1F, sizeof(glyph.bitmap));
+        ioctl(dev, LCD_IOCTL_SET_GLYPH, &glyph);
+    }
+    write(dev, bars, strlen(bars));
+    printf("Write bar graph to device\n");
 
     /* Close the device */
     close(dev);
@@ -0,0 +1,137 @@
+/**
+ * Regression test for 03_spi_lcd against the lcd_emu emulator
+ *
+ *   insmod lcd_emu.ko && insmod 03_spi_lcd.ko
+ *   ./test_emu [/dev/lcd_deviceN]
+ *
+ * Checks what ends up on the emulated screen and how many bus transactions
+ * it took. Needs debugfs mounted on /sys/kernel/debug.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "lcd_ioctl.h"
+
+#define EMU_DIR "/sys/kernel/debug/lcd_emu/"
+
+typedef struct emu_stats {
+    unsigned long long transactions;
+    unsigned long long bytes;
+    unsigned long long bus_time_ns;
+    unsigned long long instructions;
+    unsigned long long data;
+    unsigned long long violations;
+} emu_stats;
+
+static int failed = 0;
+
+static void check(int ok, const char *what){
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if(!ok)
+        failed = 1;
+}
+
+static int read_file(const char *name, char *buf, size_t size){
+    int fd = open(name, O_RDONLY);
+    int n;
+
+    if(fd == -1){
+        perror(name);
+        exit(2);
+    }
+    n = read(fd, buf, size - 1);
+    close(fd);
+    buf[n > 0 ? n : 0] = '\0';
+    return n;
+}
+
+static void reset_stats(void){
+    int fd = open(EMU_DIR "stats", O_WRONLY);
+
+    if(fd == -1 || write(fd, "0", 1) != 1){
+        perror("reset stats");
+        exit(2);
+    }
+    close(fd);
+}
+
+static void get_stats(emu_stats *st){
+    char buf[512];
+
+    read_file(EMU_DIR "stats", buf, sizeof(buf));
+    sscanf(buf, "transactions %llu\nbytes %llu\nbus_time_ns %llu\ninstructions %llu\ndata %llu\nviolations %llu",
+           &st->transactions, &st->bytes, &st->bus_time_ns, &st->instructions, &st->data, &st->violations);
+}
+
+static void print_stats(const char *what, emu_stats *st){
+    printf("  %s: %llu transactions, %llu bytes, %llu us on the bus, %llu instructions, %llu data, %llu violations\n",
+           what, st->transactions, st->bytes, st->bus_time_ns / 1000, st->instructions, st->data, st->violations);
+}
+
+static void set_scroll(int dev, int mode, int step_ms){
+    lcd_scroll scroll = { .mode = mode, .step_ms = step_ms, .direction = LCD_SCROLL_LEFT };
+
+    if(ioctl(dev, LCD_IOCTL_SET_SCROLL, &scroll) == -1){
+        perror("LCD_IOCTL_SET_SCROLL");
+        exit(2);
+    }
+}
+
+int main(int argc, char *argv[]){
+    const char *path = argc > 1 ? argv[1] : "/dev/lcd_device0";
+    char display[256];
+    emu_stats st;
+    lcd_glyph glyph;
+
+    int dev = open(path, O_RDWR);
+    if(dev == -1){
+        printf("Open device failed!\n");
+        return 2;
+    }
+
+    /* 1. Static text */
+    set_scroll(dev, LCD_SCROLL_OFF, 100);
+    reset_stats();
+    write(dev, "Hello\nWorld", 11);
+    read_file(EMU_DIR "display", display, sizeof(display));
+    get_stats(&st);
+    print_stats("static text", &st);
+    check(strcmp(display, "Hello           \nWorld           \n") == 0, "two lines on screen");
+    check(st.violations == 0, "no timing violation");
+    check(st.data == 10, "one data write per character");
+
+    /* 2. ROM characters need no CGRAM upload */
+    write(dev, "25\xc2\xb0""C", 5);
+    read_file(EMU_DIR "display", display, sizeof(display));
+    check(strncmp(display, "25\\xdfC ", 8) == 0, "degree sign from ROM");
+
+    /* 3. A glyph is uploaded once, then served from CGRAM */
+    glyph.codepoint = 0xE000;
+    memset(glyph.bitmap, 0x1F, sizeof(glyph.bitmap));
+    ioctl(dev, LCD_IOCTL_SET_GLYPH, &glyph);
+    write(dev, "\xee\x80\x80", 3);
+    reset_stats();
+    write(dev, "\xee\x80\x80\xee\x80\x80", 6);
+    get_stats(&st);
+    print_stats("cached glyph", &st);
+    check(st.data == 2, "cached glyph is not uploaded again");
+
+    /* 4. Display shift costs one instruction per step */
+    set_scroll(dev, LCD_SCROLL_AUTO, 20);
+    write(dev, "This line is long enough\nAnd so is this one here", 48);
+    reset_stats();
+    usleep(500000);
+    get_stats(&st);
+    print_stats("display shift", &st);
+    check(st.instructions > 0 && st.data == 0, "scrolling sends commands only");
+    check(st.violations == 0, "no timing violation while scrolling");
+
+    set_scroll(dev, LCD_SCROLL_OFF, 100);
+    close(dev);
+
+    printf("%s\n", failed ? "FAILED" : "ALL PASSED");
+    return failed;
+}
@@ -7,7 +7,10 @@
 #include <linux/device.h>
 #include <linux/delay.h>
 #include <linux/ioctl.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
 #include "ioctl.h"
+#include "selftest.h"
 
 #define GPIO_LED 539    //GPIO27
 
@@ -29,6 +32,17 @@ static led_device led = {
     .class_name  = "led_class"
 };
 
+/* LED self-test runs after the module is loaded, ioctl waits until it is done */
+static void selftest_done_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(selftest_work, selftest_done_fn);
+static DECLARE_COMPLETION(init_done);
+
+static void selftest_done_fn(struct work_struct *work) {
+    gpio_set_value(GPIO_LED, 0);
+    complete_all(&init_done);
+    printk(KERN_INFO "LED self-test done\n");
+}
+
 /* Dummy file operations */
 static int dev_open(struct inode *inode, struct file *file) {
     printk(KERN_INFO "Device opened\n");
@@ -42,6 +56,15 @@ static int dev_release(struct inode *inode, struct file *file) {
 
 static long led_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
     blink blink_time;
+    int ret;
+
+    // Not ours (TCGETS from isatty()...), no need to wait for the self-test
+    if (_IOC_TYPE(cmd) != MAGIC_NUM)
+        return -ENOTTY;
+    ret = selftest_wait_done(&init_done, file);
+    if (ret)
+        return ret;
+
     switch (cmd)
     {
     case IOCTL_LED_ON:
@@ -61,14 +84,14 @@ static long led_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
         printk(KERN_INFO "Led toggle\n");
         break;
     case IOCTL_LED_BLINK:
-        if (blink_time.time < 0 || blink_time.on_time_ms < 0 || blink_time.off_time_ms < 0 || blink_time.time > 100) {
-            printk(KERN_ERR "Invalid blink config values\n");
-            return -EINVAL;
-        }
         if(copy_from_user(&blink_time, (blink __user*)arg, sizeof(blink))){
             printk(KERN_ERR "Fail to copy blink times from user\n");
             return -EFAULT;
         }
+        if (!led_blink_valid(&blink_time)) {
+            printk(KERN_ERR "Invalid blink config values\n");
+            return -EINVAL;
+        }
         printk(KERN_INFO "Led blink %d time\n", blink_time.time);
         for(int i = 0; i < blink_time.time; i++){
             gpio_set_value(GPIO_LED, 1);
@@ -79,7 +102,7 @@ static long led_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
         break;
     default:
         printk(KERN_ERR "Invalid value\n");
-        break;
+        return -ENOTTY;
     }
 
     return 0;
@@ -132,12 +155,12 @@ static int __init led_driver_init(void) {
     if(gpio_direction_output(GPIO_LED, 0)){
         printk(KERN_ERR "ERROR: Fail to set GPIO %d as output\n", GPIO_LED);
         goto dir_error;
-    }else{
-        gpio_set_value(GPIO_LED, 1);
-        msleep(1000);
-        gpio_set_value(GPIO_LED, 0);
     }
 
+    // Self-test: the LED is on for one second without blocking insmod
+    gpio_set_value(GPIO_LED, 1);
+    schedule_delayed_work(&selftest_work, HZ);
+
     return 0;
 
 dir_error:
@@ -154,6 +177,9 @@ class_error:
 }
 
 static void __exit led_driver_exit(void) {
+    cancel_delayed_work_sync(&selftest_work);
+    gpio_set_value(GPIO_LED, 0);
+    gpio_free(GPIO_LED);
     device_destroy(led.device_class, led.device_number);
     class_destroy(led.device_class);
     cdev_del(&led.device_cdev);
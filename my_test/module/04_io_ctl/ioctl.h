@@ -13,5 +13,15 @@ typedef struct  blink{
 } blink;
 
 #define IOCTL_LED_BLINK    _IOW(MAGIC_NUM, 3, blink)
+#define BLINK_MAX_TIMES    100
+
+#ifdef __KERNEL__
+/* Blink config from user space, true when it can be played */
+static inline bool led_blink_valid(const blink *b)
+{
+    return b->time >= 0 && b->time <= BLINK_MAX_TIMES &&
+           b->on_time_ms >= 0 && b->off_time_ms >= 0;
+}
+#endif
 
 #endif
\ No newline at end of file
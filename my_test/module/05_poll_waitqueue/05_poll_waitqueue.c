@@ -7,7 +7,13 @@
 #include<linux/device.h>
 #include<linux/delay.h>
 #include<linux/interrupt.h>
+#include<linux/workqueue.h>
+#include<linux/completion.h>
+#include "led_bitmap.h"
+#include "selftest.h"
 #include<linux/poll.h>
+#include "drv_events.h"
+#include<linux/leds.h>
 
 typedef struct mydevice {
     char *device_name;
@@ -15,18 +21,51 @@ typedef struct mydevice {
     dev_t dev_nr;
     struct class *dev_class;
     struct cdev cdev;
-    int led_gpio;
     int button_gpio;
     int irq_nr;
 } mydevice;
 
+/* LED lines, set together with one write */
+static int led_gpios[LED_BITMAP_MAX] = { 539 };  // GPIO27
+static int nr_leds = 1;
+module_param_array(led_gpios, int, &nr_leds, 0444);
+MODULE_PARM_DESC(led_gpios, "GPIO numbers of the LEDs");
+static struct gpio_desc *led_descs[LED_BITMAP_MAX];
+
+static void leds_set(const unsigned long *bits){
+    gpiod_set_array_value(nr_leds, led_descs, NULL, (unsigned long *)bits);
+}
+
+static void leds_set_all(int value){
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+
+    if (value)
+        bitmap_fill(bits, nr_leds);
+    else
+        bitmap_zero(bits, nr_leds);
+    leds_set(bits);
+}
+
+/* LEDs bound to this trigger follow the button: echo button-edge > .../trigger */
+DEFINE_LED_TRIGGER(button_trigger);
+
 static mydevice mydev = {
     .device_name = "led_poll",
     .class_name = "led_class",
-    .led_gpio = 539,     // GPIO27
     .button_gpio = 529 // GPIO17
 };
 
+/* LED self-test runs after the module is loaded, I/O waits until it is done */
+static void selftest_done_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(selftest_work, selftest_done_fn);
+static DECLARE_COMPLETION(init_done);
+
+static void selftest_done_fn(struct work_struct *work){
+    leds_set_all(0);
+    complete_all(&init_done);
+    printk("INFO: LED self-test done\n");
+}
+
 static int dev_open(struct inode *inode, struct file *file){
     printk("INFO: Device opened\n");
     return 0;
@@ -38,70 +77,86 @@ static int dev_release(struct inode *inode, struct file *file){
 }
 
 static DECLARE_WAIT_QUEUE_HEAD(wq);     // waitqueue
-static int event_flag = 0;
+static atomic_t event_flag = ATOMIC_INIT(0);   // set by the IRQ, consumed by one read
 
 __poll_t led_poll(struct file *filp, poll_table *wait) {
     poll_wait(filp, &wq, wait);
-    return event_flag ? POLLIN | POLLRDNORM : 0;
+    return atomic_read(&event_flag) ? POLLIN | POLLRDNORM : 0;
 }
 
+/* A bit string or a bitmap, LED 0 first, see led_bitmap.h */
 static ssize_t dev_write(struct file *file, const char __user *buf, size_t count, loff_t *offset){
-    char value;
-    if (copy_from_user(&value, buf, 1)){
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+    char tmp[LED_BITMAP_MAX + 1];
+    int ret = selftest_wait_done(&init_done, file);
+    if (ret)
+        return ret;
+
+    if (count > sizeof(tmp)){
+        printk("ERROR: Invalid value\n");
+        return -EINVAL;
+    }
+
+    if (copy_from_user(tmp, buf, count)){
         printk("ERROR: Fail to copy data from user\n");
         return -1;
     }
 
-    switch(value){
-        case '0':
-            gpio_set_value(mydev.led_gpio, 0);
-            printk("LED OFF\n");
-            break;
-
-        case '1':
-            gpio_set_value(mydev.led_gpio, 1);
-            printk("LED ON");
-            break;
-
-        default:
-            printk("ERROR: Invalid value: %c\n", value);
-            break;
+    if (led_bitmap_parse(tmp, count, bits, nr_leds)){
+        printk("ERROR: Invalid value: %.*s\n", (int)count, tmp);
+        return -EINVAL;
     }
 
+    // Every LED changes at once
+    leds_set(bits);
+    drv_event_post(DRV_EVENTS_GRP_LED, mydev.device_name, bits[0]);
+    printk("LED %*pb\n", nr_leds, bits);
+
     return count;
 }
 
 static ssize_t dev_read(struct file *file, char __user *buf, size_t count, loff_t *offset){
-    char tmp[2];
-    int value = gpio_get_value(mydev.led_gpio);
-    tmp[0] = value ? '1' : '0';
-    tmp[1] = '\n';
-    if (copy_to_user(buf, tmp, 2)){
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+    char tmp[LED_BITMAP_MAX + 1];
+    size_t len;
+    int ret = selftest_wait_done(&init_done, file);
+    if (ret)
+        return ret;
+
+    if (count < nr_leds + 1)
+        return -EINVAL;
+    // No pending event, nothing is copied; a short buffer above keeps the event
+    if (!atomic_xchg(&event_flag, 0))
+        return -EAGAIN;
+
+    gpiod_get_array_value(nr_leds, led_descs, NULL, bits);
+    len = led_bitmap_format(tmp, bits, nr_leds);
+    if (copy_to_user(buf, tmp, len)){
         printk("ERROR: Faile to copy data to user\n");
         return -1;
     }
-
-    if (!event_flag) {
-        return -EAGAIN;               // Không có sự kiện → từ chối đọc
-    }
-    event_flag = 0;                   // Reset flag sau khi đọc xong
-    return 2;
+    return len;
 }
 
 static irqreturn_t irq_callback(int irq, void *dev_id) {
+    int level = gpio_get_value(mydev.button_gpio);
+
     printk("*********************\n");
     printk("\t%s\t\t\n", __func__);
     printk("*********************\n");
 
-    if(gpio_get_value(mydev.button_gpio) == 0){
-        gpio_set_value(mydev.led_gpio, 0);
-        printk("Button pressed! LED OFF\n");
-    }else{
-        gpio_set_value(mydev.led_gpio, 1);
-        printk("Button pressed! LED ON\n");
-    }
+    drv_event_post(DRV_EVENTS_GRP_BUTTON, mydev.device_name, level);
+    led_trigger_event(button_trigger, level ? LED_FULL : LED_OFF);
+
+    /* The LED belongs to the self-test until it is done */
+    if (!completion_done(&init_done))
+        return IRQ_HANDLED;
+
+    leds_set_all(level);
+    printk("Button pressed! LED %s\n", level ? "ON" : "OFF");
+    drv_event_post(DRV_EVENTS_GRP_LED, mydev.device_name, level ? (u32)GENMASK(nr_leds - 1, 0) : 0);
 
-    event_flag = 1;
+    atomic_set(&event_flag, 1);
     wake_up_interruptible(&wq);     // wake up
 
     return IRQ_HANDLED;
@@ -161,38 +216,34 @@ static int __init my_device_init(void){
         mydev.irq_nr = gpio_to_irq(mydev.button_gpio);
         if (mydev.irq_nr < 0){
             printk("ERROR: Fai to get IRQ for GPIO %d\n", mydev.button_gpio);
-            return -1;
+            goto btn_dir_err;
         }
 
+        // The IRQ uses the trigger, it has to exist first
+        led_trigger_register_simple("button-edge", &button_trigger);
+
         // Register irq handler
         if (request_irq(mydev.irq_nr, irq_callback, IRQF_TRIGGER_FALLING | IRQF_TRIGGER_RISING, "btn_irq", NULL)){
             printk("ERROR: Fail to register irq handler\n");
-            goto irq_err;
+            goto trigger_err;
         }
     }
 
     /* LED */
-    if (gpio_request(mydev.led_gpio, "led_gpio")){
-        printk("ERROR: Fail to request gpio %d\n", mydev.led_gpio);
-        goto gpio_err;
-    }
-
-    if (gpio_direction_output(mydev.led_gpio, 0)){
-        printk("ERROR: Fail to set gpio %d as output\n", mydev.led_gpio);
-        goto led_dir_err;
-    } else{
-        gpio_set_value(mydev.led_gpio, 1);
-        mdelay(1000);
-        gpio_set_value(mydev.led_gpio, 0);
+    if (led_gpios_request(led_gpios, nr_leds, led_descs, "led_gpio")){
+        goto irq_err;
     }
 
+    // Self-test: the LEDs are on for one second without blocking insmod
+    leds_set_all(1);
+    schedule_delayed_work(&selftest_work, HZ);
 
     return 0;
 
-led_dir_err:
-    gpio_free(mydev.led_gpio);
 irq_err:
     free_irq(mydev.irq_nr, NULL);
+trigger_err:
+    led_trigger_unregister_simple(button_trigger);
 btn_dir_err:
     gpio_free(mydev.button_gpio);
 gpio_err:
@@ -207,9 +258,13 @@ class_err:
 }
 
 static void __exit my_device_exit(void){
-    gpio_free(mydev.led_gpio);
-    gpio_free(mydev.button_gpio);
+    // Reverse order of init: the IRQ uses the trigger and the LEDs
     free_irq(mydev.irq_nr, NULL);
+    led_trigger_unregister_simple(button_trigger);
+    cancel_delayed_work_sync(&selftest_work);
+    leds_set_all(0);                    // the self-test may not have ended
+    led_gpios_free(led_gpios, nr_leds);
+    gpio_free(mydev.button_gpio);
     cdev_del(&mydev.cdev);
     device_destroy(mydev.dev_class, mydev.dev_nr);
     class_destroy(mydev.dev_class);
@@ -1,14 +1,14 @@
 #include<linux/module.h>
 #include<linux/init.h>
 #include<linux/kernel.h>
-#include<linux/kthread.h>
-#include<linux/delay.h>
 #include<linux/fs.h>
 #include<linux/uaccess.h>
 #include<linux/gpio.h>
 #include<linux/cdev.h>
 #include<linux/device.h>
 #include<linux/poll.h>
+#include "drv_events.h"
+#include "gpio_poller.h"
 
 typedef struct mydevice {
     char *device_name;
@@ -26,9 +26,39 @@ static mydevice mydev = {
 };
 
 /* Variable */
-static struct task_struct *my_thread;   //thread
+static struct gpio_poll_line *btn_line;    //button line in the shared poller
 static DECLARE_WAIT_QUEUE_HEAD(wq);     //waitqueue
 static int btn_flag = 0;
+static int btn_level;                   //last sampled level, only the poller touches it
+
+/*
+ * The button is sampled by the shared poller of gpio_poller.ko instead of a
+ * thread of its own, every period_us. Thread priority, CPU and the wakeup
+ * histogram belong to the poller, see gpio_poller.c.
+ */
+static unsigned int period_us = 1000000;
+
+static int period_set(const char *val, const struct kernel_param *kp){
+    unsigned int us;
+    int ret;
+
+    ret = kstrtouint(val, 0, &us);
+    if (ret)
+        return ret;
+    if (us < 10)
+        return -EINVAL;
+    WRITE_ONCE(period_us, us);
+    if (btn_line)
+        gpio_poller_set_interval(btn_line, us);
+    return 0;
+}
+
+static const struct kernel_param_ops period_ops = {
+    .set = period_set,
+    .get = param_get_uint,
+};
+module_param_cb(period_us, &period_ops, &period_us, 0644);
+MODULE_PARM_DESC(period_us, "Sampling period in microseconds, at least 10");
 
 __poll_t btn_poll(struct file *filp, poll_table *wait){
     poll_wait(filp, &wq, wait);
@@ -40,18 +70,19 @@ __poll_t btn_poll(struct file *filp, poll_table *wait){
     return  0;
 }
 
-int thread_fn(void *data){
-    printk(KERN_INFO "%s is running ....\n", __func__);
-    while (!kthread_should_stop()){
-        if(gpio_get_value(mydev.button_gpio)){
-            btn_flag = 1;
-            wake_up_interruptible(&wq);     // wake up
-        }
-        ssleep(1);
+/**
+ * @brief Called by the poller with the button level, every period_us
+ */
+static void btn_sample(void *data, int value){
+    // One event per edge, not one per sample while the button is held
+    if(value != btn_level){
+        btn_level = value;
+        drv_event_post(DRV_EVENTS_GRP_BUTTON, mydev.device_name, value);
+    }
+    if(value){
+        btn_flag = 1;
+        wake_up_interruptible(&wq);     // wake up
     }
-
-    printk(KERN_INFO "%s is stoping ....\n", __func__);
-    return 0;
 }
 
 static int dev_open(struct inode *inode, struct file *file){
@@ -111,14 +142,13 @@ static int __init thread_device_init(void){
         goto btn_dir_err;
     }
 
-    /* Create thread */
-    my_thread = kthread_create(thread_fn, NULL, "my_thread");
-    if(IS_ERR(my_thread)){
-        printk(KERN_ERR "Fail to create thread %s\n", "my_thread");
-        return PTR_ERR(my_thread);
+    /* Poll the button from the shared poller */
+    btn_line = gpio_poller_add(gpio_to_desc(mydev.button_gpio), period_us, btn_sample, NULL);
+    if(IS_ERR(btn_line)){
+        printk(KERN_ERR "Fail to add gpio %d to the poller\n", mydev.button_gpio);
+        btn_line = NULL;
+        goto btn_dir_err;
     }
-
-    wake_up_process(my_thread);
     return 0;
 
 btn_dir_err:
@@ -135,9 +165,8 @@ class_err:
 }
 
 static void __exit thread_device_exit(void){
-    if(my_thread){
-        kthread_stop(my_thread);
-    }
+    gpio_poller_remove(btn_line);
+    btn_line = NULL;
     gpio_free(mydev.button_gpio);
     cdev_del(&mydev.cdev);
     device_destroy(mydev.dev_class, mydev.dev_nr);
@@ -148,7 +177,7 @@ static void __exit thread_device_exit(void){
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Hao Phan");
-MODULE_DESCRIPTION("A sample driver using thread function + poll + waitqueue");
+MODULE_DESCRIPTION("A sample driver using a shared GPIO poller + poll + waitqueue");
 
 module_init(thread_device_init);
 module_exit(thread_device_exit);
\ No newline at end of file
@@ -0,0 +1,399 @@
+#include<linux/module.h>
+#include<linux/init.h>
+#include<linux/kernel.h>
+#include<linux/kthread.h>
+#include<linux/hrtimer.h>
+#include<linux/timerqueue.h>
+#include<linux/spinlock.h>
+#include<linux/mutex.h>
+#include<linux/slab.h>
+#include<linux/hash.h>
+#include<linux/sched.h>
+#include<linux/cpumask.h>
+#include<linux/debugfs.h>
+#include<linux/seq_file.h>
+#include<linux/gpio/consumer.h>
+#include<linux/gpio/driver.h>
+#include "gpio_poller.h"
+#include "rt_hist.h"
+
+/*
+ * A small pool of kthread_workers polls any number of GPIO lines. Lines of
+ * the same controller always go to the same worker, so the lines that are
+ * due together are read with one gpiod_get_array_value_cansleep().
+ *
+ * Every worker keeps its lines in a timer queue (rbtree ordered by next
+ * poll time) and sleeps on a single hrtimer set to the earliest one. Lines
+ * due within slack_us of each other are polled in the same pass. Polls are
+ * on absolute times, a late pass does not shift the next ones. With N
+ * lines there are still nr_workers threads and at most one wakeup per
+ * worker per distinct poll time.
+ *
+ * How late every pass started goes into a histogram, one column per
+ * worker (see rt_hist.h):
+ *
+ *   cat /sys/kernel/debug/gpio_poller/histogram
+ *   echo 0 > /sys/kernel/debug/gpio_poller/histogram   (reset)
+ *
+ * rt_prio and cpu can be changed at run time through
+ * /sys/module/gpio_poller/parameters/.
+ */
+
+#define POLL_BATCH 32                   // lines read in one go
+
+struct gpio_poll_worker {
+    struct kthread_worker *kw;
+    struct kthread_work work;
+    struct hrtimer timer;
+    spinlock_t lock;                    // queue and the removed flags
+    struct timerqueue_head queue;
+    unsigned int nr_lines;
+
+    /* Written by the worker only */
+    u64 reads;
+    struct rt_hist hist;                // one sample per pass
+};
+
+struct gpio_poll_line {
+    struct timerqueue_node node;        // expires = next poll
+    struct gpio_poll_worker *w;
+    struct gpio_desc *desc;
+    u64 interval_ns;
+    gpio_poll_fn fn;
+    void *data;
+    bool queued;
+    bool removed;
+};
+
+static unsigned int nr_workers = 2;
+module_param(nr_workers, uint, 0444);
+MODULE_PARM_DESC(nr_workers, "Number of poller threads");
+
+static unsigned int slack_us = 50;
+module_param(slack_us, uint, 0644);
+MODULE_PARM_DESC(slack_us, "Lines due this close together are polled in one pass");
+
+static int rt_prio;
+static int cpu = -1;
+static DEFINE_MUTEX(workers_lock);      // applying rt_prio and cpu
+
+static struct gpio_poll_worker *workers;
+static unsigned int workers_started;
+static struct dentry *debug_dir;
+
+/**
+ * @brief Apply rt_prio and cpu to every worker, called with workers_lock held
+ */
+static int workers_apply_sched(void){
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < workers_started; i++) {
+        ret = rt_sched_set_prio(workers[i].kw->task, rt_prio);
+        if (!ret)
+            ret = rt_sched_set_cpu(workers[i].kw->task, cpu);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+static int rt_prio_set(const char *val, const struct kernel_param *kp){
+    int prio, ret;
+
+    ret = rt_prio_parse(val, &prio);
+    if (ret)
+        return ret;
+
+    mutex_lock(&workers_lock);
+    rt_prio = prio;
+    ret = workers_apply_sched();
+    mutex_unlock(&workers_lock);
+    return ret;
+}
+
+static const struct kernel_param_ops rt_prio_ops = {
+    .set = rt_prio_set,
+    .get = param_get_int,
+};
+module_param_cb(rt_prio, &rt_prio_ops, &rt_prio, 0644);
+MODULE_PARM_DESC(rt_prio, "SCHED_FIFO priority 1-99 of the pollers, 0 = SCHED_OTHER");
+
+static int cpu_set(const char *val, const struct kernel_param *kp){
+    int new, ret;
+
+    ret = rt_cpu_parse(val, &new);
+    if (ret)
+        return ret;
+
+    mutex_lock(&workers_lock);
+    cpu = new;
+    ret = workers_apply_sched();
+    mutex_unlock(&workers_lock);
+    return ret;
+}
+
+static const struct kernel_param_ops cpu_ops = {
+    .set = cpu_set,
+    .get = param_get_int,
+};
+module_param_cb(cpu, &cpu_ops, &cpu, 0644);
+MODULE_PARM_DESC(cpu, "CPU of the pollers, -1 = any");
+
+/**
+ * @brief Set the timer to the earliest line, called with w->lock held
+ */
+static void poll_rearm(struct gpio_poll_worker *w){
+    struct timerqueue_node *first = timerqueue_getnext(&w->queue);
+
+    if (first)
+        hrtimer_start_range_ns(&w->timer, first->expires, (u64)READ_ONCE(slack_us) * NSEC_PER_USEC,
+                               HRTIMER_MODE_ABS);
+}
+
+static enum hrtimer_restart poll_timer_fn(struct hrtimer *timer){
+    struct gpio_poll_worker *w = container_of(timer, struct gpio_poll_worker, timer);
+
+    kthread_queue_work(w->kw, &w->work);
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * @brief One pass - Read every line that is due, call back, requeue
+ */
+static void poll_work_fn(struct kthread_work *work){
+    struct gpio_poll_worker *w = container_of(work, struct gpio_poll_worker, work);
+    struct gpio_poll_line *batch[POLL_BATCH];
+    struct gpio_desc *descs[POLL_BATCH];
+    DECLARE_BITMAP(values, POLL_BATCH);
+    struct timerqueue_node *next;
+    struct gpio_poll_line *line;
+    ktime_t now, due, expires;
+    unsigned int n, i;
+    bool first = true;
+
+    do {
+        now = ktime_get();
+        due = ktime_add_us(now, READ_ONCE(slack_us));
+        n = 0;
+
+        spin_lock_irq(&w->lock);
+        while (n < POLL_BATCH && (next = timerqueue_getnext(&w->queue)) && !ktime_after(next->expires, due)) {
+            if (first) {
+                if (rt_hist_add(&w->hist, ktime_to_ns(ktime_sub(now, next->expires))))
+                    w->reads = 0;
+                first = false;
+            }
+            timerqueue_del(&w->queue, next);
+            line = container_of(next, struct gpio_poll_line, node);
+            line->queued = false;
+            batch[n] = line;
+            descs[n] = line->desc;
+            n++;
+        }
+        spin_unlock_irq(&w->lock);
+
+        // One read for all of them, the GPIO core groups them per controller
+        if (n && !gpiod_get_array_value_cansleep(n, descs, NULL, values)) {
+            w->reads++;
+            for (i = 0; i < n; i++)
+                batch[i]->fn(batch[i]->data, test_bit(i, values));
+        }
+
+        spin_lock_irq(&w->lock);
+        for (i = 0; i < n; i++) {
+            line = batch[i];
+            if (line->removed)
+                continue;
+            expires = ktime_add_ns(line->node.expires, line->interval_ns);
+            if (ktime_before(expires, now)) {
+                // A whole interval lost, start again from now
+                expires = ktime_add_ns(now, line->interval_ns);
+                rt_hist_overrun(&w->hist);
+            }
+            line->node.expires = expires;
+            timerqueue_add(&w->queue, &line->node);
+            line->queued = true;
+        }
+        spin_unlock_irq(&w->lock);
+    } while (n == POLL_BATCH);
+
+    spin_lock_irq(&w->lock);
+    poll_rearm(w);
+    spin_unlock_irq(&w->lock);
+}
+
+/**
+ * @brief Register a line, polled every interval_us from now on
+ */
+struct gpio_poll_line *gpio_poller_add(struct gpio_desc *desc, unsigned int interval_us,
+                                       gpio_poll_fn fn, void *data){
+    struct gpio_poll_worker *w;
+    struct gpio_poll_line *line;
+    struct gpio_chip *chip = gpiod_to_chip(desc);
+
+    if (!chip || !fn || !interval_us || !workers_started)
+        return ERR_PTR(-EINVAL);
+
+    line = kzalloc(sizeof(*line), GFP_KERNEL);
+    if (!line)
+        return ERR_PTR(-ENOMEM);
+
+    // Lines of one controller share a worker, their reads can be batched
+    w = &workers[hash_ptr(chip, 32) % workers_started];
+    line->w = w;
+    line->desc = desc;
+    line->interval_ns = (u64)interval_us * NSEC_PER_USEC;
+    line->fn = fn;
+    line->data = data;
+    timerqueue_init(&line->node);
+    line->node.expires = ktime_get();
+
+    spin_lock_irq(&w->lock);
+    w->nr_lines++;
+    line->queued = true;
+    if (timerqueue_add(&w->queue, &line->node))
+        poll_rearm(w);                  // new earliest line
+    spin_unlock_irq(&w->lock);
+
+    return line;
+}
+EXPORT_SYMBOL_GPL(gpio_poller_add);
+
+/**
+ * @brief Change the interval, from the next poll on
+ */
+void gpio_poller_set_interval(struct gpio_poll_line *line, unsigned int interval_us){
+    spin_lock_irq(&line->w->lock);
+    line->interval_ns = (u64)max(interval_us, 1U) * NSEC_PER_USEC;
+    spin_unlock_irq(&line->w->lock);
+}
+EXPORT_SYMBOL_GPL(gpio_poller_set_interval);
+
+void gpio_poller_remove(struct gpio_poll_line *line){
+    struct gpio_poll_worker *w = line->w;
+
+    spin_lock_irq(&w->lock);
+    if (line->queued)
+        timerqueue_del(&w->queue, &line->node);
+    line->removed = true;
+    w->nr_lines--;
+    spin_unlock_irq(&w->lock);
+
+    // A pass that already took the line finishes before it is freed
+    kthread_flush_work(&w->work);
+    kfree(line);
+}
+EXPORT_SYMBOL_GPL(gpio_poller_remove);
+
+static int hist_show(struct seq_file *m, void *v){
+    struct rt_hist **hists;
+    unsigned int i;
+    int *ids;
+
+    hists = kcalloc(workers_started, sizeof(*hists), GFP_KERNEL);
+    ids = kcalloc(workers_started, sizeof(*ids), GFP_KERNEL);
+    if (!hists || !ids) {
+        kfree(hists);
+        kfree(ids);
+        return -ENOMEM;
+    }
+
+    seq_printf(m, "# workers %u rt_prio %d cpu %d slack_us %u\n", workers_started, rt_prio, cpu,
+               READ_ONCE(slack_us));
+    for (i = 0; i < workers_started; i++) {
+        seq_printf(m, "# worker%u lines %u reads %llu\n", i, READ_ONCE(workers[i].nr_lines),
+                   READ_ONCE(workers[i].reads));
+        hists[i] = &workers[i].hist;
+        ids[i] = i;
+    }
+    rt_hist_show(m, hists, ids, workers_started, "worker");
+    kfree(hists);
+    kfree(ids);
+    return 0;
+}
+
+static int hist_open(struct inode *inode, struct file *file){
+    return single_open(file, hist_show, NULL);
+}
+
+/* Any write resets, every worker clears its own part before its next pass */
+static ssize_t hist_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos){
+    unsigned int i;
+
+    for (i = 0; i < workers_started; i++)
+        rt_hist_reset(&workers[i].hist);
+    return count;
+}
+
+static const struct file_operations hist_fops = {
+    .owner = THIS_MODULE,
+    .open = hist_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+    .write = hist_write,
+};
+
+static void workers_stop(void){
+    unsigned int i;
+
+    for (i = 0; i < workers_started; i++) {
+        hrtimer_cancel(&workers[i].timer);
+        kthread_destroy_worker(workers[i].kw);
+    }
+    workers_started = 0;
+    kfree(workers);
+}
+
+static int __init poller_init(void){
+    struct gpio_poll_worker *w;
+    unsigned int i;
+
+    nr_workers = clamp(nr_workers, 1U, num_possible_cpus());
+    workers = kcalloc(nr_workers, sizeof(*workers), GFP_KERNEL);
+    if (!workers)
+        return -ENOMEM;
+
+    mutex_lock(&workers_lock);
+    for (i = 0; i < nr_workers; i++) {
+        w = &workers[i];
+        w->kw = kthread_create_worker(0, "gpio_poll/%u", i);
+        if (IS_ERR(w->kw)) {
+            printk(KERN_ERR "Fail to create poller %u\n", i);
+            mutex_unlock(&workers_lock);
+            workers_stop();
+            return -ENOMEM;
+        }
+        kthread_init_work(&w->work, poll_work_fn);
+        rt_hist_init(&w->hist);
+        hrtimer_init(&w->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+        w->timer.function = poll_timer_fn;
+        spin_lock_init(&w->lock);
+        timerqueue_init_head(&w->queue);
+        workers_started++;
+    }
+    if (workers_apply_sched())
+        printk(KERN_WARNING "Can not set rt_prio %d cpu %d\n", rt_prio, cpu);
+    mutex_unlock(&workers_lock);
+
+    debug_dir = debugfs_create_dir("gpio_poller", NULL);
+    debugfs_create_file("histogram", 0644, debug_dir, NULL, &hist_fops);
+
+    printk(KERN_INFO "GPIO poller with %u thread(s)\n", workers_started);
+    return 0;
+}
+
+static void __exit poller_exit(void){
+    debugfs_remove_recursive(debug_dir);
+    mutex_lock(&workers_lock);
+    workers_stop();
+    mutex_unlock(&workers_lock);
+}
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Hao Phan");
+MODULE_DESCRIPTION("Shared GPIO poller on a pool of kthread workers");
+
+module_init(poller_init);
+module_exit(poller_exit);
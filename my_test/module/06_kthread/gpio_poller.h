@@ -0,0 +1,22 @@
+#ifndef __GPIO_POLLER_H__
+#define __GPIO_POLLER_H__
+
+#include <linux/gpio/consumer.h>
+
+/*
+ * Shared GPIO poller, see gpio_poller.c. A driver registers a line with a
+ * poll interval and gets a callback with its level at every poll, from a
+ * kthread_worker of the pool (process context, may sleep briefly).
+ */
+
+struct gpio_poll_line;
+
+typedef void (*gpio_poll_fn)(void *data, int value);
+
+struct gpio_poll_line *gpio_poller_add(struct gpio_desc *desc, unsigned int interval_us,
+                                       gpio_poll_fn fn, void *data);
+void gpio_poller_set_interval(struct gpio_poll_line *line, unsigned int interval_us);
+/* No callback runs once it returns */
+void gpio_poller_remove(struct gpio_poll_line *line);
+
+#endif
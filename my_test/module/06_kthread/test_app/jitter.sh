@@ -0,0 +1,16 @@
+#!/bin/sh
+# Qualify wakeup jitter of the GPIO poller that samples the 06_kthread button
+#
+#   sudo ./jitter.sh [period_us] [rt_prio] [cpu] [seconds]
+#
+# Needs debugfs on /sys/kernel/debug.
+POLLER=/sys/module/gpio_poller/parameters
+HIST=/sys/kernel/debug/gpio_poller/histogram
+
+echo ${1:-1000} > /sys/module/06_kthread/parameters/period_us
+echo ${2:-80} > $POLLER/rt_prio
+echo ${3:--1} > $POLLER/cpu
+echo 0 > $HIST
+
+sleep ${4:-60}
+cat $HIST
@@ -0,0 +1,34 @@
+#ifndef __MISC_CMD_H__
+#define __MISC_CMD_H__
+
+#include <linux/kstrtox.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+
+/*
+ * Text protocol of write(), kept for compatibility:
+ *  - a number is the PID that gets SIGUSR1 on every trigger
+ *  - "trigger" notifies every subscriber
+ *  - anything else is appended to the message log
+ */
+
+enum misc_cmd {
+    MISC_CMD_PID,
+    MISC_CMD_TRIGGER,
+    MISC_CMD_STORE,
+};
+
+/**
+ * @brief Tell what a NUL terminated write() payload asks for
+ * @return A misc_cmd, *pid is set for MISC_CMD_PID, or -EINVAL
+ */
+static inline int misc_cmd_parse(const char *buf, int *pid)
+{
+    if (buf[0] >= '0' && buf[0] <= '9')
+        return kstrtoint(buf, 10, pid) ? -EINVAL : MISC_CMD_PID;
+    if (strncmp(buf, "trigger", 7) == 0)
+        return MISC_CMD_TRIGGER;
+    return MISC_CMD_STORE;
+}
+
+#endif
@@ -5,6 +5,18 @@
 #include <linux/uaccess.h>
 #include <linux/sched/signal.h>
 #include <linux/signal.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/poll.h>
+#include <linux/eventfd.h>
+#include <linux/version.h>
+#include "misc_ioctl.h"
+#include "misc_log.h"
+#include "misc_cmd.h"
+#include "drv_events.h"
+#include "drv_shared.h"
+#include <linux/leds.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Phan Hao");
@@ -13,26 +25,248 @@ MODULE_DESCRIPTION("A misc driver that demonstrates sending signal to user-space
 #define DEV_NAME "my_misc"
 #define BUF_SIZE 128
 
-static char kernel_buf[BUF_SIZE];      // Temporary buffer for write input
-static char display_buf[BUF_SIZE];     // Buffer to store message for read
-static int user_pid = -1;              // User-space process PID
+/* Message log, see misc_log.h */
+static struct misc_log msg_log;
+static DEFINE_MUTEX(log_lock);
+static DECLARE_WAIT_QUEUE_HEAD(log_wq);
+
+/* Per open file state */
+struct misc_client {
+    struct list_head node;              // on subscribers while evfd or sig_pid is set
+    struct eventfd_ctx *evfd;
+    struct pid *sig_pid;                // SIGUSR1 with the payload goes to this process
+    u64 seen_trigger;                   // last trigger reported by poll()
+    u64 log_seq;                        // next message to read, protected by log_lock
+    u32 log_idx;
+};
+
+/*
+ * Subscriber registry. A trigger wakes poll() waiters, sends SIGIO to files
+ * with O_ASYNC, signals every eventfd and, for old clients, sends SIGUSR1 to
+ * the PID written as text. The PID is resolved when it is written, so a
+ * trigger does no lookup.
+ */
+static LIST_HEAD(subscribers);
+static DEFINE_SPINLOCK(registry_lock);
+static struct fasync_struct *async_queue;
+static DECLARE_WAIT_QUEUE_HEAD(trigger_wq);
+static atomic64_t trigger_seq = ATOMIC64_INIT(0);
+static u32 trigger_payload;            // payload of the last trigger, protected by registry_lock
+
+/* User-space process PID, read under RCU by every trigger */
+struct misc_pid_cfg {
+    struct rcu_head rcu;
+    struct pid *pid;
+};
+static struct misc_pid_cfg __rcu *user_pid;
+static DEFINE_MUTEX(user_pid_lock);
+
+static void misc_pid_release(struct rcu_head *rcu)
+{
+    struct misc_pid_cfg *cfg = container_of(rcu, struct misc_pid_cfg, rcu);
+
+    put_pid(cfg->pid);
+    kfree(cfg);
+}
+
+/**
+ * @brief Send SIGUSR1 to a subscribed process
+ */
+static void misc_signal(struct pid *pid, struct kernel_siginfo *info)
+{
+    struct task_struct *task;
+
+    rcu_read_lock();
+    task = pid_task(pid, PIDTYPE_PID);
+    if (task && send_sig_info(SIGUSR1, info, task) < 0)
+        pr_err("misc_dev: Failed to send signal to user process\n");
+    rcu_read_unlock();
+}
+
+/* LED trigger, LEDs bound to "my_misc" blink once per trigger */
+DEFINE_LED_TRIGGER(misc_led_trigger);
+#define MISC_BLINK_MS 50
+
+static void misc_led_blink(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+    led_trigger_blink_oneshot(misc_led_trigger, MISC_BLINK_MS, MISC_BLINK_MS, 0);
+#else
+    unsigned long delay = MISC_BLINK_MS;
+
+    led_trigger_blink_oneshot(misc_led_trigger, &delay, &delay, 0);
+#endif
+}
+
+/**
+ * @brief Notify every subscriber, O(subscribers)
+ */
+static void misc_trigger(u32 value)
+{
+    struct kernel_siginfo info = {
+        .si_signo = SIGUSR1,
+        .si_code = SI_QUEUE,
+        .si_int  = value,
+    };
+    struct misc_client *client;
+    struct misc_pid_cfg *cfg;
+
+    spin_lock(&registry_lock);
+    trigger_payload = value;
+    atomic64_inc(&trigger_seq);
+
+    list_for_each_entry(client, &subscribers, node) {
+        if (client->evfd) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+            eventfd_signal(client->evfd);
+#else
+            eventfd_signal(client->evfd, 1);
+#endif
+        }
+        if (client->sig_pid)
+            misc_signal(client->sig_pid, &info);
+    }
+    spin_unlock(&registry_lock);
+
+    rcu_read_lock();
+    cfg = rcu_dereference(user_pid);
+    if (cfg)
+        misc_signal(cfg->pid, &info);
+    rcu_read_unlock();
+
+    wake_up_interruptible_poll(&trigger_wq, EPOLLPRI);
+    kill_fasync(&async_queue, SIGIO, POLL_PRI);
+    drv_event_post(DRV_EVENTS_GRP_MISC, DEV_NAME, value);
+    misc_led_blink();
+}
+
+/**
+ * @brief Replace the subscriptions of a file, NULL/NULL unsubscribes
+ */
+static void misc_subscribe(struct misc_client *client, struct eventfd_ctx *evfd, struct pid *sig_pid)
+{
+    struct eventfd_ctx *old_evfd;
+    struct pid *old_pid;
+
+    spin_lock(&registry_lock);
+    old_evfd = client->evfd;
+    old_pid = client->sig_pid;
+    client->evfd = evfd;
+    client->sig_pid = sig_pid;
+    if ((evfd || sig_pid) && list_empty(&client->node))
+        list_add_tail(&client->node, &subscribers);
+    else if (!evfd && !sig_pid)
+        list_del_init(&client->node);
+    spin_unlock(&registry_lock);
+
+    if (old_evfd)
+        eventfd_ctx_put(old_evfd);
+    put_pid(old_pid);
+}
+
+/**
+ * @brief Subscribe the file to an eventfd, fd < 0 unsubscribes
+ */
+static int misc_set_eventfd(struct misc_client *client, int fd)
+{
+    struct eventfd_ctx *evfd = NULL;
+    struct pid *sig_pid;
+
+    if (fd >= 0) {
+        evfd = eventfd_ctx_fdget(fd);
+        if (IS_ERR(evfd))
+            return PTR_ERR(evfd);
+    }
+
+    spin_lock(&registry_lock);
+    sig_pid = get_pid(client->sig_pid);
+    spin_unlock(&registry_lock);
+
+    misc_subscribe(client, evfd, sig_pid);
+    return 0;
+}
+
+/**
+ * @brief Append a message to the log and wake the readers
+ */
+static void misc_store(const char *msg, size_t len)
+{
+    mutex_lock(&log_lock);
+    misc_log_append(&msg_log, msg, len);
+    mutex_unlock(&log_lock);
+
+    wake_up_interruptible_poll(&log_wq, EPOLLIN | EPOLLRDNORM);
+}
+
+/**
+ * @brief True when the reader has messages left
+ */
+static bool misc_log_pending(struct misc_client *client)
+{
+    return READ_ONCE(client->log_seq) != READ_ONCE(msg_log.next_seq);
+}
+
+/**
+ * @brief Open handler - Allocates the per file state
+ */
+static int misc_open(struct inode *inode, struct file *file)
+{
+    struct misc_client *client;
+
+    client = kzalloc(sizeof(*client), GFP_KERNEL);
+    if (!client)
+        return -ENOMEM;
+
+    INIT_LIST_HEAD(&client->node);
+    client->seen_trigger = atomic64_read(&trigger_seq);
+
+    /* New readers start at the oldest message still in the log */
+    mutex_lock(&log_lock);
+    client->log_seq = msg_log.first_seq;
+    client->log_idx = msg_log.first_idx;
+    mutex_unlock(&log_lock);
+    file->private_data = client;
+    return 0;
+}
+
+static int misc_fasync(int fd, struct file *file, int on)
+{
+    return fasync_helper(fd, file, on, &async_queue);
+}
+
+/**
+ * @brief Release handler - Drops every subscription of the file
+ */
+static int misc_release(struct inode *inode, struct file *file)
+{
+    struct misc_client *client = file->private_data;
+
+    misc_fasync(-1, file, 0);
+    misc_subscribe(client, NULL, NULL);
+    kfree(client);
+    return 0;
+}
 
 /**
  * @brief Write handler - Handles data written from user-space
  *
  * If the written string is a PID (number), it stores the PID.
- * If the string is "trigger", it sends a signal to the stored PID.
- * Otherwise, it stores the string for reading via read().
+ * If the string is "trigger", it notifies every subscriber and the stored PID.
+ * Otherwise, it appends the string to the message log.
+ *
+ * This text protocol is kept for compatibility, new code uses the ioctls.
  */
 static ssize_t misc_write(struct file *file, const char __user *buf,
                           size_t len, loff_t *ppos)
 {
+    char kernel_buf[BUF_SIZE];      // Temporary buffer for write input
+    struct misc_pid_cfg *cfg;
+    int nr;
+
     if (len >= BUF_SIZE){
         len = BUF_SIZE -1;
     }
 
-    memset(kernel_buf, 0, BUF_SIZE);
-
     if (copy_from_user(kernel_buf, buf, len)) {
         pr_err("misc_write: Failed to copy data from user\n");
         return -EFAULT;
@@ -41,76 +275,212 @@ static ssize_t misc_write(struct file *file, const char __user *buf,
     kernel_buf[len] = '\0';
     *ppos = 0;
 
-    pr_info("misc_write: Received string: '%s' (len = %zu)\n", kernel_buf, len);
+    pr_debug("misc_write: Received string: '%s' (len = %zu)\n", kernel_buf, len);
 
+    switch (misc_cmd_parse(kernel_buf, &nr)) {
     // Case: PID input
-    if (kernel_buf[0] >= '0' && kernel_buf[0] <= '9') {
-        if (kstrtoint(kernel_buf, 10, &user_pid) == 0) {
-            pr_info("misc_write: PID stored: %d\n", user_pid);
-        } else {
-            pr_err("misc_write: Invalid PID format\n");
-            return -EINVAL;
-        }
-    }
-    // Case: Trigger signal
-    else if (strncmp(kernel_buf, "trigger", 7) == 0) {
-        pr_info("misc_write: Trigger received. Attempting to send signal to PID %d...\n", user_pid);
-
-        struct pid *pid_struct = find_get_pid(user_pid);
-        if (!pid_struct) {
+    case MISC_CMD_PID:
+        cfg = kmalloc(sizeof(*cfg), GFP_KERNEL);
+        if (!cfg)
+            return -ENOMEM;
+        cfg->pid = find_get_pid(nr);
+        if (!cfg->pid) {
             pr_err("misc_write: PID not found\n");
+            kfree(cfg);
             return -ESRCH;
         }
 
-        struct task_struct *task = get_pid_task(pid_struct, PIDTYPE_PID);
-        if (!task) {
-            pr_err("misc_write: Task not found for PID %d\n", user_pid);
-            return -ESRCH;
-        }
+        drv_config_publish_cb(user_pid, cfg, &user_pid_lock, misc_pid_release);
+        pr_debug("misc_write: PID stored: %d\n", nr);
+        break;
+    // Case: Trigger signal
+    case MISC_CMD_TRIGGER:
+        misc_trigger(1234);
+        pr_debug("misc_write: Trigger sent to subscribers\n");
+        break;
+    // Case: Store general message
+    case MISC_CMD_STORE:
+        misc_store(kernel_buf, len);
+        pr_debug("misc_write: Stored message: '%s'\n", kernel_buf);
+        break;
+    default:
+        pr_err("misc_write: Invalid PID format\n");
+        return -EINVAL;
+    }
 
-        struct kernel_siginfo info = {
-            .si_signo = SIGUSR1,
-            .si_code = SI_QUEUE,
-            .si_int  = 1234,
-        };
+    return len;
+}
 
-        if (send_sig_info(SIGUSR1, &info, task) < 0) {
-            pr_err("misc_write: Failed to send signal to user process\n");
-            return -EFAULT;
-        }
+/**
+ * @brief Read handler - Drains the message log
+ *
+ * Returns as many whole messages as fit in the buffer, each one followed by
+ * a newline. Blocks until a message arrives unless O_NONBLOCK is set.
+ * Returns -EPIPE once if older messages were dropped before this reader
+ * got them, also while it was copying them, the next read continues with
+ * the oldest message left. -EINVAL if the next message does not fit in len.
+ */
+static ssize_t misc_read(struct file *filp, char __user *buf, size_t len, loff_t *off)
+{
+    struct misc_client *client = filp->private_data;
+    struct misc_record *rec;
+    char tmp[BUF_SIZE];
+    size_t copied = 0;
+    bool lost = false;
+    int ret;
+
+    /* Reading acknowledges the triggers reported by poll() */
+    client->seen_trigger = atomic64_read(&trigger_seq);
 
-        pr_info("misc_write: Signal sent successfully to PID %d\n", user_pid);
+    mutex_lock(&log_lock);
+    while (client->log_seq == msg_log.next_seq) {
+        mutex_unlock(&log_lock);
+        if (filp->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(log_wq, misc_log_pending(client));
+        if (ret)
+            return ret;
+        mutex_lock(&log_lock);
     }
-    // Case: Store general message
-    else {
-        snprintf(display_buf, BUF_SIZE, "%s", kernel_buf);
-        pr_info("misc_write: Stored message: '%s'\n", display_buf);
-        pr_info("misc_write: Unrecognized input. Treated as a message\n");
+
+    if (client->log_seq < msg_log.first_seq) {
+        client->log_seq = msg_log.first_seq;
+        client->log_idx = msg_log.first_idx;
+        mutex_unlock(&log_lock);
+        return -EPIPE;
     }
 
-    return len;
+    while (client->log_seq < msg_log.next_seq) {
+        rec = misc_log_at(&msg_log, client->log_idx);
+        if (copied + rec->len + 1 > len)
+            break;
+
+        /* copy_to_user may fault, do not call it on log_buf under the lock */
+        memcpy(tmp, rec + 1, rec->len);
+        tmp[rec->len] = '\n';
+        mutex_unlock(&log_lock);
+        if (copy_to_user(buf + copied, tmp, rec->len + 1))
+            return copied ? copied : -EFAULT;
+        mutex_lock(&log_lock);
+
+        /* The writer may have dropped our position meanwhile */
+        if (client->log_seq < msg_log.first_seq) {
+            client->log_seq = msg_log.first_seq;
+            client->log_idx = msg_log.first_idx;
+            lost = true;
+            break;
+        }
+        copied += rec->len + 1;
+        client->log_idx = misc_log_next(&msg_log, client->log_idx);
+        client->log_seq++;
+    }
+    mutex_unlock(&log_lock);
+
+    /* Nothing whole was returned: messages were lost, or the first is too long */
+    if (!copied)
+        return lost ? -EPIPE : -EINVAL;
+    pr_debug("misc_read: Returned %zu bytes to user\n", copied);
+    return copied;
 }
 
 /**
- * @brief Read handler - Returns last stored message from write()
+ * @brief Poll handler - EPOLLIN for unread messages, EPOLLPRI when a trigger
+ * happened since the last read()
  */
-static ssize_t misc_read(struct file *filp, char __user *buf, size_t len, loff_t *off)
+static __poll_t misc_poll(struct file *file, poll_table *wait)
 {
-    if (*off > 0 || len < strlen(display_buf))
+    struct misc_client *client = file->private_data;
+    __poll_t mask = 0;
+
+    poll_wait(file, &trigger_wq, wait);
+    poll_wait(file, &log_wq, wait);
+    if (atomic64_read(&trigger_seq) != client->seen_trigger)
+        mask |= EPOLLPRI;
+    if (misc_log_pending(client))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    return mask;
+}
+
+/**
+ * @brief Ioctl handler - Binary command protocol, see misc_ioctl.h
+ */
+static long misc_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct misc_client *client = file->private_data;
+    void __user *uarg = (void __user *)arg;
+    struct misc_subscription sub;
+    struct misc_trigger_info trig;
+    struct misc_message msg;
+    struct eventfd_ctx *evfd = NULL;
+    char kernel_buf[BUF_SIZE];
+    u32 payload;
+    int fd;
+
+    switch (cmd) {
+    case MISC_IOC_SET_EVENTFD:
+        if (get_user(fd, (int __user *)uarg))
+            return -EFAULT;
+        return misc_set_eventfd(client, fd);
+
+    case MISC_IOC_SUBSCRIBE:
+        if (copy_from_user(&sub, uarg, sizeof(sub)))
+            return -EFAULT;
+        if (sub.flags & ~(MISC_SUB_EVENTFD | MISC_SUB_SIGNAL))
+            return -EINVAL;
+        if (sub.flags & MISC_SUB_EVENTFD) {
+            evfd = eventfd_ctx_fdget(sub.eventfd);
+            if (IS_ERR(evfd))
+                return PTR_ERR(evfd);
+        }
+        misc_subscribe(client, evfd,
+                       (sub.flags & MISC_SUB_SIGNAL) ? get_task_pid(current, PIDTYPE_PID) : NULL);
         return 0;
 
-    if (copy_to_user(buf, display_buf, strlen(display_buf)))
-        return -EFAULT;
+    case MISC_IOC_UNSUBSCRIBE:
+        misc_subscribe(client, NULL, NULL);
+        return 0;
+
+    case MISC_IOC_TRIGGER:
+        if (get_user(payload, (u32 __user *)uarg))
+            return -EFAULT;
+        misc_trigger(payload);
+        return 0;
+
+    case MISC_IOC_GET_TRIGGER:
+        spin_lock(&registry_lock);
+        trig.seq = atomic64_read(&trigger_seq);
+        trig.payload = trigger_payload;
+        spin_unlock(&registry_lock);
+        trig.pad = 0;
+        client->seen_trigger = trig.seq;
+        if (copy_to_user(uarg, &trig, sizeof(trig)))
+            return -EFAULT;
+        return 0;
+
+    case MISC_IOC_STORE:
+        if (copy_from_user(&msg, uarg, sizeof(msg)))
+            return -EFAULT;
+        if (msg.len >= BUF_SIZE)
+            return -EMSGSIZE;
+        if (copy_from_user(kernel_buf, u64_to_user_ptr(msg.data), msg.len))
+            return -EFAULT;
+        misc_store(kernel_buf, msg.len);
+        return 0;
 
-    *off += strlen(display_buf);
-    pr_info("misc_read: Returned string to user: '%s'\n", display_buf);
-    return strlen(display_buf);
+    default:
+        return -ENOTTY;
+    }
 }
 
 static struct file_operations misc_fops = {
     .owner = THIS_MODULE,
+    .open  = misc_open,
+    .release = misc_release,
     .read  = misc_read,
     .write = misc_write,
+    .poll  = misc_poll,
+    .fasync = misc_fasync,
+    .unlocked_ioctl = misc_ioctl,
 };
 
 static struct miscdevice misc_dev = {
@@ -124,8 +494,14 @@ static struct miscdevice misc_dev = {
  */
 static int __init dev_init(void)
 {
+    int ret;
+
     pr_info("misc_dev: Registering device '%s'\n", DEV_NAME);
-    return misc_register(&misc_dev);
+    ret = misc_register(&misc_dev);
+    if (ret)
+        return ret;
+    led_trigger_register_simple(DEV_NAME, &misc_led_trigger);
+    return 0;
 }
 
 /**
@@ -135,6 +511,10 @@ static void __exit dev_exit(void)
 {
     pr_info("misc_dev: Unregistering device '%s'\n", DEV_NAME);
     misc_deregister(&misc_dev);
+    led_trigger_unregister_simple(misc_led_trigger);
+    drv_config_publish_cb(user_pid, NULL, &user_pid_lock, misc_pid_release);
+    /* misc_pid_release() is module code */
+    rcu_barrier();
 }
 
 module_init(dev_init);
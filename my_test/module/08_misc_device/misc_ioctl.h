@@ -0,0 +1,46 @@
+#ifndef __MISC_IOCTL_H__
+#define __MISC_IOCTL_H__
+
+#include <linux/types.h>
+
+/*
+ * Binary command protocol of /dev/my_misc. It does the same as writing
+ * "<pid>", "trigger" or a message, without parsing strings.
+ */
+
+#define MISC_MAGIC_NUM 0xF2
+
+/* Subscription kinds */
+#define MISC_SUB_EVENTFD    0x1     // signal the eventfd on every trigger
+#define MISC_SUB_SIGNAL     0x2     // send SIGUSR1 to the caller, si_int = payload
+
+struct misc_subscription {
+    __u32 flags;
+    __s32 eventfd;
+};
+
+struct misc_trigger_info {
+    __u64 seq;                      // number of triggers so far
+    __u32 payload;                  // payload of the last one
+    __u32 pad;
+};
+
+struct misc_message {
+    __u64 data;                     // pointer to the message
+    __u32 len;                      // less than 128
+    __u32 pad;
+};
+
+/* Signal an eventfd on every trigger, -1 unsubscribes */
+#define MISC_IOC_SET_EVENTFD    _IOW(MISC_MAGIC_NUM, 0, int)
+/* Replace the subscriptions of this file */
+#define MISC_IOC_SUBSCRIBE      _IOW(MISC_MAGIC_NUM, 1, struct misc_subscription)
+#define MISC_IOC_UNSUBSCRIBE    _IO(MISC_MAGIC_NUM, 2)
+/* Notify every subscriber with a payload */
+#define MISC_IOC_TRIGGER        _IOW(MISC_MAGIC_NUM, 3, __u32)
+/* Read the last trigger, this also clears EPOLLPRI for this file */
+#define MISC_IOC_GET_TRIGGER    _IOR(MISC_MAGIC_NUM, 4, struct misc_trigger_info)
+/* Append a message to the log read() drains */
+#define MISC_IOC_STORE          _IOW(MISC_MAGIC_NUM, 5, struct misc_message)
+
+#endif
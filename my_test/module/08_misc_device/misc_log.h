@@ -0,0 +1,110 @@
+#ifndef __MISC_LOG_H__
+#define __MISC_LOG_H__
+
+#include <linux/types.h>
+#include <linux/align.h>
+#include <linux/minmax.h>
+#include <linux/string.h>
+#include <linux/compiler.h>
+
+/*
+ * Message log. Messages are variable length records in a ring, the oldest
+ * ones are dropped when it is full. Every record has a sequence number and
+ * each reader keeps its own position, so readers never steal messages from
+ * each other.
+ *
+ * A record with rec_len == 0 marks the end of the data, the next record is
+ * at the start of the buffer. There is always room for this marker after
+ * the last record.
+ *
+ * Nothing here locks, the caller serialises every access.
+ */
+
+#define LOG_BUF_SIZE 4096
+
+struct misc_record {
+    u64 seq;
+    u16 len;                            // length of the message
+    u16 rec_len;                        // length of the record, 0 = wrap
+};
+
+struct misc_log {
+    char buf[LOG_BUF_SIZE] __aligned(8);
+    u32 first_idx;                      // oldest record
+    u64 first_seq;
+    u32 next_idx;                       // where the next record goes
+    u64 next_seq;
+};
+
+/**
+ * @brief Get the record at idx, following the wrap marker
+ */
+static inline struct misc_record *misc_log_at(struct misc_log *log, u32 idx)
+{
+    struct misc_record *rec = (struct misc_record *)(log->buf + idx);
+
+    if (!rec->rec_len)
+        rec = (struct misc_record *)log->buf;
+    return rec;
+}
+
+/**
+ * @brief Index of the record after the one at idx
+ */
+static inline u32 misc_log_next(struct misc_log *log, u32 idx)
+{
+    struct misc_record *rec = (struct misc_record *)(log->buf + idx);
+
+    if (!rec->rec_len)
+        return ((struct misc_record *)log->buf)->rec_len;
+    return idx + rec->rec_len;
+}
+
+static inline bool misc_log_has_space(struct misc_log *log, u32 size)
+{
+    u32 free;
+
+    if (log->next_idx > log->first_idx)
+        free = max(LOG_BUF_SIZE - log->next_idx, log->first_idx);
+    else
+        free = log->first_idx - log->next_idx;
+
+    /* Keep room for the wrap marker */
+    return free >= size + sizeof(struct misc_record);
+}
+
+/**
+ * @brief Append a message, dropping the oldest ones until it fits
+ *
+ * len must leave room for a record and the wrap marker.
+ */
+static inline void misc_log_append(struct misc_log *log, const char *msg, size_t len)
+{
+    u32 size = ALIGN(sizeof(struct misc_record) + len, 8);
+    struct misc_record *rec;
+
+    while (log->first_seq < log->next_seq && !misc_log_has_space(log, size)) {
+        log->first_idx = misc_log_next(log, log->first_idx);
+        log->first_seq++;
+    }
+    if (log->first_seq == log->next_seq) {
+        log->first_idx = 0;
+        log->next_idx = 0;
+    }
+
+    if (log->next_idx + size + sizeof(struct misc_record) > LOG_BUF_SIZE) {
+        memset(log->buf + log->next_idx, 0, sizeof(struct misc_record));
+        log->next_idx = 0;
+    }
+
+    rec = (struct misc_record *)(log->buf + log->next_idx);
+    rec->seq = log->next_seq;
+    rec->len = len;
+    rec->rec_len = size;
+    memcpy(rec + 1, msg, len);
+
+    log->next_idx += size;
+    WRITE_ONCE(log->next_seq, log->next_seq + 1);
+}
+
+#endif
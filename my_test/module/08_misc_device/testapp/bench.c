@@ -0,0 +1,118 @@
+/**
+ * Compare the text protocol with the binary ioctls of /dev/my_misc
+ *
+ *   ./bench [iterations]
+ *
+ * For each path it reports the wall time per operation and the CPU time
+ * (user + system) the process spent per operation. A trigger is timed as a
+ * round trip: issue it, then wait for the eventfd subscription to fire.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include "../misc_ioctl.h"
+
+#define DEVICE_PATH "/dev/my_misc"
+
+static int dev, efd;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t cpu_ns(void) {
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+static void wait_event(void) {
+    uint64_t count;
+
+    if (read(efd, &count, sizeof(count)) != sizeof(count)) {
+        perror("eventfd read");
+        exit(1);
+    }
+}
+
+static void text_trigger(void) {
+    write(dev, "trigger", 7);
+    wait_event();
+}
+
+static void ioctl_trigger(void) {
+    uint32_t payload = 1234;
+
+    ioctl(dev, MISC_IOC_TRIGGER, &payload);
+    wait_event();
+}
+
+static void text_store(void) {
+    write(dev, "hello from user space", 21);
+}
+
+static void ioctl_store(void) {
+    static const char text[] = "hello from user space";
+    struct misc_message msg = { .data = (uintptr_t)text, .len = sizeof(text) - 1 };
+
+    ioctl(dev, MISC_IOC_STORE, &msg);
+}
+
+static void run(const char *name, void (*op)(void), int iterations) {
+    uint64_t t0, c0, wall, cpu;
+    int i;
+
+    for (i = 0; i < iterations / 10; i++)
+        op();
+
+    t0 = now_ns();
+    c0 = cpu_ns();
+    for (i = 0; i < iterations; i++)
+        op();
+    wall = now_ns() - t0;
+    cpu = cpu_ns() - c0;
+
+    printf("%-16s %10.0f ns/op %10.0f ns cpu/op\n", name,
+           (double)wall / iterations, (double)cpu / iterations);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    struct misc_subscription sub;
+
+    dev = open(DEVICE_PATH, O_RDWR);
+    efd = eventfd(0, 0);
+    if (dev < 0 || efd < 0) {
+        perror("Failed to open device");
+        return 1;
+    }
+
+    sub.flags = MISC_SUB_EVENTFD;
+    sub.eventfd = efd;
+    if (ioctl(dev, MISC_IOC_SUBSCRIBE, &sub) < 0) {
+        perror("MISC_IOC_SUBSCRIBE");
+        return 1;
+    }
+
+    run("text trigger", text_trigger, iterations);
+    run("ioctl trigger", ioctl_trigger, iterations);
+    run("text store", text_store, iterations);
+    run("ioctl store", ioctl_store, iterations);
+
+    ioctl(dev, MISC_IOC_UNSUBSCRIBE);
+    close(efd);
+    close(dev);
+    return 0;
+}
@@ -0,0 +1,97 @@
+/**
+ * Use /dev/my_misc as a message bus
+ *
+ * One writer posts numbered messages while two readers drain them with
+ * poll() and blocking read(). Each reader must get every message, in order.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#define DEVICE_PATH "/dev/my_misc"
+#define MESSAGES 1000
+
+static int reader(const char *name, int use_poll) {
+    struct pollfd pfd = { .events = POLLIN };
+    char buf[4096];
+    int expected = 0, batches = 0;
+    ssize_t n;
+    char *line;
+
+    pfd.fd = open(DEVICE_PATH, O_RDONLY | O_NONBLOCK);
+    if (pfd.fd < 0) {
+        perror(name);
+        return 1;
+    }
+
+    /* Skip what is left in the log from earlier runs */
+    while (read(pfd.fd, buf, sizeof(buf)) > 0 || errno == EPIPE)
+        ;
+    if (!use_poll)
+        fcntl(pfd.fd, F_SETFL, fcntl(pfd.fd, F_GETFL) & ~O_NONBLOCK);
+
+    while (expected < MESSAGES) {
+        if (use_poll)
+            poll(&pfd, 1, -1);
+        n = read(pfd.fd, buf, sizeof(buf) - 1);
+        if (n < 0 && errno == EAGAIN)
+            continue;
+        if (n < 0) {
+            printf("[%s] read failed: %s\n", name, strerror(errno));
+            return 1;
+        }
+        buf[n] = '\0';
+        batches++;
+        for (line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+            if (strncmp(line, "msg ", 4) != 0)
+                continue;
+            if (atoi(line + 4) != expected) {
+                printf("[%s] expected %d, got '%s'\n", name, expected, line);
+                return 1;
+            }
+            expected++;
+        }
+    }
+    printf("[%s] %d messages in %d reads\n", name, expected, batches);
+    return 0;
+}
+
+int main() {
+    char msg[32];
+    int fd, i, status, failed = 0;
+
+    fd = open(DEVICE_PATH, O_WRONLY);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return 1;
+    }
+
+    if (fork() == 0)
+        exit(reader("blocking", 0));
+    if (fork() == 0)
+        exit(reader("poll", 1));
+
+    /* Let the readers open the device */
+    sleep(1);
+
+    for (i = 0; i < MESSAGES; i++) {
+        snprintf(msg, sizeof(msg), "msg %d", i);
+        write(fd, msg, strlen(msg));
+        /* Stay within the log so that no reader is overrun */
+        if (i % 64 == 63)
+            usleep(10000);
+    }
+    close(fd);
+
+    for (i = 0; i < 2; i++) {
+        wait(&status);
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+    }
+    printf("%s\n", failed ? "FAILED" : "ALL PASSED");
+    return failed;
+}
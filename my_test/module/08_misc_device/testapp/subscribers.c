@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include "../misc_ioctl.h"
+
+#define DEVICE_PATH "/dev/my_misc"
+
+volatile sig_atomic_t got_sigio = 0;
+
+void sigio_handler(int signo) {
+    got_sigio = 1;
+}
+
+/* Subscriber waiting on an eventfd */
+static void eventfd_subscriber(void) {
+    int fd = open(DEVICE_PATH, O_RDWR);
+    int efd = eventfd(0, 0);
+    uint64_t count;
+
+    if (fd < 0 || efd < 0 || ioctl(fd, MISC_IOC_SET_EVENTFD, &efd) < 0) {
+        perror("eventfd subscriber");
+        exit(1);
+    }
+    read(efd, &count, sizeof(count));
+    printf("[eventfd] %llu trigger(s)\n", (unsigned long long)count);
+    exit(0);
+}
+
+/* Subscriber polling the device for POLLPRI */
+static void poll_subscriber(void) {
+    struct pollfd pfd = { .events = POLLPRI };
+
+    pfd.fd = open(DEVICE_PATH, O_RDWR);
+    if (pfd.fd < 0) {
+        perror("poll subscriber");
+        exit(1);
+    }
+    poll(&pfd, 1, -1);
+    printf("[poll] revents 0x%x\n", pfd.revents);
+    exit(0);
+}
+
+/* Subscriber getting SIGIO */
+static void sigio_subscriber(void) {
+    int fd = open(DEVICE_PATH, O_RDWR);
+    sigset_t mask, old;
+
+    if (fd < 0) {
+        perror("sigio subscriber");
+        exit(1);
+    }
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGIO);
+    sigprocmask(SIG_BLOCK, &mask, &old);
+    signal(SIGIO, sigio_handler);
+    fcntl(fd, F_SETOWN, getpid());
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_ASYNC);
+    while (!got_sigio)
+        sigsuspend(&old);
+    printf("[sigio] signal received\n");
+    exit(0);
+}
+
+int main() {
+    void (*subscriber[])(void) = { eventfd_subscriber, poll_subscriber, sigio_subscriber };
+    int n = sizeof(subscriber) / sizeof(subscriber[0]);
+    int fd, i;
+
+    for (i = 0; i < n; i++) {
+        if (fork() == 0)
+            subscriber[i]();
+    }
+
+    /* Let every subscriber register */
+    sleep(1);
+
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return 1;
+    }
+    write(fd, "trigger", 7);
+    printf("Sent 'trigger' to kernel\n");
+    close(fd);
+
+    for (i = 0; i < n; i++)
+        wait(NULL);
+    printf("All subscribers notified\n");
+    return 0;
+}
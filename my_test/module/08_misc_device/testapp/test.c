@@ -19,6 +19,7 @@ void sig_handler(int signo, siginfo_t *info, void *context) {
 
 int main() {
     int fd;
+    ssize_t n;
 
     // Register signal handler for SIGUSR1
     struct sigaction sa;
@@ -43,9 +44,10 @@ int main() {
     write(fd, write_buf, strlen(write_buf));
     printf("Wrote string '%s' to device\n", write_buf);
 
-    // 2. Read it back
-    read(fd, read_buf, sizeof(read_buf));
-    printf("Read string '%s' from device\n", read_buf);
+    // 2. Read it back, with every message still in the log
+    n = read(fd, read_buf, sizeof(read_buf) - 1);
+    read_buf[n > 0 ? n : 0] = '\0';
+    printf("Read messages from device:\n%s", read_buf);
 
     // 3. Send PID to kernel
     snprintf(write_buf, sizeof(write_buf), "%d", getpid());
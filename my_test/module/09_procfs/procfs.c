@@ -6,69 +6,135 @@
 #include <linux/delay.h>
 #include <linux/uaccess.h>
 #include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #include <linux/gpio.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
+#include "led_bitmap.h"
+#include "drv_shared.h"
 
 #define DEV_NAME "led_control"
 #define PROC_NAME "led_control"
-#define GPIO_LED 539  // GPIO27 BCM
+#define MAX_LEDS LED_BITMAP_MAX
 
-static int led_status = 0;
-static struct proc_dir_entry *proc_entry;
+static int gpios[MAX_LEDS] = { 539 };  // GPIO27 BCM
+static int nr_leds = 1;
+module_param_array(gpios, int, &nr_leds, 0444);
+MODULE_PARM_DESC(gpios, "GPIO numbers of the LEDs");
+
+struct led_state {
+    atomic_t on;
+    atomic64_t last_change_ns;         // ktime_get_ns() of the last toggle, 0 = never
+};
+
+/* Usage counters, per CPU (see drv_shared.h) */
+#define STAT_WRITES         0
+#define STAT_ERRORS         1
+#define STAT_TOGGLES(led)   (2 + (led))
+#define STAT_ON_NS(led)     (2 + MAX_LEDS + (led))   // on-time of the finished on periods
+#define NR_STATS            (2 + 2 * MAX_LEDS)
+
+struct led_totals {
+    u64 cnt[NR_STATS];
+};
+
+static struct led_state leds[MAX_LEDS];
+static struct gpio_desc *led_descs[MAX_LEDS];
+static struct drv_stats led_stats;
+static struct proc_dir_entry *proc_dir;
+
+/**
+ * @brief Count a write() call, and an error if it failed
+ */
+static void stats_count_write(bool error)
+{
+    drv_stats_inc(&led_stats, STAT_WRITES);
+    if (error)
+        drv_stats_inc(&led_stats, STAT_ERRORS);
+}
+
+/**
+ * @brief Record the new state of an LED and account the toggle
+ */
+static void led_account(int led, int on)
+{
+    u64 now, prev;
+
+    if (atomic_xchg(&leds[led].on, on) == on)
+        return;
+
+    now = ktime_get_ns();
+    prev = atomic64_xchg(&leds[led].last_change_ns, now);
+
+    drv_stats_inc(&led_stats, STAT_TOGGLES(led));
+    if (!on && prev)
+        drv_stats_add(&led_stats, STAT_ON_NS(led), now - prev);
+}
 
 /* File operations for /dev/led_control */
 static int dev_open(struct inode *inode, struct file *file)
 {
-    pr_info("%s: Device opened\n", DEV_NAME);
+    pr_debug("%s: Device opened\n", DEV_NAME);
     return 0;
 }
 
 static int dev_release(struct inode *inode, struct file *file)
 {
-    pr_info("%s: Device closed\n", DEV_NAME);
+    pr_debug("%s: Device closed\n", DEV_NAME);
     return 0;
 }
 
+/**
+ * @brief Read handler - One '0' or '1' per LED
+ */
 static ssize_t dev_read(struct file *file, char __user *buf, size_t count, loff_t *offset)
 {
-    char tmp[2];
-
-    if (*offset > 0)
-        return 0;
-
-    tmp[0] = gpio_get_value(GPIO_LED) ? '1' : '0';
-    tmp[1] = '\n';
+    char tmp[MAX_LEDS + 1];
+    int i;
 
-    if (copy_to_user(buf, tmp, sizeof(tmp)))
-        return -EFAULT;
+    for (i = 0; i < nr_leds; i++)
+        tmp[i] = atomic_read(&leds[i].on) ? '1' : '0';
+    tmp[nr_leds] = '\n';
 
-    *offset += sizeof(tmp);
-    return sizeof(tmp);
+    return simple_read_from_buffer(buf, count, offset, tmp, nr_leds + 1);
 }
 
+/**
+ * @brief Write handler - Sets every LED from a bit string or bitmap (see
+ * led_bitmap.h), or one LED with "<led> <value>"
+ */
 static ssize_t dev_write(struct file *file, const char __user *buf, size_t count, loff_t *offset)
 {
-    char value;
-
-    if (copy_from_user(&value, buf, 1))
-        return -EFAULT;
-
-    switch (value) {
-        case '0':
-            gpio_set_value(GPIO_LED, 0);
-            led_status = 0;
-            break;
-        case '1':
-            gpio_set_value(GPIO_LED, 1);
-            led_status = 1;
-            break;
-        default:
-            pr_warn("%s: Invalid value written: %c\n", DEV_NAME, value);
-            return -EINVAL;
+    char tmp[LED_BITMAP_MAX + 2];
+    size_t len = min(count, sizeof(tmp) - 1);
+    DECLARE_BITMAP(bits, MAX_LEDS);
+    int led, value, ret = -EINVAL;
+
+    if (copy_from_user(tmp, buf, len)) {
+        ret = -EFAULT;
+        goto out;
+    }
+    tmp[len] = '\0';
+
+    if (count == len && led_bitmap_parse(tmp, len, bits, nr_leds) == 0) {
+        /* All lines change at once */
+        gpiod_set_array_value(nr_leds, led_descs, NULL, bits);
+        for (led = 0; led < nr_leds; led++)
+            led_account(led, test_bit(led, bits));
+    } else if (sscanf(tmp, "%d %d", &led, &value) == 2 &&
+               led >= 0 && led < nr_leds && (value == 0 || value == 1)) {
+        gpiod_set_value(led_descs[led], value);
+        led_account(led, value);
+    } else {
+        pr_warn("%s: Invalid value written: %s\n", DEV_NAME, tmp);
+        goto out;
     }
 
-    return count;
+    ret = count;
+out:
+    stats_count_write(ret < 0);
+    return ret;
 }
-
 static const struct file_operations dev_fops = {
     .owner   = THIS_MODULE,
     .open    = dev_open,
@@ -77,28 +143,106 @@ static const struct file_operations dev_fops = {
     .write   = dev_write,
 };
 
-/* File operations for /proc/led_control */
-static ssize_t proc_read(struct file *file, char __user *buf, size_t count, loff_t *offset)
+/* /proc/led_control/status - one line per LED */
+static int status_show(struct seq_file *m, void *v)
+{
+    int i;
+
+    for (i = 0; i < nr_leds; i++)
+        seq_printf(m, "LED%d is %s\n", i, atomic_read(&leds[i].on) ? "ON" : "OFF");
+    return 0;
+}
+
+/* /proc/led_control/leds - usage of every LED, one row each */
+static void *leds_start(struct seq_file *m, loff_t *pos)
+{
+    struct led_totals *t;
+
+    if (*pos > nr_leds)
+        return NULL;
+
+    /* One snapshot for the whole table, taken when it starts */
+    if (!m->private) {
+        m->private = kmalloc(sizeof(*t), GFP_KERNEL);
+        if (!m->private)
+            return ERR_PTR(-ENOMEM);
+    }
+    if (*pos == 0)
+        drv_stats_read(&led_stats, ((struct led_totals *)m->private)->cnt);
+    return *pos ? &leds[*pos - 1] : SEQ_START_TOKEN;
+}
+
+static void *leds_next(struct seq_file *m, void *v, loff_t *pos)
 {
-    char tmp[64];
-    int len;
+    ++*pos;
+    return *pos > nr_leds ? NULL : &leds[*pos - 1];
+}
+
+static void leds_stop(struct seq_file *m, void *v)
+{
+}
 
-    if (*offset > 0)
+static int leds_show(struct seq_file *m, void *v)
+{
+    struct led_totals *t = m->private;
+    struct led_state *led = v;
+    u64 on_ns, last, secs;
+    u32 nsecs;
+    int i;
+
+    if (v == SEQ_START_TOKEN) {
+        seq_puts(m, "led gpio state  toggles     on_time_ms  last_change_s\n");
         return 0;
+    }
+
+    i = led - leds;
+    on_ns = t->cnt[STAT_ON_NS(i)];
+    last = atomic64_read(&led->last_change_ns);
+    /* Count the current on period too */
+    if (atomic_read(&led->on) && last)
+        on_ns += ktime_get_ns() - last;
 
-    len = snprintf(tmp, sizeof(tmp), "LED is %s\n", led_status ? "ON" : "OFF");
+    secs = div_u64_rem(last, NSEC_PER_SEC, &nsecs);
 
-    if (copy_to_user(buf, tmp, len))
-        return -EFAULT;
+    seq_printf(m, "%-3d %-4d %-5s %-11llu %-11llu %llu.%09u\n", i, gpios[i],
+               atomic_read(&led->on) ? "on" : "off", t->cnt[STAT_TOGGLES(i)],
+               div_u64(on_ns, NSEC_PER_MSEC), secs, nsecs);
+    return 0;
+}
+
+static const struct seq_operations leds_seq_ops = {
+    .start = leds_start,
+    .next  = leds_next,
+    .stop  = leds_stop,
+    .show  = leds_show,
+};
+
+static int leds_release(struct inode *inode, struct file *file)
+{
+    kfree(((struct seq_file *)file->private_data)->private);
+    return seq_release(inode, file);
+}
 
-    *offset += len;
-    return len;
+static int leds_open(struct inode *inode, struct file *file)
+{
+    return seq_open(file, &leds_seq_ops);
 }
 
-static const struct proc_ops proc_fops = {
-    .proc_read = proc_read,
+static const struct proc_ops leds_proc_ops = {
+    .proc_open    = leds_open,
+    .proc_read    = seq_read,
+    .proc_lseek   = seq_lseek,
+    .proc_release = leds_release,
 };
 
+/* /proc/led_control/counters - calls on /dev/led_control */
+static int counters_show(struct seq_file *m, void *v)
+{
+    seq_printf(m, "writes %llu\nerrors %llu\n", drv_stats_get(&led_stats, STAT_WRITES),
+               drv_stats_get(&led_stats, STAT_ERRORS));
+    return 0;
+}
+
 /* Define misc device */
 static struct miscdevice misc_dev = {
     .minor = MISC_DYNAMIC_MINOR,
@@ -106,6 +250,24 @@ static struct miscdevice misc_dev = {
     .fops  = &dev_fops,
 };
 
+/**
+ * @brief Create /proc/led_control and its entries
+ */
+static int led_proc_create(void)
+{
+    proc_dir = proc_mkdir(PROC_NAME, NULL);
+    if (!proc_dir)
+        return -ENOMEM;
+
+    if (!proc_create_single("status", 0444, proc_dir, status_show) ||
+        !proc_create("leds", 0444, proc_dir, &leds_proc_ops) ||
+        !proc_create_single("counters", 0444, proc_dir, counters_show)) {
+        proc_remove(proc_dir);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
 /* Module init */
 static int __init led_init(void)
 {
@@ -113,52 +275,49 @@ static int __init led_init(void)
 
     pr_info("%s: Initializing module\n", DEV_NAME);
 
-    ret = misc_register(&misc_dev);
-    if (ret) {
-        pr_err("%s: Failed to register misc device\n", DEV_NAME);
-        goto err_misc;
-    }
+    if (nr_leds < 1)
+        return -EINVAL;
 
-    proc_entry = proc_create(PROC_NAME, 0444, NULL, &proc_fops);
-    if (!proc_entry) {
-        pr_err("%s: Failed to create /proc/%s\n", DEV_NAME, PROC_NAME);
-        ret = -ENOMEM;
-        goto err_proc;
-    }
+    ret = drv_stats_init(&led_stats, NR_STATS);
+    if (ret)
+        return ret;
 
-    ret = gpio_request(GPIO_LED, "led_gpio");
+    ret = led_gpios_request(gpios, nr_leds, led_descs, "led_gpio");
+    if (ret)
+        goto err_stats;
+
+    ret = led_proc_create();
     if (ret) {
-        pr_err("%s: Failed to request GPIO\n", DEV_NAME);
+        pr_err("%s: Failed to create /proc/%s\n", DEV_NAME, PROC_NAME);
         goto err_gpio;
     }
 
-    ret = gpio_direction_output(GPIO_LED, 0);
+    ret = misc_register(&misc_dev);
     if (ret) {
-        pr_err("%s: Failed to set GPIO direction\n", DEV_NAME);
-        goto err_dir;
+        pr_err("%s: Failed to register misc device\n", DEV_NAME);
+        goto err_misc;
     }
 
-    pr_info("%s: Driver loaded\n", DEV_NAME);
+    pr_info("%s: Driver loaded with %d LED(s)\n", DEV_NAME, nr_leds);
     return 0;
 
 /* Cleanup blocks */
-err_dir:
-    gpio_free(GPIO_LED);
-err_gpio:
-    proc_remove(proc_entry);
-err_proc:
-    misc_deregister(&misc_dev);
 err_misc:
+    proc_remove(proc_dir);
+err_gpio:
+    led_gpios_free(gpios, nr_leds);
+err_stats:
+    drv_stats_free(&led_stats);
     return ret;
 }
 
 /* Module exit */
 static void __exit led_exit(void)
 {
-    gpio_set_value(GPIO_LED, 0);
-    gpio_free(GPIO_LED);
-    proc_remove(proc_entry);
     misc_deregister(&misc_dev);
+    proc_remove(proc_dir);
+    led_gpios_free(gpios, nr_leds);
+    drv_stats_free(&led_stats);
     pr_info("%s: Module removed\n", DEV_NAME);
 }
 
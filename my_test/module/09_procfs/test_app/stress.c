@@ -0,0 +1,186 @@
+/**
+ * Stress test for the lock-free paths of the drivers (see include/drv_shared.h)
+ *
+ *   ./stress [threads] [seconds]
+ *
+ * Every thread hammers the devices that are loaded:
+ *   /dev/characterDriver  writes messages of one repeated character and
+ *                         checks that no read returns a mix of two
+ *   /dev/led_control      toggles LED 0 and writes invalid values, then the
+ *                         counters in /proc/led_control must match exactly
+ *   /dev/my_misc          stores the PID and triggers at the same time
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define CHARDEV   "/dev/characterDriver"
+#define LED_DEV   "/dev/led_control"
+#define LED_PROC  "/proc/led_control/counters"
+#define MISC_DEV  "/dev/my_misc"
+#define MSG_SIZE  255
+
+static int have_chardev, have_led, have_misc;
+static volatile int stop;
+
+static atomic_ulong chardev_ops, chardev_torn;
+static atomic_ulong led_writes, led_errors, led_failed;
+static atomic_ulong misc_ops, misc_failed;
+
+static int failed = 0;
+
+static void check(int ok, const char *what){
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if(!ok)
+        failed = 1;
+}
+
+static int exists(const char *path){
+    return access(path, F_OK) == 0;
+}
+
+static void read_counters(unsigned long long *writes, unsigned long long *errors){
+    FILE *f = fopen(LED_PROC, "r");
+
+    *writes = *errors = 0;
+    if(!f){
+        perror(LED_PROC);
+        exit(2);
+    }
+    if(fscanf(f, "writes %llu\nerrors %llu", writes, errors) != 2)
+        fprintf(stderr, "unexpected %s format\n", LED_PROC);
+    fclose(f);
+}
+
+/* One iteration on /dev/characterDriver */
+static void chardev_step(int fd, unsigned int *seed){
+    char msg[MSG_SIZE], buf[MSG_SIZE];
+    int len = 1 + rand_r(seed) % MSG_SIZE;
+    int n, i;
+
+    if(rand_r(seed) & 1){
+        memset(msg, 'A' + rand_r(seed) % 26, len);
+        write(fd, msg, len);
+    }
+    else{
+        n = read(fd, buf, sizeof(buf));
+        for(i = 1; i < n; i++){
+            if(buf[i] != buf[0]){
+                atomic_fetch_add(&chardev_torn, 1);
+                break;
+            }
+        }
+    }
+    atomic_fetch_add(&chardev_ops, 1);
+}
+
+/* One iteration on /dev/led_control, every 8th write is invalid */
+static void led_step(int fd, unsigned int *seed){
+    int bad = rand_r(seed) % 8 == 0;
+    const char *val = bad ? "x" : (rand_r(seed) & 1 ? "0 1" : "0 0");
+    ssize_t ret = write(fd, val, strlen(val));
+
+    atomic_fetch_add(&led_writes, 1);
+    if(bad)
+        atomic_fetch_add(&led_errors, 1);
+    if((ret < 0) != bad)
+        atomic_fetch_add(&led_failed, 1);
+}
+
+/* One iteration on /dev/my_misc */
+static void misc_step(int fd, unsigned int *seed){
+    char pid[16];
+    int len;
+
+    if(rand_r(seed) & 1)
+        len = snprintf(pid, sizeof(pid), "%d", getpid());
+    else
+        len = snprintf(pid, sizeof(pid), "trigger");
+    if(write(fd, pid, len) < 0)
+        atomic_fetch_add(&misc_failed, 1);
+    atomic_fetch_add(&misc_ops, 1);
+}
+
+static void *worker(void *arg){
+    unsigned int seed = (unsigned long)arg;
+    int chr = have_chardev ? open(CHARDEV, O_RDWR) : -1;
+    int led = have_led ? open(LED_DEV, O_WRONLY) : -1;
+    int misc = have_misc ? open(MISC_DEV, O_RDWR) : -1;
+
+    while(!stop){
+        if(chr >= 0)
+            chardev_step(chr, &seed);
+        if(led >= 0)
+            led_step(led, &seed);
+        if(misc >= 0)
+            misc_step(misc, &seed);
+    }
+
+    if(chr >= 0)
+        close(chr);
+    if(led >= 0)
+        close(led);
+    if(misc >= 0)
+        close(misc);
+    return NULL;
+}
+
+int main(int argc, char *argv[]){
+    int threads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN) * 2;
+    int seconds = argc > 2 ? atoi(argv[2]) : 10;
+    unsigned long long writes0, errors0, writes1, errors1;
+    pthread_t *tid;
+    int i;
+
+    have_chardev = exists(CHARDEV);
+    have_led = exists(LED_DEV) && exists(LED_PROC);
+    have_misc = exists(MISC_DEV);
+    if(!have_chardev && !have_led && !have_misc){
+        printf("No device loaded\n");
+        return 2;
+    }
+
+    /* Triggers send SIGUSR1 to the stored PID, that is us */
+    signal(SIGUSR1, SIG_IGN);
+
+    tid = calloc(threads, sizeof(*tid));
+    if(have_led)
+        read_counters(&writes0, &errors0);
+
+    printf("%d threads for %d s on%s%s%s\n", threads, seconds, have_chardev ? " " CHARDEV : "",
+           have_led ? " " LED_DEV : "", have_misc ? " " MISC_DEV : "");
+    for(i = 0; i < threads; i++)
+        pthread_create(&tid[i], NULL, worker, (void *)(unsigned long)(time(NULL) + i));
+    sleep(seconds);
+    stop = 1;
+    for(i = 0; i < threads; i++)
+        pthread_join(tid[i], NULL);
+
+    if(have_chardev){
+        printf("  %s: %lu operations, %lu torn reads\n", CHARDEV,
+               atomic_load(&chardev_ops), atomic_load(&chardev_torn));
+        check(atomic_load(&chardev_torn) == 0, "reads never mix two writes");
+    }
+    if(have_led){
+        read_counters(&writes1, &errors1);
+        printf("  %s: %lu writes, %lu invalid, counters +%llu/+%llu\n", LED_DEV,
+               atomic_load(&led_writes), atomic_load(&led_errors), writes1 - writes0, errors1 - errors0);
+        check(atomic_load(&led_failed) == 0, "only invalid writes fail");
+        check(writes1 - writes0 == atomic_load(&led_writes), "no write is lost in the counters");
+        check(errors1 - errors0 == atomic_load(&led_errors), "no error is lost in the counters");
+    }
+    if(have_misc){
+        printf("  %s: %lu operations\n", MISC_DEV, atomic_load(&misc_ops));
+        check(atomic_load(&misc_failed) == 0, "PID updates and triggers never fail");
+    }
+
+    free(tid);
+    printf("%s\n", failed ? "FAILED" : "ALL PASSED");
+    return failed;
+}
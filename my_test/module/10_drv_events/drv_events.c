@@ -0,0 +1,169 @@
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/timekeeping.h>
+#include <net/genetlink.h>
+#include "drv_events.h"
+#include "drv_events_batch.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Phan Hao");
+MODULE_DESCRIPTION("Generic netlink multicast channel for driver events");
+
+static unsigned int batch_ms = 2;
+module_param(batch_ms, uint, 0644);
+MODULE_PARM_DESC(batch_ms, "How long events are collected before they are sent");
+
+/*
+ * Two batches per group. Events go into the active one while the flush
+ * work sends the other, so posting never waits for the socket layer.
+ * Events posted while the active batch is full are only counted, in that
+ * same batch: its message carries them as DRV_EVENTS_A_DROPPED.
+ */
+static struct drv_event_batch batches[DRV_EVENTS_GRP_MAX][2];
+static struct drv_event_batch *active[DRV_EVENTS_GRP_MAX];
+static DEFINE_SPINLOCK(batch_lock);
+
+static void flush_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(flush_work, flush_fn);
+
+static const struct genl_multicast_group drv_events_mcgrps[] = {
+    [DRV_EVENTS_GRP_BUTTON] = { .name = DRV_EVENTS_MCGRP_BUTTON },
+    [DRV_EVENTS_GRP_LED]    = { .name = DRV_EVENTS_MCGRP_LED },
+    [DRV_EVENTS_GRP_MISC]   = { .name = DRV_EVENTS_MCGRP_MISC },
+};
+
+static struct genl_family drv_events_family __ro_after_init = {
+    .name = DRV_EVENTS_FAMILY_NAME,
+    .version = DRV_EVENTS_VERSION,
+    .maxattr = DRV_EVENTS_A_MAX,
+    .module = THIS_MODULE,
+    .mcgrps = drv_events_mcgrps,
+    .n_mcgrps = ARRAY_SIZE(drv_events_mcgrps),
+};
+
+/**
+ * @brief Queue an event for a multicast group, any context
+ *
+ * Nothing is queued while the group has no listener. When the batch is full
+ * it is sent right away, otherwise after batch_ms.
+ */
+void drv_event_post(enum drv_events_group group, const char *source, u32 value)
+{
+    unsigned long flags;
+    int ret;
+
+    if (group >= DRV_EVENTS_GRP_MAX ||
+        !genl_has_listeners(&drv_events_family, &init_net, group))
+        return;
+
+    spin_lock_irqsave(&batch_lock, flags);
+    ret = drv_event_batch_add(active[group], source, value, ktime_get_ns());
+    spin_unlock_irqrestore(&batch_lock, flags);
+
+    if (ret < 0)
+        return;
+    if (ret)
+        mod_delayed_work(system_wq, &flush_work, 0);
+    else
+        schedule_delayed_work(&flush_work, msecs_to_jiffies(batch_ms));
+}
+EXPORT_SYMBOL_GPL(drv_event_post);
+
+/**
+ * @brief Build one message holding a whole batch
+ */
+static struct sk_buff *batch_to_msg(struct drv_event_batch *b)
+{
+    struct sk_buff *skb;
+    struct nlattr *nest;
+    void *hdr;
+    unsigned int i;
+
+    skb = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+    if (!skb)
+        return NULL;
+
+    hdr = genlmsg_put(skb, 0, 0, &drv_events_family, 0, DRV_EVENTS_CMD_EVENT);
+    if (!hdr)
+        goto err;
+
+    if (b->dropped && nla_put_u32(skb, DRV_EVENTS_A_DROPPED, b->dropped))
+        goto err;
+
+    for (i = 0; i < b->count; i++) {
+        nest = nla_nest_start(skb, DRV_EVENTS_A_EVENT);
+        if (!nest)
+            goto err;
+        if (nla_put_string(skb, DRV_EVENT_A_SOURCE, b->ev[i].source) ||
+            nla_put_u32(skb, DRV_EVENT_A_VALUE, b->ev[i].value) ||
+            nla_put_u64_64bit(skb, DRV_EVENT_A_TIME, b->ev[i].time_ns, DRV_EVENT_A_PAD))
+            goto err;
+        nla_nest_end(skb, nest);
+    }
+
+    genlmsg_end(skb, hdr);
+    return skb;
+
+err:
+    nlmsg_free(skb);
+    return NULL;
+}
+
+/**
+ * @brief Send every pending batch, one message per group
+ */
+static void flush_fn(struct work_struct *work)
+{
+    struct drv_event_batch *b;
+    struct sk_buff *skb;
+    int group;
+
+    for (group = 0; group < DRV_EVENTS_GRP_MAX; group++) {
+        spin_lock_irq(&batch_lock);
+        b = active[group];
+        if (!b->count && !b->dropped) {
+            spin_unlock_irq(&batch_lock);
+            continue;
+        }
+        active[group] = (b == &batches[group][0]) ? &batches[group][1] : &batches[group][0];
+        spin_unlock_irq(&batch_lock);
+
+        skb = batch_to_msg(b);
+        if (skb)
+            genlmsg_multicast(&drv_events_family, skb, 0, group, GFP_KERNEL);
+        else
+            pr_err("drv_events: Failed to build a message, %u events lost\n", b->count);
+
+        drv_event_batch_reset(b);
+    }
+}
+
+static int __init drv_events_init(void)
+{
+    int group, ret;
+
+    for (group = 0; group < DRV_EVENTS_GRP_MAX; group++)
+        active[group] = &batches[group][0];
+
+    ret = genl_register_family(&drv_events_family);
+    if (ret) {
+        pr_err("drv_events: Failed to register the family\n");
+        return ret;
+    }
+
+    pr_info("drv_events: Family '%s' registered\n", DRV_EVENTS_FAMILY_NAME);
+    return 0;
+}
+
+static void __exit drv_events_exit(void)
+{
+    cancel_delayed_work_sync(&flush_work);
+    genl_unregister_family(&drv_events_family);
+    pr_info("drv_events: Family '%s' unregistered\n", DRV_EVENTS_FAMILY_NAME);
+}
+
+module_init(drv_events_init);
+module_exit(drv_events_exit);
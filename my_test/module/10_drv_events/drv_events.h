@@ -0,0 +1,57 @@
+#ifndef __DRV_EVENTS_H__
+#define __DRV_EVENTS_H__
+
+/*
+ * Generic netlink family carrying driver events to user space.
+ *
+ * Every event goes to one multicast group. Events that arrive in a burst
+ * are sent together: one DRV_EVENTS_CMD_EVENT message holds several nested
+ * DRV_EVENTS_A_EVENT attributes, oldest first.
+ */
+
+#define DRV_EVENTS_FAMILY_NAME  "drv_events"
+#define DRV_EVENTS_VERSION      1
+
+#define DRV_EVENTS_MCGRP_BUTTON "button"
+#define DRV_EVENTS_MCGRP_LED    "led"
+#define DRV_EVENTS_MCGRP_MISC   "misc"
+
+#define DRV_EVENTS_SOURCE_LEN   16
+
+enum drv_events_group {
+    DRV_EVENTS_GRP_BUTTON,          // value = level after the edge
+    DRV_EVENTS_GRP_LED,             // value = new LED states, bit n = LED n
+    DRV_EVENTS_GRP_MISC,            // value = trigger payload
+    DRV_EVENTS_GRP_MAX,
+};
+
+enum {
+    DRV_EVENTS_CMD_UNSPEC,
+    DRV_EVENTS_CMD_EVENT,
+};
+
+/* Message attributes */
+enum {
+    DRV_EVENTS_A_UNSPEC,
+    DRV_EVENTS_A_EVENT,             // nested, DRV_EVENT_A_*
+    DRV_EVENTS_A_DROPPED,           // u32, events lost after the last one of this message
+    __DRV_EVENTS_A_MAX,
+};
+#define DRV_EVENTS_A_MAX (__DRV_EVENTS_A_MAX - 1)
+
+/* Attributes of one event */
+enum {
+    DRV_EVENT_A_UNSPEC,
+    DRV_EVENT_A_PAD,
+    DRV_EVENT_A_SOURCE,             // string, name of the device
+    DRV_EVENT_A_VALUE,              // u32
+    DRV_EVENT_A_TIME,               // u64, CLOCK_MONOTONIC in ns
+    __DRV_EVENT_A_MAX,
+};
+#define DRV_EVENT_A_MAX (__DRV_EVENT_A_MAX - 1)
+
+#ifdef __KERNEL__
+void drv_event_post(enum drv_events_group group, const char *source, u32 value);
+#endif
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __DRV_EVENTS_BATCH_H__
+#define __DRV_EVENTS_BATCH_H__
+
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include "drv_events.h"
+
+/*
+ * Events of one group collected until they are sent as one message, see
+ * drv_events.c. Nothing here locks, the caller serialises every access.
+ */
+
+#define BATCH_MAX 64
+
+struct drv_event {
+    char source[DRV_EVENTS_SOURCE_LEN];
+    u32 value;
+    u64 time_ns;
+};
+
+struct drv_event_batch {
+    struct drv_event ev[BATCH_MAX];
+    unsigned int count;
+    unsigned int dropped;
+};
+
+/**
+ * @brief Append an event
+ * @return 1 when the batch is now full, 0, or -ENOSPC when it was dropped
+ */
+static inline int drv_event_batch_add(struct drv_event_batch *b, const char *source,
+                                      u32 value, u64 time_ns)
+{
+    struct drv_event *ev;
+
+    if (b->count == BATCH_MAX) {
+        b->dropped++;
+        return -ENOSPC;
+    }
+    ev = &b->ev[b->count++];
+    strscpy(ev->source, source, sizeof(ev->source));
+    ev->value = value;
+    ev->time_ns = time_ns;
+    return b->count == BATCH_MAX;
+}
+
+/**
+ * @brief Empty a batch once it is sent
+ */
+static inline void drv_event_batch_reset(struct drv_event_batch *b)
+{
+    b->count = 0;
+    b->dropped = 0;
+}
+
+#endif
@@ -0,0 +1,164 @@
+/**
+ * Print every driver event from the drv_events generic netlink family
+ *
+ *   ./event_monitor [group ...]     (default: button led misc)
+ *
+ * One socket joins all the groups. Uses plain netlink sockets, no libnl.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include "../drv_events.h"
+
+#define BUF_SIZE 16384
+
+#define GENLMSG_DATA(nlh)   ((char *)NLMSG_DATA(nlh) + GENL_HDRLEN)
+#define NLA_DATA(nla)       ((char *)(nla) + NLA_HDRLEN)
+#define NLA_NEXT(nla)       ((struct nlattr *)((char *)(nla) + NLA_ALIGN((nla)->nla_len)))
+#define NLA_OK(nla, len)    ((len) >= (int)sizeof(struct nlattr) && \
+                             (nla)->nla_len >= sizeof(struct nlattr) && (nla)->nla_len <= (len))
+
+static char buf[BUF_SIZE];
+
+static const char *group_names[DRV_EVENTS_GRP_MAX] = {
+    [DRV_EVENTS_GRP_BUTTON] = DRV_EVENTS_MCGRP_BUTTON,
+    [DRV_EVENTS_GRP_LED]    = DRV_EVENTS_MCGRP_LED,
+    [DRV_EVENTS_GRP_MISC]   = DRV_EVENTS_MCGRP_MISC,
+};
+
+/* Sort the attributes of a stream by type */
+static void parse_attrs(struct nlattr *tb[], int max, struct nlattr *nla, int len) {
+    memset(tb, 0, sizeof(*tb) * (max + 1));
+    for (; NLA_OK(nla, len); len -= NLA_ALIGN(nla->nla_len), nla = NLA_NEXT(nla)) {
+        int type = nla->nla_type & NLA_TYPE_MASK;
+        if (type <= max)
+            tb[type] = nla;
+    }
+}
+
+static int send_getfamily(int sock) {
+    struct {
+        struct nlmsghdr n;
+        struct genlmsghdr g;
+        char attr[64];
+    } req = { 0 };
+    struct nlattr *nla = (struct nlattr *)req.attr;
+    struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+
+    nla->nla_type = CTRL_ATTR_FAMILY_NAME;
+    nla->nla_len = NLA_HDRLEN + sizeof(DRV_EVENTS_FAMILY_NAME);
+    strcpy(NLA_DATA(nla), DRV_EVENTS_FAMILY_NAME);
+
+    req.n.nlmsg_type = GENL_ID_CTRL;
+    req.n.nlmsg_flags = NLM_F_REQUEST;
+    req.n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN + NLA_ALIGN(nla->nla_len));
+    req.g.cmd = CTRL_CMD_GETFAMILY;
+    req.g.version = 1;
+
+    return sendto(sock, &req, req.n.nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel));
+}
+
+/* Look up the multicast group ids of the family, returns the family id */
+static int resolve_family(int sock, int group_id[]) {
+    struct nlattr *tb[CTRL_ATTR_MAX + 1], *grp[CTRL_ATTR_MCAST_GRP_MAX + 1], *nla;
+    struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+    int len, rem, i;
+
+    if (send_getfamily(sock) < 0 || (len = recv(sock, buf, sizeof(buf), 0)) < 0) {
+        perror("CTRL_CMD_GETFAMILY");
+        return -1;
+    }
+    if (!NLMSG_OK(nlh, len) || nlh->nlmsg_type == NLMSG_ERROR) {
+        fprintf(stderr, "Family '%s' not found, is drv_events loaded?\n", DRV_EVENTS_FAMILY_NAME);
+        return -1;
+    }
+
+    parse_attrs(tb, CTRL_ATTR_MAX, (struct nlattr *)GENLMSG_DATA(nlh),
+                nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN));
+    if (!tb[CTRL_ATTR_FAMILY_ID] || !tb[CTRL_ATTR_MCAST_GROUPS])
+        return -1;
+
+    nla = (struct nlattr *)NLA_DATA(tb[CTRL_ATTR_MCAST_GROUPS]);
+    rem = tb[CTRL_ATTR_MCAST_GROUPS]->nla_len - NLA_HDRLEN;
+    for (; NLA_OK(nla, rem); rem -= NLA_ALIGN(nla->nla_len), nla = NLA_NEXT(nla)) {
+        parse_attrs(grp, CTRL_ATTR_MCAST_GRP_MAX, (struct nlattr *)NLA_DATA(nla), nla->nla_len - NLA_HDRLEN);
+        if (!grp[CTRL_ATTR_MCAST_GRP_NAME] || !grp[CTRL_ATTR_MCAST_GRP_ID])
+            continue;
+        for (i = 0; i < DRV_EVENTS_GRP_MAX; i++) {
+            if (strcmp(NLA_DATA(grp[CTRL_ATTR_MCAST_GRP_NAME]), group_names[i]) == 0)
+                group_id[i] = *(uint32_t *)NLA_DATA(grp[CTRL_ATTR_MCAST_GRP_ID]);
+        }
+    }
+    return *(uint16_t *)NLA_DATA(tb[CTRL_ATTR_FAMILY_ID]);
+}
+
+static void print_message(struct nlmsghdr *nlh) {
+    struct nlattr *tb[DRV_EVENT_A_MAX + 1], *nla;
+    int len = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+    int events = 0;
+
+    nla = (struct nlattr *)GENLMSG_DATA(nlh);
+    for (; NLA_OK(nla, len); len -= NLA_ALIGN(nla->nla_len), nla = NLA_NEXT(nla)) {
+        switch (nla->nla_type & NLA_TYPE_MASK) {
+        case DRV_EVENTS_A_DROPPED:
+            printf("  %u event(s) dropped after the last one below\n", *(uint32_t *)NLA_DATA(nla));
+            break;
+        case DRV_EVENTS_A_EVENT:
+            parse_attrs(tb, DRV_EVENT_A_MAX, (struct nlattr *)NLA_DATA(nla), nla->nla_len - NLA_HDRLEN);
+            if (!tb[DRV_EVENT_A_SOURCE] || !tb[DRV_EVENT_A_VALUE] || !tb[DRV_EVENT_A_TIME])
+                break;
+            printf("  [%llu.%09llu] %-16s %u\n",
+                   (unsigned long long)(*(uint64_t *)NLA_DATA(tb[DRV_EVENT_A_TIME]) / 1000000000),
+                   (unsigned long long)(*(uint64_t *)NLA_DATA(tb[DRV_EVENT_A_TIME]) % 1000000000),
+                   NLA_DATA(tb[DRV_EVENT_A_SOURCE]), *(uint32_t *)NLA_DATA(tb[DRV_EVENT_A_VALUE]));
+            events++;
+            break;
+        }
+    }
+    printf("message with %d event(s)\n", events);
+}
+
+int main(int argc, char *argv[]) {
+    int group_id[DRV_EVENTS_GRP_MAX] = { 0 };
+    struct sockaddr_nl local = { .nl_family = AF_NETLINK };
+    struct nlmsghdr *nlh;
+    int sock, family, len, i, j;
+
+    sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        perror("netlink socket");
+        return 1;
+    }
+
+    family = resolve_family(sock, group_id);
+    if (family < 0)
+        return 1;
+
+    /* Join the groups */
+    for (i = 0; i < DRV_EVENTS_GRP_MAX; i++) {
+        int wanted = argc == 1;
+        for (j = 1; j < argc; j++)
+            wanted |= strcmp(argv[j], group_names[i]) == 0;
+        if (!wanted || !group_id[i])
+            continue;
+        if (setsockopt(sock, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group_id[i], sizeof(group_id[i])) < 0) {
+            perror(group_names[i]);
+            return 1;
+        }
+        printf("Joined group '%s' (%d)\n", group_names[i], group_id[i]);
+    }
+
+    while ((len = recv(sock, buf, sizeof(buf), 0)) > 0) {
+        for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == family)
+                print_message(nlh);
+        }
+    }
+    perror("recv");
+    return 1;
+}
@@ -0,0 +1,249 @@
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/interrupt.h>
+#include <linux/input.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+#include <linux/bitmap.h>
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Phan Hao");
+MODULE_DESCRIPTION("GPIO buttons as an input device");
+
+/*
+ * Every button line is one key of a single input device, so evtest,
+ * libinput or any evdev reader gets the presses from /dev/input/eventN with
+ * the kernel's own per-client buffers.
+ *
+ * An edge does not report anything by itself: it only arms the scan timer.
+ * When the timer fires, all lines are read with one array read and every
+ * key that changed is reported, followed by one SYN_REPORT. Edges closer
+ * than scan_us end up in the same report, and bounces in between are
+ * swallowed. The report carries the time of the first edge.
+ */
+
+#define DRIVER_NAME "gpio_buttons"
+#define MAX_BUTTONS 16
+
+static int gpios[MAX_BUTTONS] = { 529 };   // GPIO17
+static int nr_gpios = 1;
+module_param_array(gpios, int, &nr_gpios, 0444);
+MODULE_PARM_DESC(gpios, "GPIO numbers of the buttons");
+
+static unsigned int keys[MAX_BUTTONS] = { KEY_ENTER };
+static int nr_keys;
+module_param_array(keys, uint, &nr_keys, 0444);
+MODULE_PARM_DESC(keys, "Key code of every button, BTN_0 + n when missing");
+
+static bool active_low;
+module_param(active_low, bool, 0444);
+MODULE_PARM_DESC(active_low, "Buttons pull the line low when pressed");
+
+static unsigned int scan_us = 5000;
+module_param(scan_us, uint, 0644);
+MODULE_PARM_DESC(scan_us, "Edges within this window are one report (debounce)");
+
+typedef struct button_dev {
+    struct input_dev *input;
+    struct gpio_desc *descs[MAX_BUTTONS];
+    int irqs[MAX_BUTTONS];
+    unsigned int nr;
+    struct hrtimer scan_timer;
+    spinlock_t lock;                    // protects first_edge
+    ktime_t first_edge;                 // 0 = no scan pending
+    DECLARE_BITMAP(reported, MAX_BUTTONS);
+    u64 edges;
+    u64 reports;
+} button_dev;
+
+static button_dev btn;
+static unsigned int keymap[MAX_BUTTONS];   // changeable with EVIOCSKEYCODE
+
+/**
+ * @brief Scan timer - Report every key that changed since the last report
+ */
+static enum hrtimer_restart scan_fn(struct hrtimer *timer){
+    DECLARE_BITMAP(now, MAX_BUTTONS);
+    DECLARE_BITMAP(changed, MAX_BUTTONS);
+    unsigned long flags;
+    ktime_t stamp;
+    unsigned int i;
+
+    spin_lock_irqsave(&btn.lock, flags);
+    stamp = btn.first_edge;
+    btn.first_edge = 0;
+    spin_unlock_irqrestore(&btn.lock, flags);
+
+    // All buttons in one read, a chord is seen as a whole
+    if (gpiod_get_array_value(btn.nr, btn.descs, NULL, now))
+        return HRTIMER_NORESTART;
+    if (active_low)
+        bitmap_complement(now, now, btn.nr);
+
+    bitmap_xor(changed, now, btn.reported, btn.nr);
+    if (bitmap_empty(changed, btn.nr))
+        return HRTIMER_NORESTART;       // a bounce that came back
+
+    input_set_timestamp(btn.input, stamp);
+    for_each_set_bit(i, changed, btn.nr)
+        input_report_key(btn.input, keymap[i], test_bit(i, now));
+    input_sync(btn.input);
+
+    bitmap_copy(btn.reported, now, btn.nr);
+    btn.reports++;
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * @brief Edge on any button - Remember when, the scan timer reports it
+ */
+static irqreturn_t irq_callback(int irq, void *dev_id){
+    unsigned long flags;
+    bool arm = false;
+
+    spin_lock_irqsave(&btn.lock, flags);
+    btn.edges++;
+    if (!btn.first_edge) {
+        btn.first_edge = ktime_get();
+        arm = true;
+    }
+    spin_unlock_irqrestore(&btn.lock, flags);
+
+    // Later edges of the same burst join the pending report
+    if (arm)
+        hrtimer_start(&btn.scan_timer, ns_to_ktime((u64)scan_us * NSEC_PER_USEC), HRTIMER_MODE_REL);
+
+    return IRQ_HANDLED;
+}
+
+/**
+ * @brief Release the first n buttons
+ */
+static void buttons_free(unsigned int n){
+    while (n--) {
+        free_irq(btn.irqs[n], &btn);
+        gpio_free(gpios[n]);
+    }
+}
+
+/**
+ * @brief Request every button line and its interrupt
+ */
+static int buttons_request(void){
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < btn.nr; i++) {
+        ret = gpio_request(gpios[i], "btn_gpio");
+        if (ret) {
+            printk("ERROR: Fail to request gpio %d\n", gpios[i]);
+            goto err;
+        }
+        btn.descs[i] = gpio_to_desc(gpios[i]);
+        ret = gpiod_direction_input(btn.descs[i]);
+        if (ret) {
+            printk("ERROR: Fail to set gpio %d as input\n", gpios[i]);
+            goto gpio_err;
+        }
+        // The scan runs in timer context
+        if (gpiod_cansleep(btn.descs[i])) {
+            printk("ERROR: gpio %d can sleep, not supported\n", gpios[i]);
+            ret = -EINVAL;
+            goto gpio_err;
+        }
+        btn.irqs[i] = gpiod_to_irq(btn.descs[i]);
+        if (btn.irqs[i] < 0) {
+            printk("ERROR: Fail to get IRQ for GPIO %d\n", gpios[i]);
+            ret = btn.irqs[i];
+            goto gpio_err;
+        }
+        // Enabled once the input device is registered
+        ret = request_irq(btn.irqs[i], irq_callback, IRQF_TRIGGER_FALLING | IRQF_TRIGGER_RISING | IRQF_NO_AUTOEN,
+                          "btn_irq", &btn);
+        if (ret) {
+            printk("ERROR: Fail to register irq handler\n");
+            goto gpio_err;
+        }
+    }
+    return 0;
+
+gpio_err:
+    gpio_free(gpios[i]);
+err:
+    buttons_free(i);
+    return ret;
+}
+
+static int __init input_button_init(void){
+    unsigned int i;
+    int ret;
+
+    if (nr_gpios < 1) {
+        printk("ERROR: No button\n");
+        return -EINVAL;
+    }
+    btn.nr = nr_gpios;
+    spin_lock_init(&btn.lock);
+    hrtimer_init(&btn.scan_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    btn.scan_timer.function = scan_fn;
+
+    btn.input = input_allocate_device();
+    if (!btn.input) {
+        printk("ERROR: Fail to allocate input device\n");
+        return -ENOMEM;
+    }
+    btn.input->name = DRIVER_NAME;
+    btn.input->phys = DRIVER_NAME "/input0";
+    btn.input->id.bustype = BUS_HOST;
+
+    for (i = 0; i < btn.nr; i++) {
+        keymap[i] = i < nr_keys ? keys[i] : BTN_0 + i;
+        input_set_capability(btn.input, EV_KEY, keymap[i]);
+    }
+    btn.input->keycode = keymap;
+    btn.input->keycodesize = sizeof(keymap[0]);
+    btn.input->keycodemax = btn.nr;
+
+    ret = buttons_request();
+    if (ret)
+        goto input_err;
+
+    ret = input_register_device(btn.input);
+    if (ret) {
+        printk("ERROR: Fail to register input device\n");
+        goto btn_err;
+    }
+
+    // Start from the current levels, a key held at load is reported pressed
+    gpiod_get_array_value(btn.nr, btn.descs, NULL, btn.reported);
+    if (active_low)
+        bitmap_complement(btn.reported, btn.reported, btn.nr);
+    for_each_set_bit(i, btn.reported, btn.nr)
+        input_report_key(btn.input, keymap[i], 1);
+    input_sync(btn.input);
+
+    for (i = 0; i < btn.nr; i++)
+        enable_irq(btn.irqs[i]);
+
+    printk("INFO: %u button(s) as input device %s\n", btn.nr, DRIVER_NAME);
+    return 0;
+
+btn_err:
+    buttons_free(btn.nr);
+input_err:
+    input_free_device(btn.input);
+    return ret;
+}
+
+static void __exit input_button_exit(void){
+    buttons_free(btn.nr);
+    hrtimer_cancel(&btn.scan_timer);
+    input_unregister_device(btn.input);
+    printk("INFO: %llu edges in %llu reports\n", btn.edges, btn.reports);
+    printk("INFO: Module is removed\n");
+}
+
+module_init(input_button_init);
+module_exit(input_button_exit);
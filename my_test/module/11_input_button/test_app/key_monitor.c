@@ -0,0 +1,85 @@
+/**
+ * Print the reports of the gpio_buttons input device
+ *
+ *   ./key_monitor [/dev/input/eventN]
+ *
+ * Without a path, the first device named gpio_buttons is used. Every
+ * SYN_REPORT ends one report; keys pressed together show up in the same one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <linux/input.h>
+
+#define DEVICE_NAME "gpio_buttons"
+#define MAX_EVENTS 64
+
+static int open_by_name(const char *name) {
+    char path[64], dev_name[256];
+    int i, fd;
+
+    for (i = 0; i < 64; i++) {
+        snprintf(path, sizeof(path), "/dev/input/event%d", i);
+        fd = open(path, O_RDONLY | O_NONBLOCK);
+        if (fd < 0)
+            continue;
+        if (ioctl(fd, EVIOCGNAME(sizeof(dev_name)), dev_name) >= 0 && strcmp(dev_name, name) == 0) {
+            printf("Using %s\n", path);
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    struct input_event ev[MAX_EVENTS];
+    struct epoll_event pev = { .events = EPOLLIN };
+    int clk = CLOCK_MONOTONIC;
+    int fd, efd, n, i, keys = 0;
+
+    fd = argc > 1 ? open(argv[1], O_RDONLY | O_NONBLOCK) : open_by_name(DEVICE_NAME);
+    if (fd < 0) {
+        perror("Failed to open input device");
+        return 1;
+    }
+    /* Same clock as the kernel timestamps */
+    ioctl(fd, EVIOCSCLOCKID, &clk);
+
+    efd = epoll_create1(0);
+    pev.data.fd = fd;
+    if (efd < 0 || epoll_ctl(efd, EPOLL_CTL_ADD, fd, &pev) < 0) {
+        perror("epoll");
+        return 1;
+    }
+
+    for (;;) {
+        if (epoll_wait(efd, &pev, 1, -1) < 0) {
+            perror("epoll_wait");
+            return 1;
+        }
+        n = read(fd, ev, sizeof(ev));
+        if (n < 0)
+            continue;
+        for (i = 0; i < n / (int)sizeof(ev[0]); i++) {
+            if (ev[i].type == EV_KEY) {
+                printf("%s%d %s", keys ? ", " : "", ev[i].code, ev[i].value ? "down" : "up");
+                keys++;
+            } else if (ev[i].type == EV_SYN && ev[i].code == SYN_REPORT) {
+                printf("%s[%ld.%06ld] %d key(s)\n", keys ? "  " : "",
+                       (long)ev[i].input_event_sec, (long)ev[i].input_event_usec, keys);
+                keys = 0;
+            } else if (ev[i].type == EV_SYN && ev[i].code == SYN_DROPPED) {
+                printf("-- dropped, client too slow --\n");
+                keys = 0;
+            }
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
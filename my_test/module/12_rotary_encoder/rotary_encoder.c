@@ -0,0 +1,304 @@
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/io.h>
+#include <linux/uaccess.h>
+#include <linux/miscdevice.h>
+#include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/interrupt.h>
+#include <linux/workqueue.h>
+#include <linux/atomic.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/math64.h>
+#include "rotary_encoder.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Phan Hao");
+MODULE_DESCRIPTION("Quadrature rotary encoder decoder on two GPIO inputs");
+
+/*
+ * Both lines interrupt on both edges, like the button of 05_poll_waitqueue.
+ * The handler reads both levels and looks up the transition from the
+ * previous state in a table: one step either way, nothing, or illegal (both
+ * lines changed, an edge was missed). The A and B interrupts can run at the
+ * same time on two CPUs, so reading the levels and swapping the previous
+ * state is one critical section under quad_lock. Otherwise the later sample
+ * can be stored first and the older one decoded against it, which counts a
+ * step the wrong way or an error that never happened.
+ *
+ * Lines that can sleep (I2C/SPI expanders, gpio-sim) can not be read in the
+ * hard interrupt. If either channel is such a line, both get a threaded
+ * handler instead, which reads the levels with the _cansleep calls and
+ * serialises A and B on quad_mutex. Edges that come while the thread still
+ * runs are lost and show up as errors, so it only suits slow knobs.
+ *
+ * The counters live in one page that readers can mmap, see rotary_encoder.h.
+ */
+
+#define DEV_NAME "rotary_encoder"
+
+static int gpio_a = 535;    // GPIO23
+module_param(gpio_a, int, 0444);
+MODULE_PARM_DESC(gpio_a, "GPIO number of channel A");
+
+static int gpio_b = 536;    // GPIO24
+module_param(gpio_b, int, 0444);
+MODULE_PARM_DESC(gpio_b, "GPIO number of channel B");
+
+static unsigned int velocity_ms = 100;
+module_param(velocity_ms, uint, 0644);
+MODULE_PARM_DESC(velocity_ms, "Window of the velocity measurement");
+
+/* Kernel view of the shared page, same layout as rotary_state */
+typedef struct rotary_page {
+    atomic64_t position;
+    atomic64_t transitions;
+    atomic64_t errors;
+    atomic64_t velocity;
+} rotary_page;
+
+#define QUAD_ERR 2
+
+/*
+ * Index: previous state << 2 | new state, state = A << 1 | B.
+ * Clockwise is 00 -> 01 -> 11 -> 10 -> 00.
+ */
+static const s8 quad_table[16] = {
+    0,          +1,         -1,         QUAD_ERR,
+    -1,         0,          QUAD_ERR,   +1,
+    +1,         QUAD_ERR,   0,          -1,
+    QUAD_ERR,   -1,         +1,         0,
+};
+
+static rotary_page *shared;         // one zeroed page
+static struct gpio_desc *desc_a, *desc_b;
+static int irq_a, irq_b;
+static bool quad_sleeps;            // a channel can sleep, threaded handlers
+static DEFINE_RAW_SPINLOCK(quad_lock);  // hard interrupt path
+static DEFINE_MUTEX(quad_mutex);        // threaded path
+static int quad_state;              // A << 1 | B at the last edge, under one of them
+static s64 last_position;
+
+static void velocity_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(velocity_work, velocity_fn);
+
+/**
+ * @brief Count the transition from prev to cur, any context
+ */
+static void quad_count(int prev, int cur){
+    s8 step = quad_table[prev << 2 | cur];
+
+    if (step == QUAD_ERR) {
+        atomic64_inc(&shared->errors);
+    } else if (step) {
+        atomic64_add(step, &shared->position);
+        atomic64_inc(&shared->transitions);
+    }
+}
+
+/**
+ * @brief Edge on A or B - Decode one transition, no printk
+ */
+static irqreturn_t quad_irq(int irq, void *dev_id){
+    unsigned long flags;
+    int cur, prev;
+
+    raw_spin_lock_irqsave(&quad_lock, flags);
+    cur = gpiod_get_raw_value(desc_a) << 1 | gpiod_get_raw_value(desc_b);
+    prev = quad_state;
+    quad_state = cur;
+    raw_spin_unlock_irqrestore(&quad_lock, flags);
+
+    quad_count(prev, cur);
+    return IRQ_HANDLED;
+}
+
+/**
+ * @brief Edge on A or B of lines that can sleep - Same as quad_irq()
+ */
+static irqreturn_t quad_irq_thread(int irq, void *dev_id){
+    int cur, prev;
+
+    mutex_lock(&quad_mutex);
+    cur = gpiod_get_raw_value_cansleep(desc_a) << 1 | gpiod_get_raw_value_cansleep(desc_b);
+    prev = quad_state;
+    quad_state = cur;
+    mutex_unlock(&quad_mutex);
+
+    quad_count(prev, cur);
+    return IRQ_HANDLED;
+}
+
+/**
+ * @brief Velocity over the last window, in quarter steps per second
+ */
+static void velocity_fn(struct work_struct *work){
+    unsigned int ms = max(READ_ONCE(velocity_ms), 1U);
+    s64 pos = atomic64_read(&shared->position);
+
+    atomic64_set(&shared->velocity, div_s64((pos - last_position) * MSEC_PER_SEC, ms));
+    last_position = pos;
+    schedule_delayed_work(&velocity_work, msecs_to_jiffies(ms));
+}
+
+/**
+ * @brief Read - One rotary_state snapshot per call
+ */
+static ssize_t dev_read(struct file *file, char __user *buf, size_t count, loff_t *offset){
+    rotary_state st;
+
+    if (count < sizeof(st))
+        return -EINVAL;
+
+    st.position = atomic64_read(&shared->position);
+    st.transitions = atomic64_read(&shared->transitions);
+    st.errors = atomic64_read(&shared->errors);
+    st.velocity = atomic64_read(&shared->velocity);
+    if (copy_to_user(buf, &st, sizeof(st)))
+        return -EFAULT;
+    return sizeof(st);
+}
+
+/**
+ * @brief Mmap - The shared page, read-only
+ */
+static int dev_mmap(struct file *file, struct vm_area_struct *vma){
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
+        return -EINVAL;
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    vm_flags_clear(vma, VM_MAYWRITE);
+
+    return remap_pfn_range(vma, vma->vm_start, virt_to_phys(shared) >> PAGE_SHIFT,
+                           PAGE_SIZE, vma->vm_page_prot);
+}
+
+static const struct file_operations rotary_fops = {
+    .owner = THIS_MODULE,
+    .read = dev_read,
+    .mmap = dev_mmap,
+    .llseek = noop_llseek,
+};
+
+static struct miscdevice rotary_dev = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name  = DEV_NAME,
+    .fops  = &rotary_fops,
+};
+
+/**
+ * @brief Request one channel as an input and find its interrupt
+ */
+static int channel_request(int gpio, const char *label, struct gpio_desc **desc, int *irq){
+    int ret;
+
+    ret = gpio_request(gpio, label);
+    if (ret) {
+        printk("ERROR: Fail to request gpio %d\n", gpio);
+        return ret;
+    }
+    *desc = gpio_to_desc(gpio);
+    ret = gpiod_direction_input(*desc);
+    if (ret) {
+        printk("ERROR: Fail to set gpio %d as input\n", gpio);
+        goto err;
+    }
+    *irq = gpiod_to_irq(*desc);
+    if (*irq < 0) {
+        printk("ERROR: Fail to get IRQ for GPIO %d\n", gpio);
+        ret = *irq;
+        goto err;
+    }
+    return 0;
+
+err:
+    gpio_free(gpio);
+    return ret;
+}
+
+/**
+ * @brief Both-edge interrupt of one channel, enabled once both are ready
+ */
+static int channel_irq(int irq, const char *label){
+    unsigned long flags = IRQF_TRIGGER_FALLING | IRQF_TRIGGER_RISING | IRQF_NO_AUTOEN;
+    int ret;
+
+    if (quad_sleeps)
+        ret = request_threaded_irq(irq, NULL, quad_irq_thread, flags | IRQF_ONESHOT, label, NULL);
+    else
+        ret = request_irq(irq, quad_irq, flags, label, NULL);
+    if (ret)
+        printk("ERROR: Fail to register irq handler\n");
+    return ret;
+}
+
+static int __init rotary_init(void){
+    int ret;
+
+    BUILD_BUG_ON(sizeof(rotary_page) != sizeof(rotary_state));
+
+    shared = (rotary_page *)get_zeroed_page(GFP_KERNEL);
+    if (!shared)
+        return -ENOMEM;
+
+    ret = channel_request(gpio_a, "enc_a", &desc_a, &irq_a);
+    if (ret)
+        goto page_err;
+    ret = channel_request(gpio_b, "enc_b", &desc_b, &irq_b);
+    if (ret)
+        goto a_err;
+
+    // Both channels share quad_state, so both take the same path
+    quad_sleeps = gpiod_cansleep(desc_a) || gpiod_cansleep(desc_b);
+    ret = channel_irq(irq_a, "enc_a");
+    if (ret)
+        goto b_err;
+    ret = channel_irq(irq_b, "enc_b");
+    if (ret)
+        goto irq_a_err;
+
+    ret = misc_register(&rotary_dev);
+    if (ret) {
+        printk("ERROR: Fail to register misc device\n");
+        goto irq_b_err;
+    }
+
+    quad_state = gpiod_get_raw_value_cansleep(desc_a) << 1 | gpiod_get_raw_value_cansleep(desc_b);
+    enable_irq(irq_a);
+    enable_irq(irq_b);
+    schedule_delayed_work(&velocity_work, msecs_to_jiffies(velocity_ms));
+
+    printk("INFO: Encoder on gpio %d/%d as /dev/%s%s\n", gpio_a, gpio_b, DEV_NAME,
+           quad_sleeps ? ", threaded" : "");
+    return 0;
+
+irq_b_err:
+    free_irq(irq_b, NULL);
+irq_a_err:
+    free_irq(irq_a, NULL);
+b_err:
+    gpio_free(gpio_b);
+a_err:
+    gpio_free(gpio_a);
+page_err:
+    free_page((unsigned long)shared);
+    return ret;
+}
+
+static void __exit rotary_exit(void){
+    free_irq(irq_b, NULL);
+    free_irq(irq_a, NULL);
+    gpio_free(gpio_b);
+    gpio_free(gpio_a);
+    cancel_delayed_work_sync(&velocity_work);
+    misc_deregister(&rotary_dev);
+    printk("INFO: %lld transitions, %lld errors\n",
+           (long long)atomic64_read(&shared->transitions), (long long)atomic64_read(&shared->errors));
+    free_page((unsigned long)shared);
+}
+
+module_init(rotary_init);
+module_exit(rotary_exit);
@@ -0,0 +1,27 @@
+#ifndef __ROTARY_ENCODER_H__
+#define __ROTARY_ENCODER_H__
+
+#include <linux/types.h>
+
+/*
+ * State of /dev/rotary_encoder. read() returns one rotary_state, mmap()
+ * maps it read-only at offset 0 of a page that the interrupt updates in
+ * place. Every field is a naturally aligned 64-bit value, load it with a
+ * single 64-bit read.
+ *
+ * The decoder is not lock-free: the A and B handlers serialise on
+ * quad_lock (a raw spinlock, or quad_mutex when the lines can sleep) to
+ * sample both lines and swap the previous state. Readers take no lock,
+ * the fields are updated atomically one by one, so two fields read one
+ * after the other can be from different edges.
+ */
+typedef struct rotary_state {
+    __s64 position;         // quarter steps, clockwise is positive
+    __u64 transitions;      // valid transitions
+    __u64 errors;           // illegal transitions, a state was missed
+    __s64 velocity;         // quarter steps per second over the last window
+} rotary_state;
+
+#define ROTARY_STATE_SIZE sizeof(rotary_state)
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * Drive a quadrature sequence into the encoder through gpio-sim and check
+ * what the driver counted
+ *
+ *   ./sim_quad <sim_gpio_dir_a> <sim_gpio_dir_b> <quarter_steps>
+ *
+ * Normally started by sim_test.sh. A negative count turns backwards.
+ *
+ * Every quarter step waits until the driver counted the previous one, so a
+ * threaded handler (gpio-sim lines can sleep) is never handed two edges at
+ * once. The rate printed is what the whole loop managed, not a limit of
+ * the decoder.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "../rotary_encoder.h"
+
+#define DEVICE_PATH "/dev/rotary_encoder"
+
+/* Clockwise gray sequence, state = A << 1 | B */
+static const int gray[4] = { 0, 1, 3, 2 };
+
+static int open_pull(const char *dir) {
+    char path[256];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/pull", dir);
+    fd = open(path, O_WRONLY);
+    if (fd < 0) {
+        perror(path);
+        exit(2);
+    }
+    return fd;
+}
+
+static void set_line(int fd, int level) {
+    const char *val = level ? "pull-up" : "pull-down";
+
+    if (pwrite(fd, val, strlen(val), 0) < 0) {
+        perror("pull");
+        exit(2);
+    }
+}
+
+static double elapsed(const struct timespec *t0) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - t0->tv_sec) + (t.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/* Wait until the driver saw want transitions or an error, 1 s at most */
+static int wait_counted(volatile const rotary_state *st, long long want, long long err0) {
+    struct timespec t0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while ((long long)st->transitions < want && (long long)st->errors == err0) {
+        if (elapsed(&t0) > 1.0)
+            return -1;
+        sched_yield();
+    }
+    return (long long)st->errors == err0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    volatile const rotary_state *st;
+    struct timespec t0, t1;
+    long long steps, pos0, err0, tr0, i;
+    int fd_a, fd_b, dev, idx = 0, state, dir;
+    double secs;
+
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <sim_gpio_a> <sim_gpio_b> <quarter_steps>\n", argv[0]);
+        return 2;
+    }
+    fd_a = open_pull(argv[1]);
+    fd_b = open_pull(argv[2]);
+    steps = atoll(argv[3]);
+    dir = steps < 0 ? 3 : 1;
+
+    dev = open(DEVICE_PATH, O_RDONLY);
+    if (dev < 0) {
+        perror("Failed to open device");
+        return 2;
+    }
+    st = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, dev, 0);
+    if (st == MAP_FAILED) {
+        perror("mmap");
+        return 2;
+    }
+
+    /* Start from 00 */
+    set_line(fd_a, 0);
+    set_line(fd_b, 0);
+    usleep(10000);
+    pos0 = st->position;
+    err0 = st->errors;
+    tr0 = st->transitions;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < llabs(steps); i++) {
+        idx = (idx + dir) & 3;
+        state = gray[idx];
+        /* Only one line changes per quarter step */
+        if ((state ^ gray[(idx - dir) & 3]) & 2)
+            set_line(fd_a, state >> 1);
+        else
+            set_line(fd_b, state & 1);
+        if (wait_counted(st, tr0 + i + 1, err0)) {
+            printf("quarter step %lld not counted\n", i);
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    usleep(10000);
+
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%lld transitions in %.3f s (%.0f/s)\n", llabs(steps), secs, llabs(steps) / secs);
+    printf("position %+lld (expected %+lld), errors %lld, velocity %lld/s\n",
+           (long long)st->position - pos0, steps, (long long)st->errors - err0, (long long)st->velocity);
+
+    if (st->position - pos0 != steps || st->errors != err0) {
+        printf("FAIL\n");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
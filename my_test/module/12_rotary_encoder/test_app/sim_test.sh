@@ -0,0 +1,36 @@
+#!/bin/sh
+# Test 12_rotary_encoder against a gpio-sim chip with two lines
+#
+#   sudo ./sim_test.sh [quarter_steps]
+#
+# Needs CONFIG_GPIO_SIM, CONFIG_GPIO_SYSFS and configfs mounted.
+# gpio-sim lines can sleep, so this runs the threaded handlers of the
+# driver; the hard interrupt path needs lines of a SoC GPIO controller.
+set -e
+
+STEPS=${1:-100000}
+CFG=/sys/kernel/config/gpio-sim/enc
+HERE=$(dirname "$0")
+
+cleanup() {
+    rmmod rotary_encoder 2>/dev/null || true
+    [ -d $CFG ] || return 0
+    echo 0 > $CFG/live
+    rmdir $CFG/bank0 $CFG
+}
+trap cleanup EXIT
+
+modprobe gpio-sim
+mkdir $CFG $CFG/bank0
+echo 2 > $CFG/bank0/num_lines
+echo 1 > $CFG/live
+
+DEV=$(cat $CFG/dev_name)
+CHIP=$(cat $CFG/bank0/chip_name)
+BASE=$(cat /sys/devices/platform/$DEV/$CHIP/gpio/gpiochip*/base)
+SIM=/sys/devices/platform/$DEV/$CHIP
+
+insmod $HERE/../rotary_encoder.ko gpio_a=$BASE gpio_b=$((BASE + 1))
+
+$HERE/sim_quad $SIM/sim_gpio0 $SIM/sim_gpio1 $STEPS
+$HERE/sim_quad $SIM/sim_gpio0 $SIM/sim_gpio1 -$STEPS
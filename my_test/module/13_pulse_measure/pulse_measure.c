@@ -0,0 +1,318 @@
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/miscdevice.h>
+#include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/interrupt.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/math64.h>
+#include <linux/device.h>
+#include "pulse_measure.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Phan Hao");
+MODULE_DESCRIPTION("Pulse width, period and duty cycle of a GPIO input");
+
+/*
+ * The input interrupts on both edges. The handler takes a timestamp, reads
+ * the level and adds the time since the previous edges to the running
+ * min/max/sum of the window: a few additions and compares per edge, no
+ * matter how fast the input is.
+ *
+ * A timer closes the window every window_ms. The result is read as a
+ * pulse_window from /dev/pulse_measure, or as text from the sysfs files of
+ * the device (/sys/class/misc/pulse_measure/).
+ */
+
+#define DEV_NAME "pulse_measure"
+
+static int gpio = 529;      // GPIO17
+module_param(gpio, int, 0444);
+MODULE_PARM_DESC(gpio, "GPIO number of the input");
+
+static unsigned int window_ms = 1000;
+module_param(window_ms, uint, 0644);
+MODULE_PARM_DESC(window_ms, "Length of a measurement window");
+
+/* Running statistics of one kind of interval */
+typedef struct pulse_acc {
+    u64 count;
+    u64 min;
+    u64 max;
+    u64 sum;
+} pulse_acc;
+
+typedef struct pulse_dev {
+    struct gpio_desc *desc;
+    int irq;
+    struct hrtimer window_timer;
+    wait_queue_head_t wq;
+
+    spinlock_t lock;                // everything below
+    int level;                      // level after the last edge
+    u64 last_rise;                  // 0 = not seen yet
+    u64 last_fall;
+    u64 window_start;
+    u64 edges;
+    u64 missed;
+    pulse_acc period, high, low;
+    pulse_window result;            // last complete window
+} pulse_dev;
+
+static pulse_dev pdev;
+
+static inline void acc_add(pulse_acc *acc, u64 ns){
+    if (!acc->count || ns < acc->min)
+        acc->min = ns;
+    if (ns > acc->max)
+        acc->max = ns;
+    acc->sum += ns;
+    acc->count++;
+}
+
+static void acc_close(pulse_acc *acc, pulse_stat *st){
+    st->count = acc->count;
+    st->min_ns = acc->min;
+    st->max_ns = acc->max;
+    st->mean_ns = acc->count ? div64_u64(acc->sum, acc->count) : 0;
+    memset(acc, 0, sizeof(*acc));
+}
+
+/**
+ * @brief Edge - Timestamp it and update the window, constant time
+ */
+static irqreturn_t pulse_irq(int irq, void *dev_id){
+    u64 now = ktime_get_ns();
+    int level = gpiod_get_raw_value(pdev.desc);
+
+    spin_lock(&pdev.lock);
+    pdev.edges++;
+    if (level == pdev.level) {
+        // The opposite edge was lost, the intervals around it are wrong
+        pdev.missed++;
+        pdev.last_rise = pdev.last_fall = 0;
+    } else if (level) {
+        if (pdev.last_rise)
+            acc_add(&pdev.period, now - pdev.last_rise);
+        if (pdev.last_fall)
+            acc_add(&pdev.low, now - pdev.last_fall);
+        pdev.last_rise = now;
+    } else {
+        if (pdev.last_rise)
+            acc_add(&pdev.high, now - pdev.last_rise);
+        pdev.last_fall = now;
+    }
+    pdev.level = level;
+    spin_unlock(&pdev.lock);
+
+    return IRQ_HANDLED;
+}
+
+/**
+ * @brief Window timer - Publish the window and start the next one
+ */
+static enum hrtimer_restart window_fn(struct hrtimer *timer){
+    unsigned int ms = max(READ_ONCE(window_ms), 1U);
+    pulse_window *res = &pdev.result;
+    u64 now = ktime_get_ns();
+    u64 high_sum, period_sum;
+    unsigned long flags;
+
+    spin_lock_irqsave(&pdev.lock, flags);
+    res->seq++;
+    res->start_ns = pdev.window_start;
+    res->len_ns = now - pdev.window_start;
+    res->edges = pdev.edges;
+    res->missed = pdev.missed;
+    high_sum = pdev.high.sum;
+    period_sum = pdev.period.sum;
+    acc_close(&pdev.period, &res->period);
+    acc_close(&pdev.high, &res->high);
+    acc_close(&pdev.low, &res->low);
+    res->freq_mhz = res->period.mean_ns ? div64_u64(NSEC_PER_SEC * 1000ULL, res->period.mean_ns) : 0;
+    res->duty_permille = period_sum ? div64_u64(high_sum * 1000, period_sum) : 0;
+    pdev.window_start = now;
+    pdev.edges = 0;
+    pdev.missed = 0;
+    spin_unlock_irqrestore(&pdev.lock, flags);
+
+    wake_up_interruptible(&pdev.wq);
+    hrtimer_forward_now(timer, ms_to_ktime(ms));
+    return HRTIMER_RESTART;
+}
+
+static void result_get(pulse_window *res){
+    spin_lock_irq(&pdev.lock);
+    *res = pdev.result;
+    spin_unlock_irq(&pdev.lock);
+}
+
+static u64 result_seq(void){
+    u64 seq;
+
+    spin_lock_irq(&pdev.lock);
+    seq = pdev.result.seq;
+    spin_unlock_irq(&pdev.lock);
+    return seq;
+}
+
+/**
+ * @brief Read - The next complete window, the file position is its number
+ */
+static ssize_t dev_read(struct file *file, char __user *buf, size_t count, loff_t *offset){
+    pulse_window res;
+    int ret;
+
+    if (count < sizeof(res))
+        return -EINVAL;
+
+    if (result_seq() <= *offset) {
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(pdev.wq, result_seq() > *offset);
+        if (ret)
+            return ret;
+    }
+
+    result_get(&res);
+    if (copy_to_user(buf, &res, sizeof(res)))
+        return -EFAULT;
+    *offset = res.seq;
+    return sizeof(res);
+}
+
+static const struct file_operations pulse_fops = {
+    .owner = THIS_MODULE,
+    .read = dev_read,
+    .llseek = noop_llseek,
+};
+
+/* sysfs, values of the last complete window */
+static ssize_t freq_mhz_show(struct device *dev, struct device_attribute *attr, char *buf){
+    pulse_window res;
+
+    result_get(&res);
+    return sysfs_emit(buf, "%llu\n", res.freq_mhz);
+}
+static DEVICE_ATTR_RO(freq_mhz);
+
+static ssize_t duty_permille_show(struct device *dev, struct device_attribute *attr, char *buf){
+    pulse_window res;
+
+    result_get(&res);
+    return sysfs_emit(buf, "%u\n", res.duty_permille);
+}
+static DEVICE_ATTR_RO(duty_permille);
+
+static ssize_t edges_show(struct device *dev, struct device_attribute *attr, char *buf){
+    pulse_window res;
+
+    result_get(&res);
+    return sysfs_emit(buf, "%llu %llu\n", res.edges, res.missed);
+}
+static DEVICE_ATTR_RO(edges);
+
+/* "count min mean max" in ns */
+#define PULSE_STAT_ATTR(_name)                                                          \
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf){ \
+    pulse_window res;                                                                   \
+                                                                                        \
+    result_get(&res);                                                                   \
+    return sysfs_emit(buf, "%llu %llu %llu %llu\n", res._name.count, res._name.min_ns,  \
+                      res._name.mean_ns, res._name.max_ns);                             \
+}                                                                                       \
+static DEVICE_ATTR_RO(_name)
+
+PULSE_STAT_ATTR(period);
+PULSE_STAT_ATTR(high);
+PULSE_STAT_ATTR(low);
+
+static struct attribute *pulse_attrs[] = {
+    &dev_attr_freq_mhz.attr,
+    &dev_attr_duty_permille.attr,
+    &dev_attr_edges.attr,
+    &dev_attr_period.attr,
+    &dev_attr_high.attr,
+    &dev_attr_low.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(pulse);
+
+static struct miscdevice pulse_misc = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name  = DEV_NAME,
+    .fops  = &pulse_fops,
+    .groups = pulse_groups,
+};
+
+static int __init pulse_init(void){
+    int ret;
+
+    spin_lock_init(&pdev.lock);
+    init_waitqueue_head(&pdev.wq);
+    hrtimer_init(&pdev.window_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    pdev.window_timer.function = window_fn;
+
+    ret = gpio_request(gpio, "pulse_gpio");
+    if (ret) {
+        printk("ERROR: Fail to request gpio %d\n", gpio);
+        return ret;
+    }
+    pdev.desc = gpio_to_desc(gpio);
+    ret = gpiod_direction_input(pdev.desc);
+    if (ret) {
+        printk("ERROR: Fail to set gpio %d as input\n", gpio);
+        goto gpio_err;
+    }
+    // The level is read in the hard interrupt
+    if (gpiod_cansleep(pdev.desc)) {
+        printk("ERROR: gpio %d can sleep, not supported\n", gpio);
+        ret = -EINVAL;
+        goto gpio_err;
+    }
+    pdev.irq = gpiod_to_irq(pdev.desc);
+    if (pdev.irq < 0) {
+        printk("ERROR: Fail to get IRQ for GPIO %d\n", gpio);
+        ret = pdev.irq;
+        goto gpio_err;
+    }
+
+    ret = misc_register(&pulse_misc);
+    if (ret) {
+        printk("ERROR: Fail to register misc device\n");
+        goto gpio_err;
+    }
+
+    pdev.level = gpiod_get_raw_value(pdev.desc);
+    pdev.window_start = ktime_get_ns();
+    ret = request_irq(pdev.irq, pulse_irq, IRQF_TRIGGER_FALLING | IRQF_TRIGGER_RISING, "pulse_irq", NULL);
+    if (ret) {
+        printk("ERROR: Fail to register irq handler\n");
+        goto misc_err;
+    }
+    hrtimer_start(&pdev.window_timer, ms_to_ktime(max(window_ms, 1U)), HRTIMER_MODE_REL);
+
+    printk("INFO: Measuring gpio %d as /dev/%s\n", gpio, DEV_NAME);
+    return 0;
+
+misc_err:
+    misc_deregister(&pulse_misc);
+gpio_err:
+    gpio_free(gpio);
+    return ret;
+}
+
+static void __exit pulse_exit(void){
+    free_irq(pdev.irq, NULL);
+    hrtimer_cancel(&pdev.window_timer);
+    misc_deregister(&pulse_misc);
+    gpio_free(gpio);
+    printk("INFO: Module is removed\n");
+}
+
+module_init(pulse_init);
+module_exit(pulse_exit);
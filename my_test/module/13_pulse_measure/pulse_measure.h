@@ -0,0 +1,32 @@
+#ifndef __PULSE_MEASURE_H__
+#define __PULSE_MEASURE_H__
+
+#include <linux/types.h>
+
+/*
+ * Measurement of /dev/pulse_measure over one window. read() blocks until a
+ * window newer than the last one read by this file is complete, then
+ * returns one pulse_window (O_NONBLOCK: the latest one, or -EAGAIN).
+ */
+typedef struct pulse_stat {
+    __u64 count;            // 0 = no pulse in the window, the rest is 0 too
+    __u64 min_ns;
+    __u64 max_ns;
+    __u64 mean_ns;
+} pulse_stat;
+
+typedef struct pulse_window {
+    __u64 seq;              // window number, starts at 1
+    __u64 start_ns;         // CLOCK_MONOTONIC
+    __u64 len_ns;
+    __u64 edges;
+    __u64 missed;           // edges seen at the same level, one was lost
+    pulse_stat period;      // rising edge to rising edge
+    pulse_stat high;        // rising edge to falling edge
+    pulse_stat low;         // falling edge to rising edge
+    __u64 freq_mhz;         // 1000 / mean period
+    __u32 duty_permille;    // high time / period time
+    __u32 pad;
+} pulse_window;
+
+#endif
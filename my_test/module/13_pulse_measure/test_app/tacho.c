@@ -0,0 +1,43 @@
+/**
+ * Print every measurement window of /dev/pulse_measure
+ *
+ *   ./tacho [pulses_per_rev]
+ *
+ * With pulses_per_rev (fan tachometers give 2) the speed is printed in RPM.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../pulse_measure.h"
+
+#define DEVICE_PATH "/dev/pulse_measure"
+
+int main(int argc, char *argv[]) {
+    int ppr = argc > 1 ? atoi(argv[1]) : 0;
+    pulse_window w;
+    int fd;
+
+    fd = open(DEVICE_PATH, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return 1;
+    }
+
+    /* Every read blocks until the next window is complete */
+    while (read(fd, &w, sizeof(w)) == sizeof(w)) {
+        printf("#%llu %llu edges (%llu missed)  %llu.%03llu Hz  duty %u.%u%%",
+               (unsigned long long)w.seq, (unsigned long long)w.edges, (unsigned long long)w.missed,
+               (unsigned long long)w.freq_mhz / 1000, (unsigned long long)w.freq_mhz % 1000,
+               w.duty_permille / 10, w.duty_permille % 10);
+        if (ppr > 0)
+            printf("  %llu rpm", (unsigned long long)w.freq_mhz * 60 / 1000 / ppr);
+        printf("\n  period min/mean/max %llu/%llu/%llu ns, high %llu/%llu/%llu ns\n",
+               (unsigned long long)w.period.min_ns, (unsigned long long)w.period.mean_ns,
+               (unsigned long long)w.period.max_ns, (unsigned long long)w.high.min_ns,
+               (unsigned long long)w.high.mean_ns, (unsigned long long)w.high.max_ns);
+        fflush(stdout);
+    }
+    perror("read");
+    return 1;
+}
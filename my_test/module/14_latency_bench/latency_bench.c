@@ -0,0 +1,343 @@
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/hrtimer.h>
+#include <linux/sched.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/interrupt.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include "rt_hist.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Phan Hao");
+MODULE_DESCRIPTION("Cyclictest-like wakeup latency benchmark");
+
+/*
+ * One measurement thread per online CPU, bound to it and SCHED_FIFO. Each
+ * sleeps until start + n * period_us and records how late it woke up in a
+ * histogram of its own CPU: no lock and no shared cache line between CPUs.
+ *
+ *   cat /sys/kernel/debug/latency_bench/histogram     one column per CPU
+ *   cat /sys/kernel/debug/latency_bench/load          what the load did
+ *   echo 0 > /sys/kernel/debug/latency_bench/histogram     (reset)
+ *
+ * Optional load, to see what a driver pattern costs the rest of the system:
+ *  - lock_threads threads fighting over one lock like 07_mutex_semaphore,
+ *    each holds it for lock_hold_us. With lock_irqsoff the lock is a
+ *    spinlock taken with interrupts off, which delays the timer interrupts.
+ *  - storm_gpio: an interrupt on both edges of that line, busy for
+ *    storm_cost_ns. Drive it from a gpio-sim line, see test_app/storm.sh.
+ *
+ * CPUs that come online after the module is loaded are not measured.
+ */
+
+static unsigned int period_us = 1000;
+module_param(period_us, uint, 0644);
+MODULE_PARM_DESC(period_us, "Wakeup period of the measurement threads");
+
+static int rt_prio = 80;
+module_param(rt_prio, int, 0444);
+MODULE_PARM_DESC(rt_prio, "SCHED_FIFO priority of the measurement threads");
+
+static unsigned int lock_threads;
+module_param(lock_threads, uint, 0444);
+MODULE_PARM_DESC(lock_threads, "Load: threads contending for one lock");
+
+static unsigned int lock_hold_us = 50;
+module_param(lock_hold_us, uint, 0644);
+MODULE_PARM_DESC(lock_hold_us, "Load: time the lock is held");
+
+static bool lock_irqsoff;
+module_param(lock_irqsoff, bool, 0444);
+MODULE_PARM_DESC(lock_irqsoff, "Load: spinlock with interrupts off instead of a mutex");
+
+static int storm_gpio = -1;
+module_param(storm_gpio, int, 0444);
+MODULE_PARM_DESC(storm_gpio, "Load: GPIO number that interrupts on both edges, -1 = none");
+
+static unsigned int storm_cost_ns = 2000;
+module_param(storm_cost_ns, uint, 0644);
+MODULE_PARM_DESC(storm_cost_ns, "Load: busy time of every storm interrupt");
+
+/* Measurement of one CPU, only written by its thread */
+struct lat_cpu {
+    struct task_struct *thread;
+    struct rt_hist hist;
+};
+
+static struct lat_cpu __percpu *lat_cpus;   // 8 KB each, too big for a module DEFINE_PER_CPU
+static struct dentry *debug_dir;
+
+/* Load */
+static struct task_struct **lock_tasks;
+static DEFINE_MUTEX(load_mutex);
+static DEFINE_SPINLOCK(load_spin);
+static atomic64_t lock_rounds;
+static int storm_irq = -1;
+static atomic64_t storm_count;
+
+/**
+ * @brief Measurement thread, one per CPU
+ */
+static int lat_thread_fn(void *data){
+    struct lat_cpu *lc = data;
+    ktime_t next = ktime_get();
+    s64 late;
+
+    while (!kthread_should_stop()) {
+        next = ktime_add_us(next, READ_ONCE(period_us));
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (schedule_hrtimeout_range(&next, 0, HRTIMER_MODE_ABS))
+            continue;                       // woken by kthread_stop()
+
+        late = ktime_to_ns(ktime_sub(ktime_get(), next));
+        rt_hist_add(&lc->hist, late);
+        if (late > (s64)READ_ONCE(period_us) * NSEC_PER_USEC) {
+            rt_hist_overrun(&lc->hist);
+            next = ktime_get();
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Load - Take the shared lock over and over, like the 07 threads
+ */
+static int lock_thread_fn(void *data){
+    while (!kthread_should_stop()) {
+        if (lock_irqsoff) {
+            spin_lock_irq(&load_spin);
+            udelay(READ_ONCE(lock_hold_us));
+            spin_unlock_irq(&load_spin);
+        } else {
+            mutex_lock(&load_mutex);
+            udelay(READ_ONCE(lock_hold_us));
+            mutex_unlock(&load_mutex);
+        }
+        atomic64_inc(&lock_rounds);
+        cond_resched();
+    }
+    return 0;
+}
+
+/**
+ * @brief Load - One storm interrupt, busy for storm_cost_ns
+ */
+static irqreturn_t storm_irq_fn(int irq, void *dev_id){
+    ndelay(READ_ONCE(storm_cost_ns));
+    atomic64_inc(&storm_count);
+    return IRQ_HANDLED;
+}
+
+static int hist_show(struct seq_file *m, void *v){
+    struct rt_hist **hists;
+    struct lat_cpu *lc;
+    unsigned int n = 0;
+    int *ids;
+    int cpu;
+
+    hists = kcalloc(nr_cpu_ids, sizeof(*hists), GFP_KERNEL);
+    ids = kcalloc(nr_cpu_ids, sizeof(*ids), GFP_KERNEL);
+    if (!hists || !ids) {
+        kfree(hists);
+        kfree(ids);
+        return -ENOMEM;
+    }
+
+    for_each_online_cpu(cpu) {
+        lc = per_cpu_ptr(lat_cpus, cpu);
+        if (!lc->thread)
+            continue;
+        hists[n] = &lc->hist;
+        ids[n++] = cpu;
+    }
+
+    seq_printf(m, "# period_us %u rt_prio %d\n", READ_ONCE(period_us), rt_prio);
+    rt_hist_show(m, hists, ids, n, "cpu");
+    kfree(hists);
+    kfree(ids);
+    return 0;
+}
+
+static int hist_open(struct inode *inode, struct file *file){
+    return single_open(file, hist_show, NULL);
+}
+
+/* Any write resets, every thread clears its own CPU before the next sample */
+static ssize_t hist_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos){
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        rt_hist_reset(&per_cpu_ptr(lat_cpus, cpu)->hist);
+    return count;
+}
+
+static const struct file_operations hist_fops = {
+    .owner = THIS_MODULE,
+    .open = hist_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+    .write = hist_write,
+};
+
+static int load_show(struct seq_file *m, void *v){
+    seq_printf(m, "lock_threads %u %s hold_us %u rounds %lld\n", lock_threads,
+               lock_irqsoff ? "spin_irq" : "mutex", READ_ONCE(lock_hold_us),
+               (long long)atomic64_read(&lock_rounds));
+    seq_printf(m, "storm_gpio %d cost_ns %u irqs %lld\n", storm_gpio, READ_ONCE(storm_cost_ns),
+               (long long)atomic64_read(&storm_count));
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(load);
+
+static void lat_threads_stop(void){
+    struct lat_cpu *lc;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        lc = per_cpu_ptr(lat_cpus, cpu);
+        if (lc->thread)
+            kthread_stop(lc->thread);
+        lc->thread = NULL;
+    }
+}
+
+static int lat_threads_start(void){
+    struct task_struct *t;
+    struct lat_cpu *lc;
+    int cpu, ret;
+
+    cpus_read_lock();
+    for_each_online_cpu(cpu) {
+        lc = per_cpu_ptr(lat_cpus, cpu);
+        rt_hist_init(&lc->hist);
+        t = kthread_create_on_cpu(lat_thread_fn, lc, cpu, "lat_bench/%u");
+        if (IS_ERR(t)) {
+            cpus_read_unlock();
+            printk("ERROR: Fail to create the thread of cpu %d\n", cpu);
+            return PTR_ERR(t);
+        }
+        // Not worth measuring at SCHED_OTHER, give up instead
+        ret = rt_sched_set_prio(t, clamp(rt_prio, 1, MAX_RT_PRIO - 1));
+        if (ret) {
+            cpus_read_unlock();
+            kthread_stop(t);
+            printk("ERROR: Fail to set SCHED_FIFO on cpu %d\n", cpu);
+            return ret;
+        }
+        lc->thread = t;
+        wake_up_process(t);
+    }
+    cpus_read_unlock();
+    return 0;
+}
+
+static void load_stop(void){
+    unsigned int i;
+
+    if (storm_irq >= 0) {
+        free_irq(storm_irq, NULL);
+        gpio_free(storm_gpio);
+        storm_irq = -1;
+    }
+    for (i = 0; lock_tasks && i < lock_threads; i++) {
+        if (lock_tasks[i])
+            kthread_stop(lock_tasks[i]);
+    }
+    kfree(lock_tasks);
+    lock_tasks = NULL;
+}
+
+static int load_start(void){
+    struct task_struct *t;
+    unsigned int i;
+    int irq, ret;
+
+    if (lock_threads) {
+        lock_tasks = kcalloc(lock_threads, sizeof(*lock_tasks), GFP_KERNEL);
+        if (!lock_tasks)
+            return -ENOMEM;
+        for (i = 0; i < lock_threads; i++) {
+            t = kthread_run(lock_thread_fn, NULL, "lat_lock/%u", i);
+            if (IS_ERR(t)) {
+                printk("ERROR: Fail to create lock thread %u\n", i);
+                return PTR_ERR(t);
+            }
+            lock_tasks[i] = t;
+        }
+    }
+
+    if (storm_gpio >= 0) {
+        ret = gpio_request(storm_gpio, "storm_gpio");
+        if (ret) {
+            printk("ERROR: Fail to request gpio %d\n", storm_gpio);
+            return ret;
+        }
+        ret = gpio_direction_input(storm_gpio);
+        irq = ret ? ret : gpio_to_irq(storm_gpio);
+        if (irq < 0) {
+            printk("ERROR: Fail to get IRQ for GPIO %d\n", storm_gpio);
+            gpio_free(storm_gpio);
+            return irq;
+        }
+        ret = request_irq(irq, storm_irq_fn, IRQF_TRIGGER_FALLING | IRQF_TRIGGER_RISING, "lat_storm", NULL);
+        if (ret) {
+            printk("ERROR: Fail to register irq handler\n");
+            gpio_free(storm_gpio);
+            return ret;
+        }
+        storm_irq = irq;
+    }
+    return 0;
+}
+
+static int __init lat_init(void){
+    int ret;
+
+    lat_cpus = alloc_percpu(struct lat_cpu);
+    if (!lat_cpus)
+        return -ENOMEM;
+
+    ret = load_start();
+    if (ret)
+        goto load_err;
+
+    ret = lat_threads_start();
+    if (ret)
+        goto thread_err;
+
+    debug_dir = debugfs_create_dir("latency_bench", NULL);
+    debugfs_create_file("histogram", 0644, debug_dir, NULL, &hist_fops);
+    debugfs_create_file("load", 0444, debug_dir, NULL, &load_fops);
+
+    printk("INFO: Latency bench running, period %u us\n", period_us);
+    return 0;
+
+thread_err:
+    lat_threads_stop();
+load_err:
+    load_stop();
+    free_percpu(lat_cpus);
+    return ret;
+}
+
+static void __exit lat_exit(void){
+    debugfs_remove_recursive(debug_dir);
+    lat_threads_stop();
+    load_stop();
+    free_percpu(lat_cpus);
+    printk("INFO: Module is removed\n");
+}
+
+module_init(lat_init);
+module_exit(lat_exit);
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Wakeup latency with and without an interrupt storm from a gpio-sim line
+#
+#   sudo ./storm.sh [seconds] [module parameters ...]
+#
+# e.g. ./storm.sh 30 period_us=500 lock_threads=4 lock_irqsoff=1
+# Needs CONFIG_GPIO_SIM, CONFIG_GPIO_SYSFS, configfs and debugfs mounted.
+set -e
+
+SECS=${1:-30}
+[ $# -gt 0 ] && shift
+CFG=/sys/kernel/config/gpio-sim/storm
+DBG=/sys/kernel/debug/latency_bench
+HERE=$(dirname "$0")
+
+cleanup() {
+    [ -n "$PID" ] && kill $PID 2>/dev/null
+    rmmod latency_bench 2>/dev/null || true
+    [ -d $CFG ] || return 0
+    echo 0 > $CFG/live
+    rmdir $CFG/bank0 $CFG
+}
+trap cleanup EXIT
+
+modprobe gpio-sim
+mkdir $CFG $CFG/bank0
+echo 1 > $CFG/bank0/num_lines
+echo 1 > $CFG/live
+
+DEV=$(cat $CFG/dev_name)
+CHIP=$(cat $CFG/bank0/chip_name)
+BASE=$(cat /sys/devices/platform/$DEV/$CHIP/gpio/gpiochip*/base)
+PULL=/sys/devices/platform/$DEV/$CHIP/sim_gpio0/pull
+
+insmod $HERE/../latency_bench.ko storm_gpio=$BASE "$@"
+
+echo "== idle, $SECS s"
+echo 0 > $DBG/histogram
+sleep $SECS
+head -n 20 $DBG/histogram | grep '^#'
+
+echo "== interrupt storm, $SECS s"
+( while :; do echo pull-up > $PULL; echo pull-down > $PULL; done ) &
+PID=$!
+echo 0 > $DBG/histogram
+sleep $SECS
+kill $PID
+PID=
+grep '^#' $DBG/histogram
+cat $DBG/load
@@ -0,0 +1,416 @@
+#include<linux/module.h>
+#include<linux/init.h>
+#include<linux/kernel.h>
+#include<linux/fs.h>
+#include<linux/cdev.h>
+#include<linux/device.h>
+#include<linux/xarray.h>
+#include<linux/srcu.h>
+#include<linux/slab.h>
+#include<linux/poll.h>
+#include<linux/compat.h>
+#include "chrdev_core.h"
+
+#define CREATE_TRACE_POINTS
+#include "chrdev_trace.h"
+
+/*
+ * Every driver used to repeat alloc_chrdev_region, class_create,
+ * device_create, cdev_init and cdev_add, and the unwinding of all of them.
+ * A chrdev_class does it once for a range of minors. One cdev covers the
+ * whole range, so an instance is only a minor, an xarray entry and a
+ * device: creating thousands of them is cheap.
+ *
+ * open() finds the instance of the minor with one xa_load(). The other
+ * calls get it from file->private_data. Calls into the driver run in an
+ * SRCU read section; destroying instances marks them dead and waits for
+ * one grace period, for one instance or for the whole class.
+ */
+
+struct chrdev_class {
+    struct cdev cdev;
+    struct class *class;
+    dev_t base;
+    unsigned int max_minors;
+    const struct file_operations *fops;
+    struct xarray instances;            // minor -> chrdev_inst, reserved while created
+    struct srcu_struct srcu;            // calls into the driver
+};
+
+static void chrdev_inst_free(struct kref *ref)
+{
+    struct chrdev_inst *inst = container_of(ref, struct chrdev_inst, ref);
+
+    drv_stats_free(&inst->stats);
+    /* open() may still be looking at it */
+    kfree_rcu(inst, rcu);
+}
+
+static void chrdev_inst_put(struct chrdev_inst *inst)
+{
+    kref_put(&inst->ref, chrdev_inst_free);
+}
+
+/**
+ * @brief Start a call into the driver, false if the instance is destroyed
+ */
+static bool chrdev_enter(struct chrdev_inst *inst, int *idx)
+{
+    *idx = srcu_read_lock(&inst->cls->srcu);
+    if (!READ_ONCE(inst->dead))
+        return true;
+    srcu_read_unlock(&inst->cls->srcu, *idx);
+    return false;
+}
+
+static void chrdev_leave(struct chrdev_inst *inst, int idx)
+{
+    srcu_read_unlock(&inst->cls->srcu, idx);
+}
+
+/**
+ * @brief Count and trace a call
+ */
+static void chrdev_account(struct chrdev_inst *inst, int op, enum chrdev_stat stat,
+                           unsigned long arg, long ret)
+{
+    trace_chrdev_io(inst->devt, op, arg, ret);
+    drv_stats_inc(&inst->stats, stat);
+    if (ret < 0)
+        drv_stats_inc(&inst->stats, CHRDEV_STAT_ERRORS);
+    else if (op == CHRDEV_OP_READ)
+        drv_stats_add(&inst->stats, CHRDEV_STAT_BYTES_OUT, ret);
+    else if (op == CHRDEV_OP_WRITE)
+        drv_stats_add(&inst->stats, CHRDEV_STAT_BYTES_IN, ret);
+}
+
+static int chrdev_core_open(struct inode *inode, struct file *file)
+{
+    struct chrdev_class *cls = container_of(inode->i_cdev, struct chrdev_class, cdev);
+    struct chrdev_inst *inst;
+    int ret = 0, idx;
+
+    rcu_read_lock();
+    inst = xa_load(&cls->instances, iminor(inode));
+    if (inst && !kref_get_unless_zero(&inst->ref))
+        inst = NULL;
+    rcu_read_unlock();
+    if (!inst)
+        return -ENODEV;
+
+    file->private_data = inst;
+    if (!chrdev_enter(inst, &idx)) {
+        ret = -ENODEV;
+    } else {
+        if (cls->fops->open)
+            ret = cls->fops->open(inode, file);
+        chrdev_leave(inst, idx);
+    }
+
+    chrdev_account(inst, CHRDEV_OP_OPEN, CHRDEV_STAT_OPENS, 0, ret);
+    if (ret)
+        chrdev_inst_put(inst);
+    return ret;
+}
+
+static int chrdev_core_release(struct inode *inode, struct file *file)
+{
+    struct chrdev_inst *inst = file->private_data;
+    int idx;
+
+    if (inst->cls->fops->release && chrdev_enter(inst, &idx)) {
+        inst->cls->fops->release(inode, file);
+        chrdev_leave(inst, idx);
+    }
+    trace_chrdev_io(inst->devt, CHRDEV_OP_RELEASE, 0, 0);
+    chrdev_inst_put(inst);
+    return 0;
+}
+
+static ssize_t chrdev_core_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+    struct chrdev_inst *inst = file->private_data;
+    ssize_t ret = -EINVAL;
+    int idx;
+
+    if (!chrdev_enter(inst, &idx))
+        return -ENODEV;
+    if (inst->cls->fops->read)
+        ret = inst->cls->fops->read(file, buf, count, ppos);
+    chrdev_leave(inst, idx);
+
+    chrdev_account(inst, CHRDEV_OP_READ, CHRDEV_STAT_READS, count, ret);
+    return ret;
+}
+
+static ssize_t chrdev_core_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
+{
+    struct chrdev_inst *inst = file->private_data;
+    ssize_t ret = -EINVAL;
+    int idx;
+
+    if (!chrdev_enter(inst, &idx))
+        return -ENODEV;
+    if (inst->cls->fops->write)
+        ret = inst->cls->fops->write(file, buf, count, ppos);
+    chrdev_leave(inst, idx);
+
+    chrdev_account(inst, CHRDEV_OP_WRITE, CHRDEV_STAT_WRITES, count, ret);
+    return ret;
+}
+
+static long chrdev_core_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct chrdev_inst *inst = file->private_data;
+    long ret = -ENOTTY;
+    int idx;
+
+    if (!chrdev_enter(inst, &idx))
+        return -ENODEV;
+    if (inst->cls->fops->unlocked_ioctl)
+        ret = inst->cls->fops->unlocked_ioctl(file, cmd, arg);
+    chrdev_leave(inst, idx);
+
+    chrdev_account(inst, CHRDEV_OP_IOCTL, CHRDEV_STAT_IOCTLS, cmd, ret);
+    return ret;
+}
+
+static __poll_t chrdev_core_poll(struct file *file, poll_table *wait)
+{
+    struct chrdev_inst *inst = file->private_data;
+    __poll_t mask = DEFAULT_POLLMASK;
+    int idx;
+
+    if (!chrdev_enter(inst, &idx))
+        return EPOLLERR | EPOLLHUP;
+    if (inst->cls->fops->poll)
+        mask = inst->cls->fops->poll(file, wait);
+    chrdev_leave(inst, idx);
+    return mask;
+}
+
+static loff_t chrdev_core_llseek(struct file *file, loff_t offset, int whence)
+{
+    struct chrdev_inst *inst = file->private_data;
+    loff_t ret = -ESPIPE;
+    int idx;
+
+    if (!chrdev_enter(inst, &idx))
+        return -ENODEV;
+    if (inst->cls->fops->llseek)
+        ret = inst->cls->fops->llseek(file, offset, whence);
+    chrdev_leave(inst, idx);
+    return ret;
+}
+
+static const struct file_operations chrdev_core_fops = {
+    .owner          = THIS_MODULE,
+    .open           = chrdev_core_open,
+    .release        = chrdev_core_release,
+    .read           = chrdev_core_read,
+    .write          = chrdev_core_write,
+    .unlocked_ioctl = chrdev_core_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+    .poll           = chrdev_core_poll,
+    .llseek         = chrdev_core_llseek,
+};
+
+/* /sys/class/<class>/<dev>/stats */
+static ssize_t stats_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct chrdev_inst *inst = dev_get_drvdata(dev);
+    u64 v[NR_CHRDEV_STATS];
+
+    drv_stats_read(&inst->stats, v);
+    return sysfs_emit(buf, "opens %llu\nreads %llu\nwrites %llu\nioctls %llu\n"
+                      "bytes_in %llu\nbytes_out %llu\nerrors %llu\n",
+                      v[CHRDEV_STAT_OPENS], v[CHRDEV_STAT_READS], v[CHRDEV_STAT_WRITES],
+                      v[CHRDEV_STAT_IOCTLS], v[CHRDEV_STAT_BYTES_IN], v[CHRDEV_STAT_BYTES_OUT],
+                      v[CHRDEV_STAT_ERRORS]);
+}
+static DEVICE_ATTR_RO(stats);
+
+static struct attribute *chrdev_inst_attrs[] = {
+    &dev_attr_stats.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(chrdev_inst);
+
+/**
+ * @brief Allocate max_minors device numbers, a class and the cdev
+ * @return The class or an ERR_PTR()
+ */
+struct chrdev_class *chrdev_class_create(const char *class_name, const char *name,
+                                         unsigned int max_minors,
+                                         const struct file_operations *fops)
+{
+    struct chrdev_class *cls;
+    int ret;
+
+    if (!max_minors || max_minors > MINORMASK + 1)
+        return ERR_PTR(-EINVAL);
+
+    cls = kzalloc(sizeof(*cls), GFP_KERNEL);
+    if (!cls)
+        return ERR_PTR(-ENOMEM);
+    cls->max_minors = max_minors;
+    cls->fops = fops;
+    xa_init_flags(&cls->instances, XA_FLAGS_ALLOC);
+
+    ret = alloc_chrdev_region(&cls->base, 0, max_minors, name);
+    if (ret) {
+        printk("ERROR: Can not allocate %u device numbers for %s\n", max_minors, name);
+        goto regionError;
+    }
+
+    cls->class = class_create(class_name);
+    if (IS_ERR(cls->class)) {
+        ret = PTR_ERR(cls->class);
+        printk("ERROR: Can not create class %s\n", class_name);
+        goto classError;
+    }
+
+    ret = init_srcu_struct(&cls->srcu);
+    if (ret)
+        goto srcuError;
+
+    /* The driver stays loaded while a file is open */
+    cdev_init(&cls->cdev, &chrdev_core_fops);
+    cls->cdev.owner = fops->owner;
+    ret = cdev_add(&cls->cdev, cls->base, max_minors);
+    if (ret) {
+        printk("ERROR: Can not add the cdev of %s\n", name);
+        goto cdevError;
+    }
+
+    return cls;
+
+cdevError:
+    cleanup_srcu_struct(&cls->srcu);
+srcuError:
+    class_destroy(cls->class);
+classError:
+    unregister_chrdev_region(cls->base, max_minors);
+regionError:
+    kfree(cls);
+    return ERR_PTR(ret);
+}
+EXPORT_SYMBOL_GPL(chrdev_class_create);
+
+/**
+ * @brief Destroy every instance left and the class, meant for module exit
+ */
+void chrdev_class_destroy(struct chrdev_class *cls)
+{
+    struct chrdev_inst *inst;
+    unsigned long minor;
+
+    /* No new open, then one grace period for all of them */
+    cdev_del(&cls->cdev);
+    xa_for_each(&cls->instances, minor, inst) {
+        device_destroy(cls->class, inst->devt);
+        WRITE_ONCE(inst->dead, true);
+    }
+    synchronize_srcu(&cls->srcu);
+
+    xa_for_each(&cls->instances, minor, inst) {
+        xa_erase(&cls->instances, minor);
+        trace_chrdev_inst(inst->devt, false);
+        chrdev_inst_put(inst);
+    }
+
+    xa_destroy(&cls->instances);
+    cleanup_srcu_struct(&cls->srcu);
+    class_destroy(cls->class);
+    unregister_chrdev_region(cls->base, cls->max_minors);
+    kfree(cls);
+}
+EXPORT_SYMBOL_GPL(chrdev_class_destroy);
+
+/**
+ * @brief Create an instance on the first free minor, with a /dev node
+ * @return The instance or an ERR_PTR()
+ */
+struct chrdev_inst *chrdev_inst_create(struct chrdev_class *cls, void *priv, const char *fmt, ...)
+{
+    struct chrdev_inst *inst;
+    va_list args;
+    char *name;
+    u32 minor;
+    int ret;
+
+    inst = kzalloc(sizeof(*inst), GFP_KERNEL);
+    if (!inst)
+        return ERR_PTR(-ENOMEM);
+    inst->cls = cls;
+    inst->priv = priv;
+    kref_init(&inst->ref);
+
+    ret = drv_stats_init(&inst->stats, NR_CHRDEV_STATS);
+    if (ret)
+        goto statsError;
+
+    va_start(args, fmt);
+    name = kvasprintf(GFP_KERNEL, fmt, args);
+    va_end(args);
+    if (!name) {
+        ret = -ENOMEM;
+        goto nameError;
+    }
+
+    /* Reserved, open() does not see it before it is complete */
+    ret = xa_alloc(&cls->instances, &minor, NULL, XA_LIMIT(0, cls->max_minors - 1), GFP_KERNEL);
+    if (ret)
+        goto minorError;
+    inst->minor = minor;
+    inst->devt = MKDEV(MAJOR(cls->base), minor);
+
+    inst->dev = device_create_with_groups(cls->class, NULL, inst->devt, inst,
+                                          chrdev_inst_groups, "%s", name);
+    if (IS_ERR(inst->dev)) {
+        ret = PTR_ERR(inst->dev);
+        goto deviceError;
+    }
+
+    /* Open from here on; the slot is reserved, but check like any store */
+    ret = xa_err(xa_store(&cls->instances, minor, inst, GFP_KERNEL));
+    if (ret)
+        goto storeError;
+    trace_chrdev_inst(inst->devt, true);
+    kfree(name);
+    return inst;
+
+storeError:
+    device_destroy(cls->class, inst->devt);
+deviceError:
+    xa_erase(&cls->instances, minor);
+minorError:
+    kfree(name);
+nameError:
+    drv_stats_free(&inst->stats);
+statsError:
+    kfree(inst);
+    return ERR_PTR(ret);
+}
+EXPORT_SYMBOL_GPL(chrdev_inst_create);
+
+/**
+ * @brief Remove an instance, files still open on it get -ENODEV
+ */
+void chrdev_inst_destroy(struct chrdev_inst *inst)
+{
+    struct chrdev_class *cls = inst->cls;
+
+    device_destroy(cls->class, inst->devt);
+    WRITE_ONCE(inst->dead, true);
+    synchronize_srcu(&cls->srcu);
+
+    xa_erase(&cls->instances, inst->minor);
+    trace_chrdev_inst(inst->devt, false);
+    chrdev_inst_put(inst);
+}
+EXPORT_SYMBOL_GPL(chrdev_inst_destroy);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Hao Phan");
+MODULE_DESCRIPTION("Shared character device core");
@@ -0,0 +1,66 @@
+#ifndef __CHRDEV_CORE_H__
+#define __CHRDEV_CORE_H__
+
+#include <linux/fs.h>
+#include <linux/kref.h>
+#include "drv_shared.h"
+
+/*
+ * Character device core, see chrdev_core.c. A driver creates one
+ * chrdev_class (device numbers, class and a cdev covering every minor) and
+ * then any number of instances, each with its own minor and /dev node.
+ *
+ *   cls = chrdev_class_create("myClass", "mydev", 1024, &my_fops);
+ *   inst = chrdev_inst_create(cls, my_data, "mydev%d", n);
+ *   ...
+ *   chrdev_class_destroy(cls);          // also destroys every instance
+ *
+ * The core calls open, release, read, write, poll, unlocked_ioctl and
+ * llseek of the driver's fops with file->private_data set to the instance,
+ * chrdev_file_priv() gives the driver data. Calls are counted per instance
+ * (/sys/class/<class>/<dev>/stats) and traced (events/chrdev_core/).
+ * Once an instance is destroyed none of its callbacks runs anymore, files
+ * still open on it get -ENODEV.
+ */
+
+enum chrdev_stat {
+    CHRDEV_STAT_OPENS,
+    CHRDEV_STAT_READS,
+    CHRDEV_STAT_WRITES,
+    CHRDEV_STAT_IOCTLS,
+    CHRDEV_STAT_BYTES_IN,               // written by user space
+    CHRDEV_STAT_BYTES_OUT,              // read by user space
+    CHRDEV_STAT_ERRORS,                 // calls that returned an error
+    NR_CHRDEV_STATS,
+};
+
+struct chrdev_class;
+
+struct chrdev_inst {
+    struct chrdev_class *cls;
+    unsigned int minor;
+    dev_t devt;
+    struct device *dev;
+    void *priv;
+    struct drv_stats stats;
+    struct kref ref;                    // the table and every open file
+    bool dead;
+    struct rcu_head rcu;
+};
+
+struct chrdev_class *chrdev_class_create(const char *class_name, const char *name,
+                                         unsigned int max_minors,
+                                         const struct file_operations *fops);
+void chrdev_class_destroy(struct chrdev_class *cls);
+
+struct chrdev_inst *chrdev_inst_create(struct chrdev_class *cls, void *priv,
+                                       const char *fmt, ...) __printf(3, 4);
+/* No callback of the instance runs once it returns */
+void chrdev_inst_destroy(struct chrdev_inst *inst);
+
+static inline void *chrdev_file_priv(struct file *file)
+{
+    return ((struct chrdev_inst *)file->private_data)->priv;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM chrdev_core
+
+#if !defined(__CHRDEV_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __CHRDEV_TRACE_H__
+
+#include <linux/tracepoint.h>
+#include <linux/kdev_t.h>
+
+/*
+ *   echo 1 > /sys/kernel/tracing/events/chrdev_core/enable
+ *   cat /sys/kernel/tracing/trace_pipe
+ */
+
+#define CHRDEV_OP_OPEN      0
+#define CHRDEV_OP_RELEASE   1
+#define CHRDEV_OP_READ      2
+#define CHRDEV_OP_WRITE     3
+#define CHRDEV_OP_IOCTL     4
+
+TRACE_EVENT(chrdev_inst,
+
+    TP_PROTO(dev_t devt, bool create),
+
+    TP_ARGS(devt, create),
+
+    TP_STRUCT__entry(
+        __field(dev_t, devt)
+        __field(bool, create)
+    ),
+
+    TP_fast_assign(
+        __entry->devt = devt;
+        __entry->create = create;
+    ),
+
+    TP_printk("%d:%d %s", MAJOR(__entry->devt), MINOR(__entry->devt),
+              __entry->create ? "create" : "destroy")
+);
+
+TRACE_EVENT(chrdev_io,
+
+    TP_PROTO(dev_t devt, int op, unsigned long arg, long ret),
+
+    TP_ARGS(devt, op, arg, ret),
+
+    TP_STRUCT__entry(
+        __field(dev_t, devt)
+        __field(int, op)
+        __field(unsigned long, arg)
+        __field(long, ret)
+    ),
+
+    TP_fast_assign(
+        __entry->devt = devt;
+        __entry->op = op;
+        __entry->arg = arg;
+        __entry->ret = ret;
+    ),
+
+    /* arg is the byte count of read/write and the command of ioctl */
+    TP_printk("%d:%d %s arg=%#lx ret=%ld", MAJOR(__entry->devt), MINOR(__entry->devt),
+              __print_symbolic(__entry->op,
+                               { CHRDEV_OP_OPEN, "open" },
+                               { CHRDEV_OP_RELEASE, "release" },
+                               { CHRDEV_OP_READ, "read" },
+                               { CHRDEV_OP_WRITE, "write" },
+                               { CHRDEV_OP_IOCTL, "ioctl" }),
+              __entry->arg, __entry->ret)
+);
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE chrdev_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Create and tear down many instances of 01_character_driver on chrdev_core
+#
+#   sudo ./farm.sh [devices]
+#
+# Build 15_chrdev_core and 01_character_driver first.
+set -e
+
+N=${1:-4096}
+HERE=$(dirname "$0")
+CORE=$HERE/../chrdev_core.ko
+DRV=$HERE/../../01_character_driver/01_read_write.ko
+CLASS=/sys/class/myClass
+
+cleanup() {
+    rmmod 01_read_write 2>/dev/null || true
+    rmmod chrdev_core 2>/dev/null || true
+}
+trap cleanup EXIT
+
+lsmod | grep -q '^chrdev_core ' || insmod $CORE
+
+START=$(date +%s%N)
+insmod $DRV nr_devices=$N
+END=$(date +%s%N)
+echo "create $N devices: $(( (END - START) / 1000000 )) ms"
+
+COUNT=$(ls $CLASS | wc -l)
+echo "$COUNT devices in $CLASS"
+[ "$COUNT" -eq "$N" ]
+
+# Every instance has its own buffer and counters
+udevadm settle
+LAST=characterDriver$((N - 1))
+[ "$N" -gt 1 ] || LAST=characterDriver
+printf first > /dev/characterDriver
+printf last > /dev/$LAST
+# One read returns the whole last write
+[ "$(dd if=/dev/characterDriver bs=255 count=1 2>/dev/null)" = first ]
+[ "$(dd if=/dev/$LAST bs=255 count=1 2>/dev/null)" = last ]
+cat $CLASS/$LAST/stats
+
+START=$(date +%s%N)
+rmmod 01_read_write
+END=$(date +%s%N)
+echo "destroy $N devices: $(( (END - START) / 1000000 )) ms"
+echo PASS
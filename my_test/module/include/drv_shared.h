@@ -0,0 +1,160 @@
+#ifndef __DRV_SHARED_H__
+#define __DRV_SHARED_H__
+
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/rcupdate.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/overflow.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+
+/*
+ * State shared between syscalls, interrupts and threads.
+ *
+ * Statistics go in a drv_stats: n 64 bit counters per CPU. An update only
+ * touches the counters of the CPU it runs on, from any context, so writers
+ * never share a cache line. Readers add up every CPU. u64_stats_sync keeps
+ * the values whole on 32 bit CPUs and costs nothing on 64 bit ones.
+ *
+ *   drv_stats_init(&stats, NR_STATS);
+ *   drv_stats_inc(&stats, STAT_WRITES);                 // hot path
+ *   drv_stats_read(&stats, totals);                     // totals[NR_STATS]
+ *
+ * Configuration is a struct that is never changed once published. Readers
+ * use it under rcu_read_lock() without any lock; a writer fills in a new
+ * one and swaps it in with drv_config_publish(), the old one is released
+ * after every reader is done with it. The struct needs a member
+ * "struct rcu_head rcu".
+ *
+ *   rcu_read_lock();
+ *   cfg = rcu_dereference(my_cfg);
+ *   ... use cfg ...
+ *   rcu_read_unlock();
+ */
+
+struct drv_stats_cpu {
+    struct u64_stats_sync syncp;
+    u64_stats_t cnt[];
+};
+
+struct drv_stats {
+    struct drv_stats_cpu __percpu *cpu;
+    unsigned int n;
+};
+
+static inline int drv_stats_init(struct drv_stats *s, unsigned int n)
+{
+    struct drv_stats_cpu *c;
+    int cpu;
+
+    s->cpu = __alloc_percpu(struct_size(c, cnt, n), __alignof__(struct drv_stats_cpu));
+    if (!s->cpu)
+        return -ENOMEM;
+    for_each_possible_cpu(cpu)
+        u64_stats_init(&per_cpu_ptr(s->cpu, cpu)->syncp);
+    s->n = n;
+    return 0;
+}
+
+static inline void drv_stats_free(struct drv_stats *s)
+{
+    free_percpu(s->cpu);
+    s->cpu = NULL;
+}
+
+/**
+ * @brief Add to a counter of the local CPU, any context
+ */
+static inline void drv_stats_add(struct drv_stats *s, unsigned int idx, u64 val)
+{
+    struct drv_stats_cpu *c = get_cpu_ptr(s->cpu);
+    unsigned long flags;
+
+    flags = u64_stats_update_begin_irqsave(&c->syncp);
+    u64_stats_add(&c->cnt[idx], val);
+    u64_stats_update_end_irqrestore(&c->syncp, flags);
+    put_cpu_ptr(s->cpu);
+}
+
+#define drv_stats_inc(s, idx) drv_stats_add(s, idx, 1)
+
+/**
+ * @brief Sum of every counter over all CPUs, out has room for s->n values
+ */
+static inline void drv_stats_read(struct drv_stats *s, u64 *out)
+{
+    struct drv_stats_cpu *c;
+    unsigned int start, i;
+    int cpu;
+
+    memset(out, 0, s->n * sizeof(*out));
+    for_each_possible_cpu(cpu) {
+        c = per_cpu_ptr(s->cpu, cpu);
+        /* Added after the retry loop, a retry must not count twice */
+        for (i = 0; i < s->n; i++) {
+            u64 v;
+
+            do {
+                start = u64_stats_fetch_begin(&c->syncp);
+                v = u64_stats_read(&c->cnt[i]);
+            } while (u64_stats_fetch_retry(&c->syncp, start));
+            out[i] += v;
+        }
+    }
+}
+
+/**
+ * @brief Sum of one counter over all CPUs
+ */
+static inline u64 drv_stats_get(struct drv_stats *s, unsigned int idx)
+{
+    struct drv_stats_cpu *c;
+    unsigned int start;
+    u64 sum = 0, v;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        c = per_cpu_ptr(s->cpu, cpu);
+        do {
+            start = u64_stats_fetch_begin(&c->syncp);
+            v = u64_stats_read(&c->cnt[idx]);
+        } while (u64_stats_fetch_retry(&c->syncp, start));
+        sum += v;
+    }
+    return sum;
+}
+
+/*
+ * Swap in a new configuration, new may be NULL. lock serialises the
+ * writers, it is never taken by readers. The old struct is freed with
+ * kfree() after a grace period.
+ */
+#define drv_config_publish(slot, new, lock)                                 \
+do {                                                                        \
+    typeof(*(slot)) *__old;                                                 \
+                                                                            \
+    mutex_lock(lock);                                                       \
+    __old = rcu_replace_pointer(slot, new, lockdep_is_held(lock));          \
+    mutex_unlock(lock);                                                     \
+    if (__old)                                                              \
+        kfree_rcu(__old, rcu);                                              \
+} while (0)
+
+/*
+ * Same, for structs that hold references: release(&old->rcu) is called
+ * after a grace period instead of kfree().
+ */
+#define drv_config_publish_cb(slot, new, lock, release)                     \
+do {                                                                        \
+    typeof(*(slot)) *__old;                                                 \
+                                                                            \
+    mutex_lock(lock);                                                       \
+    __old = rcu_replace_pointer(slot, new, lockdep_is_held(lock));          \
+    mutex_unlock(lock);                                                     \
+    if (__old)                                                              \
+        call_rcu(&__old->rcu, release);                                     \
+} while (0)
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef __LED_BITMAP_H__
+#define __LED_BITMAP_H__
+
+#include <linux/bitmap.h>
+#include <linux/bits.h>
+#include <linux/errno.h>
+#include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+
+/*
+ * Set a group of LEDs with one write().
+ *
+ * The payload is either
+ *  - a bit string, one '0' or '1' per LED, LED 0 first, e.g. "10110010\n"
+ *  - a raw bitmap of BITS_TO_BYTES(n) bytes, LED 0 is bit 0 of byte 0
+ * The two are told apart by their length, so a single LED still takes the
+ * usual "0" and "1".
+ *
+ * The LEDs are then set with gpiod_set_array_value(). Lines on the same
+ * controller change with a single register write.
+ */
+
+#define LED_BITMAP_MAX 32
+
+/**
+ * @brief Parse a write() payload into a bitmap of nbits LEDs
+ */
+static inline int led_bitmap_parse(const char *buf, size_t len, unsigned long *bits, unsigned int nbits)
+{
+    size_t n = len;
+    unsigned int i;
+
+    bitmap_zero(bits, nbits);
+
+    /* Bit string */
+    if (n && buf[n - 1] == '\n')
+        n--;
+    if (n == nbits) {
+        for (i = 0; i < nbits && (buf[i] == '0' || buf[i] == '1'); i++) {
+            if (buf[i] == '1')
+                __set_bit(i, bits);
+        }
+        if (i == nbits)
+            return 0;
+        bitmap_zero(bits, nbits);
+    }
+
+    /* Raw bitmap, no bit may be set past the last LED */
+    if (len == BITS_TO_BYTES(nbits)) {
+        if (nbits % 8 && ((u8)buf[len - 1] >> (nbits % 8)))
+            return -EINVAL;
+        for (i = 0; i < nbits; i++) {
+            if (buf[i / 8] & BIT(i % 8))
+                __set_bit(i, bits);
+        }
+        return 0;
+    }
+
+    return -EINVAL;
+}
+
+/**
+ * @brief Format a bitmap as a bit string with a newline, returns the length
+ */
+static inline size_t led_bitmap_format(char *buf, const unsigned long *bits, unsigned int nbits)
+{
+    unsigned int i;
+
+    for (i = 0; i < nbits; i++)
+        buf[i] = test_bit(i, bits) ? '1' : '0';
+    buf[nbits] = '\n';
+    return nbits + 1;
+}
+
+/**
+ * @brief Request GPIO numbers as outputs, low, and get their descriptors
+ */
+static inline int led_gpios_request(const int *gpios, unsigned int n, struct gpio_desc **descs, const char *label)
+{
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+        ret = gpio_request(gpios[i], label);
+        if (ret) {
+            printk("ERROR: Fail to request gpio %d\n", gpios[i]);
+            goto err;
+        }
+        ret = gpio_direction_output(gpios[i], 0);
+        if (ret) {
+            printk("ERROR: Fail to set gpio %d as output\n", gpios[i]);
+            gpio_free(gpios[i]);
+            goto err;
+        }
+        descs[i] = gpio_to_desc(gpios[i]);
+    }
+    return 0;
+
+err:
+    while (i--)
+        gpio_free(gpios[i]);
+    return ret;
+}
+
+static inline void led_gpios_free(const int *gpios, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        gpio_set_value(gpios[i], 0);
+        gpio_free(gpios[i]);
+    }
+}
+
+#endif
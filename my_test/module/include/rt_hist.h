@@ -0,0 +1,211 @@
+#ifndef __RT_HIST_H__
+#define __RT_HIST_H__
+
+#include <linux/kernel.h>
+#include <linux/atomic.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+#include <linux/kstrtox.h>
+#include <linux/seq_file.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/u64_stats_sync.h>
+#include <uapi/linux/sched/types.h>
+
+/*
+ * Wakeup latency of a periodic thread, and the scheduling knobs of such
+ * threads. Used by 06_kthread/gpio_poller and 14_latency_bench.
+ *
+ * An rt_hist is written by one thread only, rt_hist_add() for every
+ * wakeup with how late it was. Readers get whole totals from
+ * rt_hist_read() on 32 bit CPUs too. A reset from a reader only raises a
+ * flag, the writer clears everything before its next sample, so there is
+ * never a second writer.
+ *
+ *   cat .../histogram                   summary, then one column per hist
+ *   echo 0 > .../histogram              rt_hist_reset() on each of them
+ */
+
+#define RT_HIST_BUCKETS 1000            // 1 us each, the last one is "more"
+
+struct rt_hist {
+    struct u64_stats_sync syncp;
+    u64_stats_t count;
+    u64_stats_t sum_ns;
+    u64_stats_t min_ns;
+    u64_stats_t max_ns;
+    u64_stats_t overruns;               // deadlines missed by a whole period
+    u64 bucket[RT_HIST_BUCKETS + 1];
+    atomic_t reset;
+};
+
+struct rt_hist_sum {
+    u64 count;
+    u64 sum_ns;
+    u64 min_ns;
+    u64 max_ns;
+    u64 overruns;
+};
+
+static inline void rt_hist_init(struct rt_hist *h)
+{
+    memset(h, 0, sizeof(*h));
+    u64_stats_init(&h->syncp);
+}
+
+/**
+ * @brief Record how late one wakeup was, writer only
+ * @return true if a pending reset was done first
+ */
+static inline bool rt_hist_add(struct rt_hist *h, s64 late_ns)
+{
+    u64 late = max_t(s64, late_ns, 0);
+    bool reset = atomic_xchg(&h->reset, 0);
+
+    u64_stats_update_begin(&h->syncp);
+    if (reset) {
+        u64_stats_set(&h->count, 0);
+        u64_stats_set(&h->sum_ns, 0);
+        u64_stats_set(&h->min_ns, 0);
+        u64_stats_set(&h->max_ns, 0);
+        u64_stats_set(&h->overruns, 0);
+        memset(h->bucket, 0, sizeof(h->bucket));
+    }
+    if (!u64_stats_read(&h->count) || late < u64_stats_read(&h->min_ns))
+        u64_stats_set(&h->min_ns, late);
+    if (late > u64_stats_read(&h->max_ns))
+        u64_stats_set(&h->max_ns, late);
+    u64_stats_add(&h->sum_ns, late);
+    u64_stats_inc(&h->count);
+    h->bucket[min_t(u64, div_u64(late, NSEC_PER_USEC), RT_HIST_BUCKETS)]++;
+    u64_stats_update_end(&h->syncp);
+    return reset;
+}
+
+/**
+ * @brief Count a deadline missed by a whole period, writer only
+ */
+static inline void rt_hist_overrun(struct rt_hist *h)
+{
+    u64_stats_update_begin(&h->syncp);
+    u64_stats_inc(&h->overruns);
+    u64_stats_update_end(&h->syncp);
+}
+
+/**
+ * @brief Ask the writer to clear the histogram before its next sample
+ */
+static inline void rt_hist_reset(struct rt_hist *h)
+{
+    atomic_set(&h->reset, 1);
+}
+
+static inline void rt_hist_read(struct rt_hist *h, struct rt_hist_sum *s)
+{
+    unsigned int start;
+
+    do {
+        start = u64_stats_fetch_begin(&h->syncp);
+        s->count = u64_stats_read(&h->count);
+        s->sum_ns = u64_stats_read(&h->sum_ns);
+        s->min_ns = u64_stats_read(&h->min_ns);
+        s->max_ns = u64_stats_read(&h->max_ns);
+        s->overruns = u64_stats_read(&h->overruns);
+    } while (u64_stats_fetch_retry(&h->syncp, start));
+}
+
+/**
+ * @brief Print n histograms side by side, column i is named <name><id[i]>
+ *
+ * Only the rows with at least one sample are printed, like cyclictest -h.
+ */
+static inline void rt_hist_show(struct seq_file *m, struct rt_hist *const *h, const int *id,
+                                unsigned int n, const char *name)
+{
+    struct rt_hist_sum s;
+    unsigned int i, j;
+    bool used;
+
+    for (j = 0; j < n; j++) {
+        rt_hist_read(h[j], &s);
+        seq_printf(m, "# %s%d samples %llu min_ns %llu avg_ns %llu max_ns %llu overruns %llu\n",
+                   name, id[j], s.count, s.min_ns, s.count ? div64_u64(s.sum_ns, s.count) : 0,
+                   s.max_ns, s.overruns);
+    }
+
+    seq_puts(m, "# latency_us");
+    for (j = 0; j < n; j++)
+        seq_printf(m, " %s%d", name, id[j]);
+    seq_putc(m, '\n');
+    for (i = 0; i <= RT_HIST_BUCKETS; i++) {
+        used = false;
+        for (j = 0; j < n; j++)
+            used |= READ_ONCE(h[j]->bucket[i]) != 0;
+        if (!used)
+            continue;
+        if (i == RT_HIST_BUCKETS)
+            seq_printf(m, ">%u", RT_HIST_BUCKETS - 1);
+        else
+            seq_printf(m, "%u", i);
+        for (j = 0; j < n; j++)
+            seq_printf(m, " %llu", READ_ONCE(h[j]->bucket[i]));
+        seq_putc(m, '\n');
+    }
+}
+
+/**
+ * @brief Parse an rt_prio parameter, 1-99 is SCHED_FIFO, 0 SCHED_OTHER
+ */
+static inline int rt_prio_parse(const char *val, int *prio)
+{
+    int new, ret;
+
+    ret = kstrtoint(val, 0, &new);
+    if (ret)
+        return ret;
+    if (new < 0 || new > MAX_RT_PRIO - 1)
+        return -EINVAL;
+    *prio = new;
+    return 0;
+}
+
+/**
+ * @brief Parse a cpu parameter, a possible CPU or -1 for any
+ */
+static inline int rt_cpu_parse(const char *val, int *cpu)
+{
+    int new, ret;
+
+    ret = kstrtoint(val, 0, &new);
+    if (ret)
+        return ret;
+    if (new < -1 || new >= (int)nr_cpu_ids || (new >= 0 && !cpu_possible(new)))
+        return -EINVAL;
+    *cpu = new;
+    return 0;
+}
+
+/**
+ * @brief SCHED_FIFO at prio, or SCHED_OTHER for 0
+ */
+static inline int rt_sched_set_prio(struct task_struct *t, int prio)
+{
+    struct sched_attr attr = {
+        .size = sizeof(attr),
+        .sched_policy = prio ? SCHED_FIFO : SCHED_NORMAL,
+        .sched_priority = prio,
+    };
+
+    return sched_setattr_nocheck(t, &attr);
+}
+
+/**
+ * @brief Run only on cpu, or on any CPU for -1. Not for per-CPU kthreads.
+ */
+static inline int rt_sched_set_cpu(struct task_struct *t, int cpu)
+{
+    return set_cpus_allowed_ptr(t, cpu >= 0 ? cpumask_of(cpu) : cpu_possible_mask);
+}
+
+#endif
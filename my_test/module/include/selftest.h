@@ -0,0 +1,34 @@
+#ifndef __SELFTEST_H__
+#define __SELFTEST_H__
+
+#include <linux/completion.h>
+#include <linux/fs.h>
+#include <linux/errno.h>
+
+/*
+ * LED self-test of 04, 05 and mini_project/00_led_control. Init lights the
+ * LEDs and schedules a delayed work that turns them off and calls
+ * complete_all(), so insmod does not wait for it. File operations that
+ * touch the LEDs wait for the completion first:
+ *
+ *   ret = selftest_wait_done(&init_done, file);
+ *   if (ret)
+ *       return ret;
+ *
+ * On exit, cancel the work and then turn the LEDs off, the work may not
+ * have run.
+ */
+
+/**
+ * @brief Wait until the self-test is over, -EAGAIN for O_NONBLOCK files
+ */
+static inline int selftest_wait_done(struct completion *done, struct file *file)
+{
+    if (completion_done(done))
+        return 0;
+    if (file->f_flags & O_NONBLOCK)
+        return -EAGAIN;
+    return wait_for_completion_interruptible(done);
+}
+
+#endif
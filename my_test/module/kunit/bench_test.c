@@ -0,0 +1,176 @@
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/ioctl.h>
+#include "led_bitmap.h"
+#include "misc_log.h"
+#include "misc_cmd.h"
+#include "ioctl.h"
+#include "lcd_encode.h"
+#include "drv_events_batch.h"
+#include "drv_shared.h"
+
+/*
+ * Cost of the hot path helpers, one case each. Every case prints
+ *
+ *   bench <name> <ns>.<hundredths> ns/op
+ *
+ * and only fails if the helper gave a wrong result; compare the numbers
+ * between runs. iters can be raised for steadier numbers:
+ *   kunit.py run ... --kernel_args bench_test.iters=N
+ */
+
+static unsigned int iters = 100000;
+module_param(iters, uint, 0444);
+MODULE_PARM_DESC(iters, "Calls per benchmark");
+
+static void bench_report(struct kunit *test, const char *name, u64 ns)
+{
+    u64 centi = div_u64(ns * 100, max(iters, 1U));
+
+    kunit_info(test, "bench %s %llu.%02llu ns/op\n", name, div_u64(centi, 100), centi % 100);
+}
+
+/* Time body, run iters times, it sees the iteration as __i */
+#define BENCH(test, name, body)                                             \
+do {                                                                        \
+    unsigned int __i;                                                       \
+    u64 __t0 = ktime_get_ns();                                              \
+                                                                            \
+    for (__i = 0; __i < iters; __i++) {                                     \
+        body;                                                               \
+    }                                                                       \
+    bench_report(test, name, ktime_get_ns() - __t0);                        \
+} while (0)
+
+static void bench_led_bitmap_parse(struct kunit *test)
+{
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+    const char *buf = "10110010101100101011001010110010\n";
+    size_t len = strlen(buf);
+
+    BENCH(test, "led_bitmap_parse", {
+        OPTIMIZER_HIDE_VAR(buf);
+        led_bitmap_parse(buf, len, bits, LED_BITMAP_MAX);
+    });
+    KUNIT_EXPECT_EQ(test, bits[0] & 1, 1UL);
+}
+
+static void bench_led_bitmap_format(struct kunit *test)
+{
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+    char buf[LED_BITMAP_MAX + 1];
+
+    bitmap_fill(bits, LED_BITMAP_MAX);
+    BENCH(test, "led_bitmap_format", {
+        led_bitmap_format(buf, bits, LED_BITMAP_MAX);
+        OPTIMIZER_HIDE_VAR(bits[0]);
+    });
+    KUNIT_EXPECT_EQ(test, buf[0], '1');
+}
+
+static void bench_misc_log_append(struct kunit *test)
+{
+    struct misc_log *log = kunit_kzalloc(test, sizeof(*log), GFP_KERNEL);
+    char msg[64];
+
+    KUNIT_ASSERT_NOT_NULL(test, log);
+    memset(msg, 'm', sizeof(msg));
+    /* Mostly on a full log, every append drops the oldest message */
+    BENCH(test, "misc_log_append", misc_log_append(log, msg, sizeof(msg)));
+    KUNIT_EXPECT_EQ(test, log->next_seq, (u64)iters);
+}
+
+static void bench_misc_cmd_parse(struct kunit *test)
+{
+    const char *cmds[] = { "1234", "trigger", "hello world" };
+    int pid, ret = 0;
+
+    BENCH(test, "misc_cmd_parse", {
+        const char *cmd = cmds[__i % ARRAY_SIZE(cmds)];
+
+        OPTIMIZER_HIDE_VAR(cmd);
+        ret += misc_cmd_parse(cmd, &pid);
+    });
+    KUNIT_EXPECT_GE(test, ret, 0);
+}
+
+static void bench_led_blink_valid(struct kunit *test)
+{
+    blink b = { .on_time_ms = 100, .off_time_ms = 100, .time = 10 };
+    unsigned int valid = 0;
+
+    BENCH(test, "led_blink_valid", {
+        OPTIMIZER_HIDE_VAR(b.time);
+        valid += led_blink_valid(&b);
+    });
+    KUNIT_EXPECT_EQ(test, valid, iters);
+}
+
+static void bench_lcd_encode(struct kunit *test)
+{
+    u8 out[LCD_XFER_LEN];
+
+    BENCH(test, "lcd_encode", {
+        lcd_encode(__i, __i & 1, out);
+        OPTIMIZER_HIDE_VAR(out[0]);
+    });
+    KUNIT_EXPECT_TRUE(test, out[0] & BACKLIGHT);
+}
+
+static void bench_drv_event_batch_add(struct kunit *test)
+{
+    struct drv_event_batch *b = kunit_kzalloc(test, sizeof(*b), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, b);
+    /* Sent when full, like flush_fn() does */
+    BENCH(test, "drv_event_batch_add", {
+        if (drv_event_batch_add(b, "led_control", __i, __i) == 1)
+            drv_event_batch_reset(b);
+    });
+    KUNIT_EXPECT_EQ(test, b->dropped, 0U);
+}
+
+static void bench_drv_stats_inc(struct kunit *test)
+{
+    struct drv_stats s;
+
+    KUNIT_ASSERT_EQ(test, drv_stats_init(&s, 1), 0);
+    BENCH(test, "drv_stats_inc", drv_stats_inc(&s, 0));
+    KUNIT_EXPECT_EQ(test, drv_stats_get(&s, 0), (u64)iters);
+    drv_stats_free(&s);
+}
+
+static void bench_drv_stats_read(struct kunit *test)
+{
+    struct drv_stats s;
+    u64 v[8];
+
+    KUNIT_ASSERT_EQ(test, drv_stats_init(&s, ARRAY_SIZE(v)), 0);
+    BENCH(test, "drv_stats_read", drv_stats_read(&s, v));
+    KUNIT_EXPECT_EQ(test, v[0], 0ULL);
+    drv_stats_free(&s);
+}
+
+static struct kunit_case bench_test_cases[] = {
+    KUNIT_CASE(bench_led_bitmap_parse),
+    KUNIT_CASE(bench_led_bitmap_format),
+    KUNIT_CASE(bench_misc_log_append),
+    KUNIT_CASE(bench_misc_cmd_parse),
+    KUNIT_CASE(bench_led_blink_valid),
+    KUNIT_CASE(bench_lcd_encode),
+    KUNIT_CASE(bench_drv_event_batch_add),
+    KUNIT_CASE(bench_drv_stats_inc),
+    KUNIT_CASE(bench_drv_stats_read),
+    {}
+};
+
+static struct kunit_suite bench_test_suite = {
+    .name = "my_test_bench",
+    .test_cases = bench_test_cases,
+};
+kunit_test_suite(bench_test_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Hao Phan");
+MODULE_DESCRIPTION("Microbenchmarks of the my_test hot path helpers");
@@ -0,0 +1,75 @@
+#include <kunit/test.h>
+#include "drv_events_batch.h"
+
+/* Event batches of 10_drv_events */
+
+static void drv_events_test_fill(struct kunit *test)
+{
+    struct drv_event_batch *b = kunit_kzalloc(test, sizeof(*b), GFP_KERNEL);
+    int i;
+
+    KUNIT_ASSERT_NOT_NULL(test, b);
+    for (i = 0; i < BATCH_MAX - 1; i++)
+        KUNIT_EXPECT_EQ(test, drv_event_batch_add(b, "dev", i, 1000 + i), 0);
+    /* The last one asks for an immediate send */
+    KUNIT_EXPECT_EQ(test, drv_event_batch_add(b, "dev", i, 1000 + i), 1);
+    KUNIT_EXPECT_EQ(test, b->count, (unsigned int)BATCH_MAX);
+
+    /* Oldest first */
+    for (i = 0; i < BATCH_MAX; i++) {
+        KUNIT_EXPECT_EQ(test, b->ev[i].value, (u32)i);
+        KUNIT_EXPECT_EQ(test, b->ev[i].time_ns, 1000ULL + i);
+    }
+}
+
+static void drv_events_test_drop(struct kunit *test)
+{
+    struct drv_event_batch *b = kunit_kzalloc(test, sizeof(*b), GFP_KERNEL);
+    int i;
+
+    KUNIT_ASSERT_NOT_NULL(test, b);
+    for (i = 0; i < BATCH_MAX; i++)
+        drv_event_batch_add(b, "dev", i, 0);
+
+    /* A full batch counts what it loses and keeps what it has */
+    for (i = 0; i < 5; i++)
+        KUNIT_EXPECT_EQ(test, drv_event_batch_add(b, "dev", 999, 0), -ENOSPC);
+    KUNIT_EXPECT_EQ(test, b->dropped, 5U);
+    KUNIT_EXPECT_EQ(test, b->ev[BATCH_MAX - 1].value, (u32)(BATCH_MAX - 1));
+
+    drv_event_batch_reset(b);
+    KUNIT_EXPECT_EQ(test, b->count, 0U);
+    KUNIT_EXPECT_EQ(test, b->dropped, 0U);
+    KUNIT_EXPECT_EQ(test, drv_event_batch_add(b, "dev", 1, 0), 0);
+}
+
+static void drv_events_test_source(struct kunit *test)
+{
+    struct drv_event_batch *b = kunit_kzalloc(test, sizeof(*b), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, b);
+    drv_event_batch_add(b, "led_control", 0, 0);
+    KUNIT_EXPECT_STREQ(test, b->ev[0].source, "led_control");
+
+    /* Long names are cut, always terminated */
+    drv_event_batch_add(b, "a_very_long_device_name", 0, 0);
+    KUNIT_EXPECT_EQ(test, strlen(b->ev[1].source), (size_t)DRV_EVENTS_SOURCE_LEN - 1);
+    KUNIT_EXPECT_EQ(test, strncmp(b->ev[1].source, "a_very_long_device_name", DRV_EVENTS_SOURCE_LEN - 1), 0);
+}
+
+static struct kunit_case drv_events_test_cases[] = {
+    KUNIT_CASE(drv_events_test_fill),
+    KUNIT_CASE(drv_events_test_drop),
+    KUNIT_CASE(drv_events_test_source),
+    {}
+};
+
+static struct kunit_suite drv_events_test_suite = {
+    .name = "drv_events",
+    .test_cases = drv_events_test_cases,
+};
+kunit_test_suite(drv_events_test_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Hao Phan");
+MODULE_DESCRIPTION("KUnit tests of the drv_events batches");
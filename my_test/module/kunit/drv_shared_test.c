@@ -0,0 +1,163 @@
+#include <kunit/test.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include "drv_shared.h"
+
+/* Per-CPU statistics and RCU configuration of drv_shared.h */
+
+#define STRESS_LOOPS 100000
+
+struct test_cfg {
+    struct rcu_head rcu;
+    int a;
+    int b;                              // always -a
+};
+
+struct stress_ctx {
+    struct drv_stats stats;
+    struct test_cfg __rcu *cfg;
+    struct mutex cfg_lock;
+    atomic_t running;
+    atomic_t torn;
+    struct completion done;
+};
+
+static void drv_stats_test_basic(struct kunit *test)
+{
+    struct drv_stats s;
+    u64 v[3];
+
+    KUNIT_ASSERT_EQ(test, drv_stats_init(&s, 3), 0);
+    drv_stats_inc(&s, 0);
+    drv_stats_inc(&s, 0);
+    drv_stats_add(&s, 2, 1ULL << 40);
+    drv_stats_read(&s, v);
+    KUNIT_EXPECT_EQ(test, v[0], 2ULL);
+    KUNIT_EXPECT_EQ(test, v[1], 0ULL);
+    KUNIT_EXPECT_EQ(test, v[2], 1ULL << 40);
+    KUNIT_EXPECT_EQ(test, drv_stats_get(&s, 2), 1ULL << 40);
+    drv_stats_free(&s);
+}
+
+static int stats_thread(void *data)
+{
+    struct stress_ctx *ctx = data;
+    int i;
+
+    for (i = 0; i < STRESS_LOOPS; i++) {
+        drv_stats_inc(&ctx->stats, 0);
+        drv_stats_add(&ctx->stats, 1, 3);
+    }
+    if (atomic_dec_and_test(&ctx->running))
+        complete(&ctx->done);
+    return 0;
+}
+
+/**
+ * @brief One thread per CPU updating the same counters, nothing is lost
+ */
+static void drv_stats_test_concurrent(struct kunit *test)
+{
+    struct stress_ctx *ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+    struct task_struct *t;
+    int cpu, n = 0;
+
+    KUNIT_ASSERT_NOT_NULL(test, ctx);
+    KUNIT_ASSERT_EQ(test, drv_stats_init(&ctx->stats, 2), 0);
+    init_completion(&ctx->done);
+
+    cpus_read_lock();
+    atomic_set(&ctx->running, num_online_cpus());
+    for_each_online_cpu(cpu) {
+        t = kthread_run_on_cpu(stats_thread, ctx, cpu, "stats_test/%u");
+        if (IS_ERR(t))
+            atomic_dec(&ctx->running);
+        else
+            n++;
+    }
+    cpus_read_unlock();
+    KUNIT_ASSERT_GT(test, n, 0);
+
+    wait_for_completion(&ctx->done);
+    KUNIT_EXPECT_EQ(test, drv_stats_get(&ctx->stats, 0), (u64)n * STRESS_LOOPS);
+    KUNIT_EXPECT_EQ(test, drv_stats_get(&ctx->stats, 1), (u64)n * STRESS_LOOPS * 3);
+    drv_stats_free(&ctx->stats);
+}
+
+static int cfg_reader(void *data)
+{
+    struct stress_ctx *ctx = data;
+    struct test_cfg *cfg;
+    int i;
+
+    for (i = 0; i < STRESS_LOOPS; i++) {
+        rcu_read_lock();
+        cfg = rcu_dereference(ctx->cfg);
+        if (cfg && cfg->a != -cfg->b)
+            atomic_inc(&ctx->torn);
+        rcu_read_unlock();
+        if (!(i % 1024))
+            cond_resched();
+    }
+    if (atomic_dec_and_test(&ctx->running))
+        complete(&ctx->done);
+    return 0;
+}
+
+/**
+ * @brief Readers on every CPU never see a half updated configuration
+ */
+static void drv_config_test_publish(struct kunit *test)
+{
+    struct stress_ctx *ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+    struct test_cfg *cfg;
+    struct task_struct *t;
+    int cpu, i;
+
+    KUNIT_ASSERT_NOT_NULL(test, ctx);
+    mutex_init(&ctx->cfg_lock);
+    init_completion(&ctx->done);
+
+    cpus_read_lock();
+    atomic_set(&ctx->running, num_online_cpus());
+    for_each_online_cpu(cpu) {
+        t = kthread_run_on_cpu(cfg_reader, ctx, cpu, "cfg_test/%u");
+        if (IS_ERR(t) && atomic_dec_and_test(&ctx->running))
+            complete(&ctx->done);
+    }
+    cpus_read_unlock();
+
+    for (i = 1; !completion_done(&ctx->done); i++) {
+        /* The readers use ctx, keep going until they are done */
+        cfg = kmalloc(sizeof(*cfg), GFP_KERNEL);
+        if (!cfg)
+            continue;
+        cfg->a = i;
+        cfg->b = -i;
+        drv_config_publish(ctx->cfg, cfg, &ctx->cfg_lock);
+        cond_resched();
+    }
+    wait_for_completion(&ctx->done);
+
+    KUNIT_EXPECT_EQ(test, atomic_read(&ctx->torn), 0);
+    drv_config_publish(ctx->cfg, NULL, &ctx->cfg_lock);
+    KUNIT_EXPECT_NULL(test, rcu_access_pointer(ctx->cfg));
+}
+
+static struct kunit_case drv_shared_test_cases[] = {
+    KUNIT_CASE(drv_stats_test_basic),
+    KUNIT_CASE(drv_stats_test_concurrent),
+    KUNIT_CASE(drv_config_test_publish),
+    {}
+};
+
+static struct kunit_suite drv_shared_test_suite = {
+    .name = "drv_shared",
+    .test_cases = drv_shared_test_cases,
+};
+kunit_test_suite(drv_shared_test_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Hao Phan");
+MODULE_DESCRIPTION("KUnit tests of drv_shared.h");
@@ -0,0 +1,73 @@
+#include <kunit/test.h>
+#include "lcd_encode.h"
+
+/* Port writes of lcd_send_command()/lcd_send_data() in 03_spi_lcd */
+
+static void lcd_encode_test_command(struct kunit *test)
+{
+    /* 0x28: 4 bit bus, 2 lines */
+    const u8 expect[LCD_XFER_LEN] = { 0x28, 0x2C, 0x28, 0x88, 0x8C, 0x88 };
+    u8 out[LCD_XFER_LEN];
+
+    lcd_encode(0x28, false, out);
+    KUNIT_EXPECT_MEMEQ(test, out, expect, LCD_XFER_LEN);
+}
+
+static void lcd_encode_test_data(struct kunit *test)
+{
+    /* 'A' with RS set */
+    const u8 expect[LCD_XFER_LEN] = { 0x49, 0x4D, 0x49, 0x19, 0x1D, 0x19 };
+    u8 out[LCD_XFER_LEN];
+
+    lcd_encode('A', true, out);
+    KUNIT_EXPECT_MEMEQ(test, out, expect, LCD_XFER_LEN);
+}
+
+/**
+ * @brief Every byte in both modes: what the LCD latches is what was sent
+ */
+static void lcd_encode_test_all(struct kunit *test)
+{
+    u8 out[LCD_XFER_LEN];
+    int byte, data, i;
+    u8 latched;
+
+    for (data = 0; data < 2; data++) {
+        for (byte = 0; byte < 256; byte++) {
+            lcd_encode(byte, data, out);
+            latched = 0;
+            for (i = 0; i < LCD_XFER_LEN; i++) {
+                /* Backlight always on, never a read, RS as asked */
+                KUNIT_EXPECT_TRUE(test, out[i] & BACKLIGHT);
+                KUNIT_EXPECT_FALSE(test, out[i] & 0x02);
+                KUNIT_EXPECT_EQ(test, !!(out[i] & LCD_RS), data);
+                /* EN only in the middle of each pulse, the data does not change around it */
+                KUNIT_EXPECT_EQ(test, !!(out[i] & ENABLE), i % 3 == 1);
+                if (i % 3 == 2) {
+                    KUNIT_EXPECT_EQ(test, out[i] | ENABLE, out[i - 1]);
+                    KUNIT_EXPECT_EQ(test, out[i], out[i - 2]);
+                    /* Latched on the falling edge of EN */
+                    latched = (latched << 4) | (out[i] >> 4);
+                }
+            }
+            KUNIT_EXPECT_EQ(test, latched, byte);
+        }
+    }
+}
+
+static struct kunit_case lcd_encode_test_cases[] = {
+    KUNIT_CASE(lcd_encode_test_command),
+    KUNIT_CASE(lcd_encode_test_data),
+    KUNIT_CASE(lcd_encode_test_all),
+    {}
+};
+
+static struct kunit_suite lcd_encode_test_suite = {
+    .name = "lcd_encode",
+    .test_cases = lcd_encode_test_cases,
+};
+kunit_test_suite(lcd_encode_test_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Hao Phan");
+MODULE_DESCRIPTION("KUnit tests of the 03_spi_lcd byte encoding");
@@ -0,0 +1,95 @@
+#include <kunit/test.h>
+#include "led_bitmap.h"
+
+/* write() payloads of 02, 05 and 09, see led_bitmap.h */
+
+static void led_bitmap_test_string(struct kunit *test)
+{
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+
+    KUNIT_ASSERT_EQ(test, led_bitmap_parse("10110010\n", 9, bits, 8), 0);
+    KUNIT_EXPECT_EQ(test, bits[0], 0x4DUL);
+
+    /* The newline is optional */
+    KUNIT_ASSERT_EQ(test, led_bitmap_parse("0001", 4, bits, 4), 0);
+    KUNIT_EXPECT_EQ(test, bits[0], 0x8UL);
+
+    /* A single LED still takes "0" and "1" */
+    KUNIT_ASSERT_EQ(test, led_bitmap_parse("1", 1, bits, 1), 0);
+    KUNIT_EXPECT_EQ(test, bits[0], 1UL);
+    KUNIT_ASSERT_EQ(test, led_bitmap_parse("0\n", 2, bits, 1), 0);
+    KUNIT_EXPECT_EQ(test, bits[0], 0UL);
+}
+
+static void led_bitmap_test_raw(struct kunit *test)
+{
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+
+    KUNIT_ASSERT_EQ(test, led_bitmap_parse("\xa5", 1, bits, 8), 0);
+    KUNIT_EXPECT_EQ(test, bits[0], 0xA5UL);
+
+    KUNIT_ASSERT_EQ(test, led_bitmap_parse("\xff\x0f", 2, bits, 12), 0);
+    KUNIT_EXPECT_EQ(test, bits[0], 0xFFFUL);
+
+    KUNIT_ASSERT_EQ(test, led_bitmap_parse("\x01\x02\x04\x80", 4, bits, 32), 0);
+    KUNIT_EXPECT_EQ(test, bits[0] & 0xFFFFFFFFUL, 0x80040201UL);
+}
+
+static void led_bitmap_test_invalid(struct kunit *test)
+{
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+
+    /* Wrong length */
+    KUNIT_EXPECT_EQ(test, led_bitmap_parse("101", 3, bits, 8), -EINVAL);
+    KUNIT_EXPECT_EQ(test, led_bitmap_parse("", 0, bits, 8), -EINVAL);
+    /* Not a bit string and too long for a bitmap */
+    KUNIT_EXPECT_EQ(test, led_bitmap_parse("10210010", 8, bits, 8), -EINVAL);
+    /* A bit past the last LED */
+    KUNIT_EXPECT_EQ(test, led_bitmap_parse("\xff\x1f", 2, bits, 12), -EINVAL);
+    KUNIT_EXPECT_EQ(test, led_bitmap_parse("x", 1, bits, 1), -EINVAL);
+    /* Nothing is left set after an error */
+    KUNIT_EXPECT_TRUE(test, bitmap_empty(bits, 12));
+}
+
+static void led_bitmap_test_format(struct kunit *test)
+{
+    DECLARE_BITMAP(bits, LED_BITMAP_MAX);
+    DECLARE_BITMAP(back, LED_BITMAP_MAX);
+    char buf[LED_BITMAP_MAX + 1];
+    unsigned int nbits;
+    size_t len;
+
+    bitmap_zero(bits, LED_BITMAP_MAX);
+    bitmap_set(bits, 1, 2);
+    len = led_bitmap_format(buf, bits, 5);
+    KUNIT_EXPECT_EQ(test, len, (size_t)6);
+    KUNIT_EXPECT_MEMEQ(test, buf, "01100\n", 6);
+
+    /* What read() returns can be written back */
+    for (nbits = 1; nbits <= LED_BITMAP_MAX; nbits++) {
+        bitmap_zero(bits, LED_BITMAP_MAX);
+        bitmap_set(bits, 0, nbits);
+        bitmap_clear(bits, nbits / 2, 1);
+        len = led_bitmap_format(buf, bits, nbits);
+        KUNIT_ASSERT_EQ(test, led_bitmap_parse(buf, len, back, nbits), 0);
+        KUNIT_EXPECT_TRUE(test, bitmap_equal(bits, back, nbits));
+    }
+}
+
+static struct kunit_case led_bitmap_test_cases[] = {
+    KUNIT_CASE(led_bitmap_test_string),
+    KUNIT_CASE(led_bitmap_test_raw),
+    KUNIT_CASE(led_bitmap_test_invalid),
+    KUNIT_CASE(led_bitmap_test_format),
+    {}
+};
+
+static struct kunit_suite led_bitmap_test_suite = {
+    .name = "led_bitmap",
+    .test_cases = led_bitmap_test_cases,
+};
+kunit_test_suite(led_bitmap_test_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Hao Phan");
+MODULE_DESCRIPTION("KUnit tests of led_bitmap.h");
@@ -0,0 +1,72 @@
+#include <kunit/test.h>
+#include <linux/ioctl.h>
+#include "ioctl.h"
+
+/* ioctl interface of 04_io_ctl */
+
+static void led_ioctl_test_blink_valid(struct kunit *test)
+{
+    blink b = { .on_time_ms = 100, .off_time_ms = 200, .time = 3 };
+
+    KUNIT_EXPECT_TRUE(test, led_blink_valid(&b));
+
+    b.time = 0;
+    KUNIT_EXPECT_TRUE(test, led_blink_valid(&b));
+    b.time = BLINK_MAX_TIMES;
+    KUNIT_EXPECT_TRUE(test, led_blink_valid(&b));
+    b.on_time_ms = 0;
+    b.off_time_ms = 0;
+    KUNIT_EXPECT_TRUE(test, led_blink_valid(&b));
+}
+
+static void led_ioctl_test_blink_invalid(struct kunit *test)
+{
+    blink b = { .on_time_ms = 100, .off_time_ms = 200, .time = 3 };
+
+    b.time = BLINK_MAX_TIMES + 1;
+    KUNIT_EXPECT_FALSE(test, led_blink_valid(&b));
+    b.time = -1;
+    KUNIT_EXPECT_FALSE(test, led_blink_valid(&b));
+
+    b.time = 3;
+    b.on_time_ms = -1;
+    KUNIT_EXPECT_FALSE(test, led_blink_valid(&b));
+    b.on_time_ms = 100;
+    b.off_time_ms = INT_MIN;
+    KUNIT_EXPECT_FALSE(test, led_blink_valid(&b));
+}
+
+static void led_ioctl_test_numbers(struct kunit *test)
+{
+    const unsigned int cmds[] = { IOCTL_LED_ON, IOCTL_LED_OFF, IOCTL_LED_TOGGLE, IOCTL_LED_BLINK };
+    int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(cmds); i++) {
+        KUNIT_EXPECT_EQ(test, _IOC_TYPE(cmds[i]), MAGIC_NUM);
+        KUNIT_EXPECT_EQ(test, _IOC_NR(cmds[i]), i);
+        for (j = 0; j < i; j++)
+            KUNIT_EXPECT_NE(test, cmds[i], cmds[j]);
+    }
+
+    /* The blink config goes from user space to the kernel */
+    KUNIT_EXPECT_EQ(test, _IOC_DIR(IOCTL_LED_BLINK), _IOC_WRITE);
+    KUNIT_EXPECT_EQ(test, _IOC_SIZE(IOCTL_LED_BLINK), sizeof(blink));
+    KUNIT_EXPECT_EQ(test, _IOC_DIR(IOCTL_LED_ON), _IOC_NONE);
+}
+
+static struct kunit_case led_ioctl_test_cases[] = {
+    KUNIT_CASE(led_ioctl_test_blink_valid),
+    KUNIT_CASE(led_ioctl_test_blink_invalid),
+    KUNIT_CASE(led_ioctl_test_numbers),
+    {}
+};
+
+static struct kunit_suite led_ioctl_test_suite = {
+    .name = "led_ioctl",
+    .test_cases = led_ioctl_test_cases,
+};
+kunit_test_suite(led_ioctl_test_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Hao Phan");
+MODULE_DESCRIPTION("KUnit tests of the 04_io_ctl ioctl interface");
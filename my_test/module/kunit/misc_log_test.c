@@ -0,0 +1,131 @@
+#include <kunit/test.h>
+#include "misc_log.h"
+#include "misc_cmd.h"
+
+/* Message log and write() protocol of 08_misc_device */
+
+#define MSG_MAX 127                     // BUF_SIZE - 1 in misc_device.c
+
+/* Message seq, its length depends on seq so records of every size show up */
+static size_t make_msg(char *buf, u64 seq)
+{
+    size_t len = 1 + seq * 7 % MSG_MAX;
+
+    memset(buf, 'a' + seq % 26, len);
+    return len;
+}
+
+/**
+ * @brief Walk the log like misc_read() does and check every record
+ */
+static void check_log(struct kunit *test, struct misc_log *log)
+{
+    struct misc_record *rec;
+    char msg[MSG_MAX];
+    u32 idx = log->first_idx;
+    size_t len;
+    u64 seq;
+
+    for (seq = log->first_seq; seq < log->next_seq; seq++) {
+        KUNIT_ASSERT_LT(test, idx, (u32)LOG_BUF_SIZE);
+        rec = misc_log_at(log, idx);
+        len = make_msg(msg, seq);
+        KUNIT_EXPECT_EQ(test, rec->seq, seq);
+        KUNIT_ASSERT_EQ(test, (size_t)rec->len, len);
+        KUNIT_EXPECT_MEMEQ(test, (char *)(rec + 1), msg, len);
+        /* Records never run past the end of the buffer */
+        KUNIT_EXPECT_LE(test, (char *)rec + rec->rec_len, log->buf + LOG_BUF_SIZE);
+        idx = misc_log_next(log, idx);
+    }
+    KUNIT_EXPECT_EQ(test, idx, log->next_idx);
+}
+
+static void misc_log_test_order(struct kunit *test)
+{
+    struct misc_log *log = kunit_kzalloc(test, sizeof(*log), GFP_KERNEL);
+    char msg[MSG_MAX];
+    u64 seq;
+
+    KUNIT_ASSERT_NOT_NULL(test, log);
+    for (seq = 0; seq < 10; seq++)
+        misc_log_append(log, msg, make_msg(msg, seq));
+
+    KUNIT_EXPECT_EQ(test, log->first_seq, 0ULL);
+    KUNIT_EXPECT_EQ(test, log->next_seq, 10ULL);
+    check_log(test, log);
+}
+
+static void misc_log_test_wrap(struct kunit *test)
+{
+    struct misc_log *log = kunit_kzalloc(test, sizeof(*log), GFP_KERNEL);
+    char msg[MSG_MAX];
+    u64 seq;
+
+    KUNIT_ASSERT_NOT_NULL(test, log);
+    /* Many times around the ring, checked after every message */
+    for (seq = 0; seq < 2000; seq++) {
+        misc_log_append(log, msg, make_msg(msg, seq));
+        check_log(test, log);
+        KUNIT_ASSERT_EQ(test, log->next_seq, seq + 1);
+    }
+
+    /* The oldest ones were dropped, never the last one */
+    KUNIT_EXPECT_GT(test, log->first_seq, 0ULL);
+    KUNIT_EXPECT_LT(test, log->first_seq, log->next_seq);
+}
+
+static void misc_log_test_full_size(struct kunit *test)
+{
+    struct misc_log *log = kunit_kzalloc(test, sizeof(*log), GFP_KERNEL);
+    char msg[MSG_MAX];
+    u32 size = ALIGN(sizeof(struct misc_record) + MSG_MAX, 8);
+    int i;
+
+    KUNIT_ASSERT_NOT_NULL(test, log);
+    memset(msg, 'z', sizeof(msg));
+    for (i = 0; i < 500; i++) {
+        misc_log_append(log, msg, MSG_MAX);
+        /* As many as fit, less the wrap marker and the record that would straddle */
+        KUNIT_EXPECT_GE(test, log->next_seq - log->first_seq,
+                        min_t(u64, i + 1, LOG_BUF_SIZE / size - 1));
+    }
+}
+
+static void misc_cmd_test_parse(struct kunit *test)
+{
+    int pid = -1;
+
+    KUNIT_EXPECT_EQ(test, misc_cmd_parse("1234", &pid), MISC_CMD_PID);
+    KUNIT_EXPECT_EQ(test, pid, 1234);
+    KUNIT_EXPECT_EQ(test, misc_cmd_parse("42\n", &pid), MISC_CMD_PID);
+    KUNIT_EXPECT_EQ(test, pid, 42);
+
+    KUNIT_EXPECT_EQ(test, misc_cmd_parse("12ab", &pid), -EINVAL);
+    KUNIT_EXPECT_EQ(test, misc_cmd_parse("99999999999", &pid), -EINVAL);
+
+    KUNIT_EXPECT_EQ(test, misc_cmd_parse("trigger", &pid), MISC_CMD_TRIGGER);
+    KUNIT_EXPECT_EQ(test, misc_cmd_parse("trigger\n", &pid), MISC_CMD_TRIGGER);
+
+    KUNIT_EXPECT_EQ(test, misc_cmd_parse("hello", &pid), MISC_CMD_STORE);
+    KUNIT_EXPECT_EQ(test, misc_cmd_parse("trig", &pid), MISC_CMD_STORE);
+    KUNIT_EXPECT_EQ(test, misc_cmd_parse("-1", &pid), MISC_CMD_STORE);
+    KUNIT_EXPECT_EQ(test, misc_cmd_parse("", &pid), MISC_CMD_STORE);
+}
+
+static struct kunit_case misc_log_test_cases[] = {
+    KUNIT_CASE(misc_log_test_order),
+    KUNIT_CASE(misc_log_test_wrap),
+    KUNIT_CASE(misc_log_test_full_size),
+    KUNIT_CASE(misc_cmd_test_parse),
+    {}
+};
+
+static struct kunit_suite misc_log_test_suite = {
+    .name = "misc_log",
+    .test_cases = misc_log_test_cases,
+};
+kunit_test_suite(misc_log_test_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Hao Phan");
+MODULE_DESCRIPTION("KUnit tests of the misc_device message log and commands");
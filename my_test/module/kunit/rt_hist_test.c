@@ -0,0 +1,89 @@
+#include <kunit/test.h>
+#include "rt_hist.h"
+
+/* Wakeup histogram and parameter parsing of rt_hist.h */
+
+static void rt_hist_test_add(struct kunit *test)
+{
+    struct rt_hist *h = kunit_kzalloc(test, sizeof(*h), GFP_KERNEL);
+    struct rt_hist_sum s;
+
+    KUNIT_ASSERT_NOT_NULL(test, h);
+    rt_hist_init(h);
+    KUNIT_EXPECT_FALSE(test, rt_hist_add(h, 1500));
+    rt_hist_add(h, 500);
+    rt_hist_add(h, -20);                /* early counts as 0 */
+    rt_hist_add(h, 5 * NSEC_PER_SEC);   /* past the last bucket */
+    rt_hist_overrun(h);
+
+    rt_hist_read(h, &s);
+    KUNIT_EXPECT_EQ(test, s.count, 4ULL);
+    KUNIT_EXPECT_EQ(test, s.min_ns, 0ULL);
+    KUNIT_EXPECT_EQ(test, s.max_ns, 5ULL * NSEC_PER_SEC);
+    KUNIT_EXPECT_EQ(test, s.sum_ns, 5ULL * NSEC_PER_SEC + 2000);
+    KUNIT_EXPECT_EQ(test, s.overruns, 1ULL);
+    KUNIT_EXPECT_EQ(test, h->bucket[0], 2ULL);
+    KUNIT_EXPECT_EQ(test, h->bucket[1], 1ULL);
+    KUNIT_EXPECT_EQ(test, h->bucket[RT_HIST_BUCKETS], 1ULL);
+}
+
+static void rt_hist_test_reset(struct kunit *test)
+{
+    struct rt_hist *h = kunit_kzalloc(test, sizeof(*h), GFP_KERNEL);
+    struct rt_hist_sum s;
+
+    KUNIT_ASSERT_NOT_NULL(test, h);
+    rt_hist_init(h);
+    rt_hist_add(h, 3000);
+    rt_hist_overrun(h);
+
+    /* Only done by the next sample, which is the first one after it */
+    rt_hist_reset(h);
+    rt_hist_read(h, &s);
+    KUNIT_EXPECT_EQ(test, s.count, 1ULL);
+    KUNIT_EXPECT_TRUE(test, rt_hist_add(h, 7000));
+    rt_hist_read(h, &s);
+    KUNIT_EXPECT_EQ(test, s.count, 1ULL);
+    KUNIT_EXPECT_EQ(test, s.min_ns, 7000ULL);
+    KUNIT_EXPECT_EQ(test, s.overruns, 0ULL);
+    KUNIT_EXPECT_EQ(test, h->bucket[3], 0ULL);
+    KUNIT_EXPECT_EQ(test, h->bucket[7], 1ULL);
+}
+
+static void rt_hist_test_parse(struct kunit *test)
+{
+    int v = 42;
+
+    KUNIT_EXPECT_EQ(test, rt_prio_parse("0", &v), 0);
+    KUNIT_EXPECT_EQ(test, v, 0);
+    KUNIT_EXPECT_EQ(test, rt_prio_parse("99\n", &v), 0);
+    KUNIT_EXPECT_EQ(test, v, 99);
+    KUNIT_EXPECT_EQ(test, rt_prio_parse("100", &v), -EINVAL);
+    KUNIT_EXPECT_EQ(test, rt_prio_parse("-1", &v), -EINVAL);
+    KUNIT_EXPECT_NE(test, rt_prio_parse("fifo", &v), 0);
+    KUNIT_EXPECT_EQ(test, v, 99);
+
+    KUNIT_EXPECT_EQ(test, rt_cpu_parse("-1", &v), 0);
+    KUNIT_EXPECT_EQ(test, v, -1);
+    KUNIT_EXPECT_EQ(test, rt_cpu_parse("0", &v), 0);
+    KUNIT_EXPECT_EQ(test, v, 0);
+    KUNIT_EXPECT_EQ(test, rt_cpu_parse("-2", &v), -EINVAL);
+    KUNIT_EXPECT_EQ(test, rt_cpu_parse("100000", &v), -EINVAL);
+}
+
+static struct kunit_case rt_hist_test_cases[] = {
+    KUNIT_CASE(rt_hist_test_add),
+    KUNIT_CASE(rt_hist_test_reset),
+    KUNIT_CASE(rt_hist_test_parse),
+    {}
+};
+
+static struct kunit_suite rt_hist_test_suite = {
+    .name = "rt_hist",
+    .test_cases = rt_hist_test_cases,
+};
+kunit_test_suite(rt_hist_test_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Hao Phan");
+MODULE_DESCRIPTION("KUnit tests of rt_hist.h");
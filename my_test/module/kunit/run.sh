@@ -0,0 +1,21 @@
+#!/bin/sh
+# Run every suite with kunit.py, on UML by default
+#
+#   ./run.sh <linux source> [kunit.py run options]
+#
+# e.g. ./run.sh ~/linux --arch=x86_64 for QEMU. The modules directory is
+# linked into the kernel tree as drivers/my_test, once.
+set -e
+
+LINUX=$(cd "$1" && pwd)
+shift
+MODULES=$(cd "$(dirname "$0")/.." && pwd)
+
+ln -sfn "$MODULES" "$LINUX/drivers/my_test"
+grep -q 'drivers/my_test/kunit/Kconfig' "$LINUX/drivers/Kconfig" ||
+    sed -i '$i source "drivers/my_test/kunit/Kconfig"' "$LINUX/drivers/Kconfig"
+grep -q 'my_test/kunit/' "$LINUX/drivers/Makefile" ||
+    echo 'obj-$(CONFIG_MY_TEST_KUNIT) += my_test/kunit/' >> "$LINUX/drivers/Makefile"
+
+cd "$LINUX"
+exec ./tools/testing/kunit/kunit.py run --kunitconfig=drivers/my_test/kunit "$@"